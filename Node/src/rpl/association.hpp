@@ -0,0 +1,459 @@
+#pragma once
+// Data association for the node's tracker (tracker.hpp): gating through a spatial index, then
+// global nearest neighbour or JPDA on independent clusters.
+//
+// Gating: the chi-square gate of a track, projected on range and azimuth, is a box. The boxes go
+// into a uniform range x azimuth grid rebuilt every frame (a counting sort into one array), and a
+// detection is only tested against the tracks whose box covers its cell. The tracker computes the
+// distance of those candidates and adds the pairs inside the gate (add), which makes the cost
+// matrix sparse from the start.
+//
+// Clusters: tracks and detections linked by gated pairs form connected components (union-find),
+// and each is solved on its own, so the cost is cubic in the largest cluster, not in the frame.
+//  - GNN: the most likely assignment. A pair costs minus its log likelihood ratio against clutter
+//    (so the clutter density and the track's uncertainty count, not only the distance), a track
+//    left without a detection -log(1 - pd): in dense clutter a wide, uncertain gate takes a
+//    detection only if it is much likelier the track's than clutter. Hungarian algorithm on the
+//    cluster's tracks x (detections + one "missed" column per track), O(tracks^2 x (detections +
+//    tracks)).
+//  - JPDA: the probability of every gated pair and of "no detection" per track, by enumerating
+//    the joint events of the cluster (as trackerJPDA in detection_tracking.m), or with the cheap
+//    JPDA approximation (Fitzgerald) when a cluster may have more than ASSOC_JPDA_MAX_EVENTS
+//    events (the product over its tracks of 1 + gated detections).
+//
+// Scratch memory grows to the largest frame seen and is reused; after that nothing is allocated.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define ASSOC_GRID_CELLS 64                 // per axis at most
+#define ASSOC_JPDA_MAX_EVENTS 20000         // joint events of a cluster JPDA enumerates, more are approximated
+#define ASSOC_PD 0.8                        // detection probability (detection_tracking.m)
+#define ASSOC_CLUTTER_DENSITY 0.0177        // false detections per m x rad x m/s: 5 in 18 m x 180 deg x 5 m/s (detection_tracking.m)
+#define ASSOC_BIG 1e12                      // cost of a pair outside the gate
+
+enum AssociationMode
+{
+    ASSOC_GNN,              // one detection per track, best global assignment
+    ASSOC_JPDA              // every gated detection, weighted by its probability
+};
+
+inline bool parse_association_mode(const std::string& s, AssociationMode& m)
+{
+    if (s == "gnn")
+        m = ASSOC_GNN;
+    else if (s == "jpda")
+        m = ASSOC_JPDA;
+    else
+        return false;
+    return true;
+}
+
+struct AssociationConfig
+{
+    AssociationMode mode = ASSOC_GNN;
+    double pd = ASSOC_PD;
+    double clutter_density = ASSOC_CLUTTER_DENSITY;
+};
+
+// What the last frame took
+struct AssociationStats
+{
+    int pairs;                  // gated track-detection pairs
+    int clusters;
+    int largest_tracks;         // tracks and detections of the largest cluster
+    int largest_detections;
+    int approximated;           // JPDA clusters solved with the cheap approximation
+    int births_dropped;         // detections in no gate that found the track store full (set by the tracker)
+    int64_t solve_ns;
+};
+
+// A track-detection pair inside the gate
+struct AssocPair
+{
+    int t, m;
+    double d2;                  // chi-square distance
+    double lr;                  // log likelihood ratio against clutter
+    double beta;                // JPDA: probability that m is t's detection
+};
+
+class Associator
+{
+    AssociationConfig cfg;
+    double miss_cost;
+
+    // Grid: cells of tracks, tracks' boxes in real units
+    double r0, a0, cell_r, cell_a;
+    int nr, na;
+    std::vector<int> cell_start, cell_tracks;
+    std::vector<double> box;                // per track: r_lo, r_hi, a_lo, a_hi
+
+    std::vector<AssocPair> pairs;
+    std::vector<int> track_first;           // pairs of track t: [track_first[t], track_first[t + 1])
+    std::vector<int> parent;                // union-find over tracks, then detections
+    std::vector<int> order;                 // pair indices grouped by cluster
+    std::vector<int> local;                 // index inside its cluster, per track and detection
+    std::vector<int> c_tracks, c_dets;      // the cluster being solved
+    std::vector<double> cost, u, v, minv;
+    std::vector<int> p, way;
+    std::vector<char> used;
+
+    // Results
+    std::vector<int> track_meas;            // GNN
+    std::vector<double> track_miss;         // JPDA: probability that no detection is the track's
+    std::vector<char> meas_gated;
+
+    // JPDA enumeration
+    std::vector<double> event_beta;         // per pair of the cluster
+    std::vector<double> event_miss;         // per track of the cluster
+    std::vector<int> event_pick;            // pair chosen per track, -1 none
+    std::vector<char> det_taken;
+
+    AssociationStats stats;
+
+    public:
+        Associator(const AssociationConfig& c = AssociationConfig())
+            : cfg(c), miss_cost(-std::log(1 - c.pd)), r0(0), a0(0), cell_r(1), cell_a(1), nr(0), na(0)
+        {
+            stats = AssociationStats();
+        }
+
+        const AssociationConfig& config() const { return cfg; }
+
+        // Builds the grid over the tracks' gate boxes: predicted range and azimuth, and the half
+        // widths of the gate along each
+        void index(const double* range, const double* azimuth, const double* half_range, const double* half_azimuth, int n)
+        {
+            box.resize(4 * n);
+            pairs.clear();
+            if (n == 0) {
+                nr = na = 0;
+                return;
+            }
+            double r_lo = 1e300, r_hi = -1e300, a_lo = 1e300, a_hi = -1e300, w_r = 0, w_a = 0;
+            for (int t = 0; t < n; t++) {
+                double* b = &box[4 * t];
+                b[0] = range[t] - half_range[t];
+                b[1] = range[t] + half_range[t];
+                b[2] = azimuth[t] - half_azimuth[t];
+                b[3] = azimuth[t] + half_azimuth[t];
+                r_lo = std::min(r_lo, b[0]);
+                r_hi = std::max(r_hi, b[1]);
+                a_lo = std::min(a_lo, b[2]);
+                a_hi = std::max(a_hi, b[3]);
+                w_r += 2 * half_range[t];
+                w_a += 2 * half_azimuth[t];
+            }
+            // Cells about the size of an average gate: a box covers a few cells, a cell holds few boxes
+            r0 = r_lo;
+            a0 = a_lo;
+            nr = std::max(1, std::min(ASSOC_GRID_CELLS, (int) std::ceil((r_hi - r_lo) / std::max(w_r / n, 1e-6))));
+            na = std::max(1, std::min(ASSOC_GRID_CELLS, (int) std::ceil((a_hi - a_lo) / std::max(w_a / n, 1e-9))));
+            cell_r = std::max((r_hi - r_lo) / nr, 1e-6);
+            cell_a = std::max((a_hi - a_lo) / na, 1e-9);
+
+            cell_start.assign(nr * na + 1, 0);
+            for (int pass = 0; pass < 2; pass++) {
+                for (int t = 0; t < n; t++) {
+                    const double* b = &box[4 * t];
+                    int i0 = cell(b[0], r0, cell_r, nr), i1 = cell(b[1], r0, cell_r, nr);
+                    int j0 = cell(b[2], a0, cell_a, na), j1 = cell(b[3], a0, cell_a, na);
+                    for (int i = i0; i <= i1; i++) {
+                        for (int j = j0; j <= j1; j++) {
+                            if (pass == 0)
+                                cell_start[i * na + j + 1]++;
+                            else
+                                cell_tracks[cell_start[i * na + j]++] = t;
+                        }
+                    }
+                }
+                if (pass == 0) {
+                    for (int c = 0; c < nr * na; c++)
+                        cell_start[c + 1] += cell_start[c];
+                    cell_tracks.resize(cell_start[nr * na]);
+                }
+                else {
+                    // The fill moved every start to the next cell's, shift back
+                    for (int c = nr * na; c > 0; c--)
+                        cell_start[c] = cell_start[c - 1];
+                    cell_start[0] = 0;
+                }
+            }
+        }
+
+        // Calls fn(t) for every track whose gate box holds the detection
+        template <typename F>
+        void candidates(double range, double azimuth, F fn) const
+        {
+            if (nr == 0)
+                return;
+            // Outside the grid lands in an edge cell, whose boxes then reject it
+            int c = cell(range, r0, cell_r, nr) * na + cell(azimuth, a0, cell_a, na);
+            for (int k = cell_start[c]; k < cell_start[c + 1]; k++) {
+                int t = cell_tracks[k];
+                const double* b = &box[4 * t];
+                if (range >= b[0] && range <= b[1] && azimuth >= b[2] && azimuth <= b[3])
+                    fn(t);
+            }
+        }
+
+        // A pair inside the gate
+        void add(int t, int m, double d2, double lr)
+        {
+            pairs.push_back({t, m, d2, lr, 0});
+        }
+
+        void solve(int n_tracks, int n_dets)
+        {
+            auto t0 = std::chrono::steady_clock::now();
+            stats = AssociationStats();
+            stats.pairs = pairs.size();
+            track_meas.assign(n_tracks, -1);
+            track_miss.assign(n_tracks, 1.0);
+            meas_gated.assign(n_dets, 0);
+
+            // Pairs by track, then clusters
+            std::sort(pairs.begin(), pairs.end(), [](const AssocPair& a, const AssocPair& b) {
+                return a.t != b.t ? a.t < b.t : a.m < b.m;
+            });
+            track_first.assign(n_tracks + 1, 0);
+            for (const AssocPair& q : pairs)
+                track_first[q.t + 1]++;
+            for (int t = 0; t < n_tracks; t++)
+                track_first[t + 1] += track_first[t];
+
+            parent.resize(n_tracks + n_dets);
+            for (int i = 0; i < n_tracks + n_dets; i++)
+                parent[i] = i;
+            for (const AssocPair& q : pairs) {
+                meas_gated[q.m] = 1;
+                int a = find(q.t), b = find(n_tracks + q.m);
+                if (a != b)
+                    parent[a] = b;
+            }
+            order.resize(pairs.size());
+            for (size_t i = 0; i < pairs.size(); i++)
+                order[i] = i;
+            std::sort(order.begin(), order.end(), [&](int a, int b) {
+                int ra = find(pairs[a].t), rb = find(pairs[b].t);
+                return ra != rb ? ra < rb : a < b;
+            });
+
+            local.assign(n_tracks + n_dets, -1);
+            for (size_t begin = 0; begin < order.size();) {
+                int root = find(pairs[order[begin]].t);
+                size_t end = begin;
+                c_tracks.clear();
+                c_dets.clear();
+                for (; end < order.size() && find(pairs[order[end]].t) == root; end++) {
+                    const AssocPair& q = pairs[order[end]];
+                    if (local[q.t] < 0) {
+                        local[q.t] = c_tracks.size();
+                        c_tracks.push_back(q.t);
+                    }
+                    if (local[n_tracks + q.m] < 0) {
+                        local[n_tracks + q.m] = c_dets.size();
+                        c_dets.push_back(q.m);
+                    }
+                }
+                stats.clusters++;
+                if (c_tracks.size() + c_dets.size() > (size_t) (stats.largest_tracks + stats.largest_detections)) {
+                    stats.largest_tracks = c_tracks.size();
+                    stats.largest_detections = c_dets.size();
+                }
+                if (cfg.mode == ASSOC_GNN)
+                    solve_gnn(n_tracks);
+                else
+                    solve_jpda(n_tracks);
+                for (int t : c_tracks)
+                    local[t] = -1;
+                for (int m : c_dets)
+                    local[n_tracks + m] = -1;
+                begin = end;
+            }
+            stats.solve_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+        }
+
+        // GNN: the detection assigned to track t, -1 for none
+        int assigned(int t) const { return track_meas[t]; }
+        // JPDA: track t's pairs, with beta set
+        const AssocPair* pairsBegin(int t) const { return pairs.data() + track_first[t]; }
+        const AssocPair* pairsEnd(int t) const { return pairs.data() + track_first[t + 1]; }
+        // JPDA: probability that none of the detections is track t's
+        double missProbability(int t) const { return track_miss[t]; }
+        // True if detection m is inside some track's gate
+        bool gated(int m) const { return meas_gated[m] != 0; }
+        const AssociationStats& getStats() const { return stats; }
+
+    private:
+        static int cell(double x, double x0, double size, int n)
+        {
+            return std::max(0, std::min(n - 1, (int) ((x - x0) / size)));
+        }
+
+        int find(int i)
+        {
+            while (parent[i] != i) {
+                parent[i] = parent[parent[i]];
+                i = parent[i];
+            }
+            return i;
+        }
+
+        // Hungarian algorithm (shortest augmenting paths with potentials), rows = tracks,
+        // columns = detections then one "missed" column per track
+        void solve_gnn(int n_tracks)
+        {
+            int n = c_tracks.size(), nd = c_dets.size(), m = nd + n;
+            if (n == 1 && nd == 1) {
+                if (-pairs[track_first[c_tracks[0]]].lr < miss_cost)
+                    track_meas[c_tracks[0]] = c_dets[0];
+                return;
+            }
+            cost.assign((size_t) n * m, ASSOC_BIG);
+            for (int i = 0; i < n; i++) {
+                cost[(size_t) i * m + nd + i] = miss_cost;
+                int t = c_tracks[i];
+                for (int k = track_first[t]; k < track_first[t + 1]; k++)
+                    cost[(size_t) i * m + local[n_tracks + pairs[k].m]] = -pairs[k].lr;
+            }
+
+            // 1-based rows and columns, column 0 is the virtual start
+            u.assign(n + 1, 0);
+            v.assign(m + 1, 0);
+            p.assign(m + 1, 0);
+            way.assign(m + 1, 0);
+            for (int i = 1; i <= n; i++) {
+                p[0] = i;
+                int j0 = 0;
+                minv.assign(m + 1, 1e300);
+                used.assign(m + 1, 0);
+                do {
+                    used[j0] = 1;
+                    int i0 = p[j0], j1 = 0;
+                    double delta = 1e300;
+                    const double* row = &cost[(size_t) (i0 - 1) * m];
+                    for (int j = 1; j <= m; j++) {
+                        if (used[j])
+                            continue;
+                        double cur = row[j - 1] - u[i0] - v[j];
+                        if (cur < minv[j]) {
+                            minv[j] = cur;
+                            way[j] = j0;
+                        }
+                        if (minv[j] < delta) {
+                            delta = minv[j];
+                            j1 = j;
+                        }
+                    }
+                    for (int j = 0; j <= m; j++) {
+                        if (used[j]) {
+                            u[p[j]] += delta;
+                            v[j] -= delta;
+                        }
+                        else {
+                            minv[j] -= delta;
+                        }
+                    }
+                    j0 = j1;
+                } while (p[j0] != 0);
+                do {
+                    int j1 = way[j0];
+                    p[j0] = p[j1];
+                    j0 = j1;
+                } while (j0 != 0);
+            }
+            for (int j = 1; j <= nd; j++) {
+                int i = p[j];
+                if (i > 0 && cost[(size_t) (i - 1) * m + j - 1] < ASSOC_BIG)
+                    track_meas[c_tracks[i - 1]] = c_dets[j - 1];
+            }
+        }
+
+        void solve_jpda(int n_tracks)
+        {
+            int n = c_tracks.size();
+            double bound = 1;
+            for (int t : c_tracks)
+                bound *= 1 + track_first[t + 1] - track_first[t];
+            if (bound > ASSOC_JPDA_MAX_EVENTS) {
+                stats.approximated++;
+                cheap_jpda(n_tracks);
+                return;
+            }
+            event_beta.assign(pairs.size(), 0);
+            event_miss.assign(n, 0);
+            event_pick.assign(n, -1);
+            det_taken.assign(c_dets.size(), 0);
+            double total = enumerate(0, 1.0, n_tracks);
+            if (!(total > 0)) {
+                stats.approximated++;
+                cheap_jpda(n_tracks);
+                return;
+            }
+            for (int i = 0; i < n; i++) {
+                int t = c_tracks[i];
+                track_miss[t] = event_miss[i] / total;
+                for (int k = track_first[t]; k < track_first[t + 1]; k++)
+                    pairs[k].beta = event_beta[k] / total;
+            }
+        }
+
+        // Sums the weights of all joint events of tracks [i, n) given the picks so far into the
+        // pairs and misses, returns the total weight
+        double enumerate(int i, double weight, int n_tracks)
+        {
+            if (i == (int) c_tracks.size()) {
+                for (int k = 0; k < i; k++) {
+                    if (event_pick[k] < 0)
+                        event_miss[k] += weight;
+                    else
+                        event_beta[event_pick[k]] += weight;
+                }
+                return weight;
+            }
+            int t = c_tracks[i];
+            event_pick[i] = -1;
+            double total = enumerate(i + 1, weight * (1 - cfg.pd), n_tracks);
+            for (int k = track_first[t]; k < track_first[t + 1]; k++) {
+                int d = local[n_tracks + pairs[k].m];
+                if (det_taken[d])
+                    continue;
+                det_taken[d] = 1;
+                event_pick[i] = k;
+                total += enumerate(i + 1, weight * likelihood(pairs[k]), n_tracks);
+                det_taken[d] = 0;
+            }
+            event_pick[i] = -1;
+            return total;
+        }
+
+        // beta = G / (sum over the track + sum over the detection - G + (1 - pd))
+        void cheap_jpda(int n_tracks)
+        {
+            std::vector<double>& det_sum = minv;     // scratch, per detection of the cluster
+            det_sum.assign(c_dets.size(), 0);
+            for (int t : c_tracks)
+                for (int k = track_first[t]; k < track_first[t + 1]; k++)
+                    det_sum[local[n_tracks + pairs[k].m]] += likelihood(pairs[k]);
+            for (int t : c_tracks) {
+                double track_sum = 0, assigned = 0;
+                for (int k = track_first[t]; k < track_first[t + 1]; k++)
+                    track_sum += likelihood(pairs[k]);
+                for (int k = track_first[t]; k < track_first[t + 1]; k++) {
+                    double g = likelihood(pairs[k]);
+                    pairs[k].beta = g / (track_sum + det_sum[local[n_tracks + pairs[k].m]] - g + (1 - cfg.pd));
+                    assigned += pairs[k].beta;
+                }
+                track_miss[t] = std::max(0.0, 1 - assigned);
+            }
+        }
+
+        static double likelihood(const AssocPair& q)
+        {
+            return std::exp(std::max(-700.0, std::min(700.0, q.lr)));
+        }
+};
@@ -0,0 +1,429 @@
+#pragma once
+// TCP uplink to the multi-node server on a thread of its own.
+//
+// send() copies a message into a bounded ring of reused buffers and returns: the frame path never
+// touches the socket, waits on the network or allocates once the buffers have grown. A full ring
+// applies the policy (drop the oldest or the newest message, or keep only the latest one), drops
+// are counted. The sender thread writes everything queued with one sendmsg (up to max_batch
+// messages), so a backlog after a stall goes out in few large writes.
+//
+// A connection that fails, or makes no progress for UPLINK_STALL_MS, is closed and reopened with
+// exponential backoff; messages keep queueing (and dropping) meanwhile. A message cut off by a
+// broken connection is dropped, the next connection starts at a message boundary.
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define UPLINK_QUEUE 64                 // messages waiting to be sent
+#define UPLINK_MAX_BATCH 16             // messages per sendmsg
+#define UPLINK_CONNECT_TIMEOUT_MS 2000
+#define UPLINK_STALL_MS 3000            // no bytes accepted for this long: reconnect
+#define UPLINK_BACKOFF_MIN_MS 100
+#define UPLINK_BACKOFF_MAX_MS 10000
+#define UPLINK_DRAIN_MS 1000            // stop() waits this long for the queue to go out
+
+enum UplinkPolicy
+{
+    UPLINK_DROP_OLDEST,     // a full queue drops its oldest message
+    UPLINK_DROP_NEWEST,     // ... or the message being sent
+    UPLINK_LATEST           // only the newest message waits, older unsent ones are replaced
+};
+
+inline const char* uplink_policy_name(UplinkPolicy p)
+{
+    switch (p) {
+        case UPLINK_DROP_OLDEST: return "drop_oldest";
+        case UPLINK_DROP_NEWEST: return "drop_newest";
+        case UPLINK_LATEST: return "latest";
+    }
+    return "?";
+}
+
+inline bool parse_uplink_policy(const std::string& s, UplinkPolicy& p)
+{
+    if (s == "drop_oldest")
+        p = UPLINK_DROP_OLDEST;
+    else if (s == "drop_newest")
+        p = UPLINK_DROP_NEWEST;
+    else if (s == "latest")
+        p = UPLINK_LATEST;
+    else
+        return false;
+    return true;
+}
+
+struct UplinkStats
+{
+    bool connected;
+    int depth, max_depth;               // messages queued now / at most
+    uint64_t queued, sent, dropped;     // messages
+    uint64_t bytes, reconnects;
+    int64_t latency_p50_ns, latency_p99_ns, latency_max_ns;     // send() to fully written
+};
+
+class AsyncUplink
+{
+    struct Message
+    {
+        std::vector<uint8_t> data;
+        int64_t t_queued_ns;
+    };
+
+    std::string host;
+    int port;
+    UplinkPolicy policy;
+    int max_batch;
+
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<Message> ring;          // under m, buffers are swapped with the sender's, never freed
+    int head, count;
+    bool running, stopping;
+    int64_t drain_deadline_ns;
+    std::thread sender;
+
+    std::mutex fd_lock;                 // fd changes, receive()
+    std::condition_variable connected_cv;
+    int fd;
+
+    std::mutex stats_lock;
+    LatencyHistogram latency;
+    int max_depth;                      // under m
+    std::atomic<uint64_t> queued, sent, dropped, bytes, reconnects;
+
+    public:
+        AsyncUplink(int capacity = UPLINK_QUEUE, UplinkPolicy p = UPLINK_DROP_OLDEST, int batch = UPLINK_MAX_BATCH)
+            : port(0), policy(p), max_batch(std::max(1, batch)), ring(std::max(1, capacity)), head(0), count(0),
+              running(false), stopping(false), drain_deadline_ns(0), fd(-1), max_depth(0),
+              queued(0), sent(0), dropped(0), bytes(0), reconnects(0) {}
+
+        ~AsyncUplink()
+        {
+            stop(0);
+        }
+
+        // Connects in the background, send() works right away
+        void start(const std::string& server, int server_port)
+        {
+            std::lock_guard<std::mutex> lock(m);
+            if (running)
+                return;
+            host = server;
+            port = server_port;
+            running = true;
+            stopping = false;
+            sender = std::thread(&AsyncUplink::send_loop, this);
+        }
+
+        // Sends what is queued for up to drain_ms while connected, then closes
+        void stop(int drain_ms = UPLINK_DRAIN_MS)
+        {
+            {
+                // send() refuses messages from here on, the drain sees everything queued before
+                std::lock_guard<std::mutex> lock(m);
+                if (!running || stopping)
+                    return;
+                stopping = true;
+                drain_deadline_ns = monotonic_ns() + (int64_t) drain_ms * 1000000;
+            }
+            cv.notify_all();
+            sender.join();
+            {
+                std::lock_guard<std::mutex> lock(m);
+                running = false;
+                dropped += count;       // not drained in time
+                count = 0;
+            }
+            set_fd(-1);
+            printStats("uplink");
+        }
+
+        // Queues a copy of the message. Returns false if the policy dropped it.
+        bool send(const void* data, size_t len)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m);
+                if (!running || stopping) {
+                    dropped++;
+                    return false;
+                }
+                int capacity = ring.size();
+                if (policy == UPLINK_LATEST && count > 0) {
+                    dropped += count;
+                    count = 0;
+                }
+                else if (count == capacity) {
+                    dropped++;
+                    if (policy == UPLINK_DROP_NEWEST)
+                        return false;
+                    head = (head + 1) % capacity;
+                    count--;
+                }
+                Message& msg = ring[(head + count) % capacity];
+                const uint8_t* p = static_cast<const uint8_t*>(data);
+                msg.data.assign(p, p + len);        // reuses the buffer's capacity
+                msg.t_queued_ns = monotonic_ns();
+                count++;
+                queued++;
+                if (count > max_depth)
+                    max_depth = count;
+            }
+            cv.notify_one();
+            return true;
+        }
+
+        // Messages waiting to be sent
+        int pending()
+        {
+            std::lock_guard<std::mutex> lock(m);
+            return count;
+        }
+
+        // Messages dropped so far, cheaper than stats() for a per-frame check
+        uint64_t getDropped() const { return dropped.load(); }
+
+        bool connected()
+        {
+            std::lock_guard<std::mutex> lock(fd_lock);
+            return fd >= 0;
+        }
+
+        // Reads what the server sent, waiting up to timeout_ms for a connection and data.
+        // Returns the bytes read, 0 on timeout or a closed connection, -1 on error.
+        // Waits on a duplicate of the socket with fd_lock released, so the sender thread can
+        // replace the connection meanwhile; set_fd() shuts the old one down, which ends the wait.
+        ssize_t receive(void* buf, size_t len, int timeout_ms)
+        {
+            int64_t deadline = monotonic_ns() + (int64_t) timeout_ms * 1000000;
+            int rfd;
+            {
+                std::unique_lock<std::mutex> lock(fd_lock);
+                if (!connected_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] { return fd >= 0; }))
+                    return 0;
+                rfd = dup(fd);
+            }
+            if (rfd < 0)
+                return -1;
+            int wait_ms = std::max<int64_t>(0, (deadline - monotonic_ns()) / 1000000);
+            struct pollfd pfd = {rfd, POLLIN, 0};
+            ssize_t r = poll(&pfd, 1, wait_ms);
+            if (r > 0)
+                r = recv(rfd, buf, len, 0);
+            close(rfd);
+            return r;
+        }
+
+        UplinkStats stats()
+        {
+            UplinkStats s;
+            {
+                std::lock_guard<std::mutex> lock(m);
+                s.depth = count;
+                s.max_depth = max_depth;
+            }
+            s.connected = connected();
+            s.queued = queued.load();
+            s.sent = sent.load();
+            s.dropped = dropped.load();
+            s.bytes = bytes.load();
+            s.reconnects = reconnects.load();
+            std::lock_guard<std::mutex> lock(stats_lock);
+            s.latency_p50_ns = latency.percentile(0.5);
+            s.latency_p99_ns = latency.percentile(0.99);
+            s.latency_max_ns = latency.max();
+            return s;
+        }
+
+        void printStats(const char* name)
+        {
+            UplinkStats s = stats();
+            printf("%s: %llu of %llu messages sent (%llu bytes), %llu dropped (%s), queue %d/%d max %d, "
+                   "%llu reconnects | send latency p50 %.2f ms p99 %.2f ms max %.2f ms\n",
+                   name, (unsigned long long) s.sent, (unsigned long long) s.queued, (unsigned long long) s.bytes,
+                   (unsigned long long) s.dropped, uplink_policy_name(policy), s.depth, (int) ring.size(), s.max_depth,
+                   (unsigned long long) s.reconnects, s.latency_p50_ns / 1e6, s.latency_p99_ns / 1e6, s.latency_max_ns / 1e6);
+        }
+
+    private:
+        void set_fd(int new_fd)
+        {
+            {
+                std::lock_guard<std::mutex> lock(fd_lock);
+                if (fd >= 0) {
+                    shutdown(fd, SHUT_RDWR);        // wakes a receive() waiting on a duplicate
+                    close(fd);
+                }
+                fd = new_fd;
+            }
+            if (new_fd >= 0)
+                connected_cv.notify_all();
+        }
+
+        // Non-blocking connect with a timeout. Returns the socket or -1.
+        int open_connection()
+        {
+            struct addrinfo hints, *res = NULL;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_INET;
+            hints.ai_socktype = SOCK_STREAM;
+            std::string service = std::to_string(port);
+            if (getaddrinfo(host.c_str(), service.c_str(), &hints, &res) != 0 || res == NULL)
+                return -1;
+            int s = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+            if (s < 0) {
+                freeaddrinfo(res);
+                return -1;
+            }
+            int r = connect(s, res->ai_addr, res->ai_addrlen);
+            freeaddrinfo(res);
+            if (r != 0 && errno != EINPROGRESS) {
+                close(s);
+                return -1;
+            }
+            if (r != 0) {
+                struct pollfd pfd = {s, POLLOUT, 0};
+                int err = 0;
+                socklen_t len = sizeof(err);
+                if (poll(&pfd, 1, UPLINK_CONNECT_TIMEOUT_MS) != 1 || getsockopt(s, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0) {
+                    close(s);
+                    return -1;
+                }
+            }
+            // Small messages at frame rate: no Nagle delay
+            int one = 1;
+            setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            setsockopt(s, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+            return s;
+        }
+
+        // Sleeps until the deadline or stop(). Returns false when stopping.
+        bool wait_until(int64_t t_ns)
+        {
+            std::unique_lock<std::mutex> lock(m);
+            int64_t wait = t_ns - monotonic_ns();
+            if (wait > 0)
+                cv.wait_for(lock, std::chrono::nanoseconds(wait), [this] { return stopping; });
+            return !stopping;
+        }
+
+        // Writes the batch. Returns false when the connection broke or stalled, written is the
+        // number of messages that made it out whole.
+        bool write_batch(int s, std::vector<Message>& batch, int n, int& written)
+        {
+            struct iovec iov[UPLINK_MAX_BATCH];
+            int first = 0;
+            size_t offset = 0;          // into batch[first]
+            int64_t last_progress = monotonic_ns();
+            while (first < n) {
+                int k = 0;
+                for (int i = first; i < n && k < UPLINK_MAX_BATCH; i++, k++) {
+                    size_t skip = i == first ? offset : 0;
+                    iov[k].iov_base = batch[i].data.data() + skip;
+                    iov[k].iov_len = batch[i].data.size() - skip;
+                }
+                struct msghdr mh;
+                memset(&mh, 0, sizeof(mh));
+                mh.msg_iov = iov;
+                mh.msg_iovlen = k;
+                ssize_t w = sendmsg(s, &mh, MSG_NOSIGNAL);
+                if (w < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                    return false;
+                if (w <= 0) {
+                    int64_t now = monotonic_ns();
+                    if (now - last_progress > (int64_t) UPLINK_STALL_MS * 1000000)
+                        return false;
+                    struct pollfd pfd = {s, POLLOUT, 0};
+                    poll(&pfd, 1, 100);
+                    continue;
+                }
+                last_progress = monotonic_ns();
+                bytes += w;
+                size_t left = w;
+                while (first < n && left >= batch[first].data.size() - offset) {
+                    left -= batch[first].data.size() - offset;
+                    offset = 0;
+                    done(batch[first]);
+                    first++;
+                }
+                offset += left;
+                written = first;
+            }
+            return true;
+        }
+
+        void done(const Message& msg)
+        {
+            sent++;
+            std::lock_guard<std::mutex> lock(stats_lock);
+            latency.add(monotonic_ns() - msg.t_queued_ns);
+        }
+
+        void send_loop()
+        {
+            Tracer::instance().name_thread("uplink");
+            std::vector<Message> batch(max_batch);
+            int backoff_ms = UPLINK_BACKOFF_MIN_MS;
+            bool warned = false, was_connected = false;
+            int s = -1;
+            for (;;) {
+                if (s < 0) {
+                    s = open_connection();
+                    if (s < 0) {
+                        if (!warned)
+                            fprintf(stderr, "Warning: cannot connect to the server %s:%d, retrying in the background\n", host.c_str(), port);
+                        warned = true;
+                        if (!wait_until(monotonic_ns() + (int64_t) backoff_ms * 1000000))
+                            return;
+                        backoff_ms = std::min(backoff_ms * 2, UPLINK_BACKOFF_MAX_MS);
+                        continue;
+                    }
+                    if (was_connected)
+                        reconnects++;
+                    was_connected = true;
+                    printf("Connected to the server %s:%d\n", host.c_str(), port);
+                    warned = false;
+                    backoff_ms = UPLINK_BACKOFF_MIN_MS;
+                    set_fd(s);
+                }
+
+                int n = 0;
+                {
+                    std::unique_lock<std::mutex> lock(m);
+                    cv.wait(lock, [this] { return stopping || count > 0; });
+                    if (stopping && (count == 0 || monotonic_ns() > drain_deadline_ns))
+                        return;
+                    int capacity = ring.size();
+                    for (; n < max_batch && count > 0; n++) {
+                        std::swap(batch[n], ring[head]);        // the sent buffer goes back into the ring
+                        head = (head + 1) % capacity;
+                        count--;
+                    }
+                }
+
+                TRACE_SCOPE("uplink send");
+                int written = 0;
+                if (!write_batch(s, batch, n, written)) {
+                    // What the batch did not get out is lost with the connection
+                    dropped += n - written;
+                    fprintf(stderr, "Warning: lost the connection to the server %s:%d, reconnecting\n", host.c_str(), port);
+                    set_fd(-1);
+                    s = -1;
+                    warned = true;
+                }
+            }
+        }
+};
@@ -0,0 +1,101 @@
+#pragma once
+// Writes small files on a background thread, for logging off the processing path.
+//
+// write() only queues the data. A full queue drops the entry (counted) instead of waiting, so a
+// slow SD card shows up as missing log files and never as a stalled frame.
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#define ASYNC_WRITER_QUEUE 256      // files waiting to be written
+
+class AsyncFileWriter
+{
+    std::deque<std::pair<std::string, std::string>> q;     // path, contents
+    std::mutex m;
+    std::condition_variable cv;
+    std::thread worker;
+    bool running;
+    std::atomic<uint64_t> written, dropped, failed;
+
+    public:
+        AsyncFileWriter() : running(false), written(0), dropped(0), failed(0) {}
+
+        ~AsyncFileWriter()
+        {
+            stop();
+        }
+
+        void start()
+        {
+            std::lock_guard<std::mutex> lock(m);
+            if (running)
+                return;
+            running = true;
+            worker = std::thread(&AsyncFileWriter::loop, this);
+        }
+
+        // Writes what is queued, then stops the thread
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m);
+                if (!running)
+                    return;
+                running = false;
+            }
+            cv.notify_one();
+            worker.join();
+            if (dropped > 0 || failed > 0)
+                fprintf(stderr, "Warning: async writer dropped %llu and failed %llu of %llu files\n",
+                        (unsigned long long) dropped.load(), (unsigned long long) failed.load(),
+                        (unsigned long long) (written.load() + dropped.load() + failed.load()));
+        }
+
+        // Queues data to be written to path (replacing the file). Returns false if it was dropped.
+        bool write(std::string path, const char* data, size_t len)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m);
+                if (!running || q.size() >= ASYNC_WRITER_QUEUE) {
+                    dropped++;
+                    return false;
+                }
+                q.emplace_back(std::move(path), std::string(data, len));
+            }
+            cv.notify_one();
+            return true;
+        }
+
+        uint64_t getWritten() const { return written.load(); }
+        uint64_t getDropped() const { return dropped.load(); }
+
+    private:
+        void loop()
+        {
+            std::unique_lock<std::mutex> lock(m);
+            for (;;) {
+                cv.wait(lock, [this] { return !running || !q.empty(); });
+                if (q.empty())
+                    return;
+                std::pair<std::string, std::string> item = std::move(q.front());
+                q.pop_front();
+                lock.unlock();
+
+                FILE* fp = fopen(item.first.c_str(), "w");
+                bool ok = fp != NULL && fwrite(item.second.data(), 1, item.second.size(), fp) == item.second.size();
+                if (fp != NULL && fclose(fp) != 0)
+                    ok = false;
+                if (ok)
+                    written++;
+                else
+                    failed++;
+                lock.lock();
+            }
+        }
+};
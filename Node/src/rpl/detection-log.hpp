@@ -0,0 +1,161 @@
+#pragma once
+// Columnar detection log, written by the offline batch processor (tools/batch).
+//
+// One file per capture, little endian:
+//   DetectionLogHeader                            64 bytes
+//   frame[records]        uint32   frame number (1-based, frame k starts at (k-1)*frame period)
+//   range_bin[records]    int32
+//   doppler_bin[records]  int32
+//   range[records]        float32  m
+//   doppler[records]      float32  bins from zero Doppler
+//   azimuth[records]      float32  deg
+//   elevation[records]    float32  deg
+//   snr[records]          float32
+// Every column is 4 bytes wide, so column c starts at 64 + c*4*records and can be read with a
+// single fread / np.fromfile. Rows are sorted by frame, frames without detections have no row.
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#define DETECTION_LOG_MAGIC "RDET"
+#define DETECTION_LOG_VERSION 1
+#define DETECTION_LOG_COLUMNS 8
+
+struct DetectionLogHeader
+{
+    char magic[4];              // DETECTION_LOG_MAGIC
+    uint32_t version;           // DETECTION_LOG_VERSION
+    int32_t fast_time;          // geometry the capture was processed with
+    int32_t slow_time;
+    int32_t rx;
+    int32_t tx;
+    float frame_period_ms;
+    uint32_t frames;            // frames processed, including those without detections
+    uint64_t records;           // rows in every column
+    uint32_t columns;           // DETECTION_LOG_COLUMNS
+    uint32_t reserved[5];
+};
+
+// Collects the detections of one capture in column order
+class DetectionLog
+{
+    std::vector<uint32_t> frame;
+    std::vector<int32_t> range_bin, doppler_bin;
+    std::vector<float> range, doppler, azimuth, elevation, snr;
+    uint32_t frames;
+
+    public:
+        DetectionLog() : frames(0) {}
+
+        void reserve(size_t rows)
+        {
+            frame.reserve(rows);
+            range_bin.reserve(rows);
+            doppler_bin.reserve(rows);
+            range.reserve(rows);
+            doppler.reserve(rows);
+            azimuth.reserve(rows);
+            elevation.reserve(rows);
+            snr.reserve(rows);
+        }
+
+        // Called for every frame in order, n = 0 for a frame without detections
+        void append(uint32_t id, const Detection* dets, int n)
+        {
+            for (int i = 0; i < n; i++) {
+                frame.push_back(id);
+                range_bin.push_back(dets[i].range_bin);
+                doppler_bin.push_back(dets[i].doppler_bin);
+                range.push_back(dets[i].range);
+                doppler.push_back(dets[i].doppler);
+                azimuth.push_back(dets[i].azimuth);
+                elevation.push_back(dets[i].elevation);
+                snr.push_back(dets[i].snr);
+            }
+            frames = std::max(frames, id);
+        }
+
+        size_t records() const { return frame.size(); }
+
+        // Returns false if the file cannot be written
+        bool write(const std::string& path, const FrameGeometry& g) const
+        {
+            FILE* fp = fopen(path.c_str(), "wb");
+            if (fp == NULL) {
+                perror("[ERROR] opening the detection log\n");
+                return false;
+            }
+            DetectionLogHeader h;
+            memset(&h, 0, sizeof(h));
+            memcpy(h.magic, DETECTION_LOG_MAGIC, 4);
+            h.version = DETECTION_LOG_VERSION;
+            h.fast_time = g.fast_time;
+            h.slow_time = g.slow_time;
+            h.rx = g.rx;
+            h.tx = g.tx;
+            h.frame_period_ms = g.frame_period_ms;
+            h.frames = frames;
+            h.records = records();
+            h.columns = DETECTION_LOG_COLUMNS;
+
+            size_t n = records();
+            bool ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+            ok = ok && fwrite(frame.data(), 4, n, fp) == n;
+            ok = ok && fwrite(range_bin.data(), 4, n, fp) == n;
+            ok = ok && fwrite(doppler_bin.data(), 4, n, fp) == n;
+            ok = ok && fwrite(range.data(), 4, n, fp) == n;
+            ok = ok && fwrite(doppler.data(), 4, n, fp) == n;
+            ok = ok && fwrite(azimuth.data(), 4, n, fp) == n;
+            ok = ok && fwrite(elevation.data(), 4, n, fp) == n;
+            ok = ok && fwrite(snr.data(), 4, n, fp) == n;
+            if (fclose(fp) != 0 || !ok) {
+                perror("[ERROR] writing the detection log\n");
+                return false;
+            }
+            return true;
+        }
+};
+
+// Reads a log back into rows. Returns false if the file is missing, truncated or not a log.
+inline bool read_detection_log(const std::string& path, DetectionLogHeader& h, std::vector<uint32_t>& frames,
+                               std::vector<Detection>& dets)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (fp == NULL) {
+        perror("[ERROR] opening the detection log\n");
+        return false;
+    }
+    if (fread(&h, sizeof(h), 1, fp) != 1 || memcmp(h.magic, DETECTION_LOG_MAGIC, 4) != 0 ||
+        h.version != DETECTION_LOG_VERSION || h.columns != DETECTION_LOG_COLUMNS) {
+        fprintf(stderr, "Error: %s is not a detection log\n", path.c_str());
+        fclose(fp);
+        return false;
+    }
+
+    size_t n = h.records;
+    std::vector<int32_t> ints(n);
+    std::vector<float> floats(n);
+    frames.resize(n);
+    dets.assign(n, Detection());
+    bool ok = fread(frames.data(), 4, n, fp) == n;
+    ok = ok && fread(ints.data(), 4, n, fp) == n;
+    for (size_t i = 0; ok && i < n; i++)
+        dets[i].range_bin = ints[i];
+    ok = ok && fread(ints.data(), 4, n, fp) == n;
+    for (size_t i = 0; ok && i < n; i++)
+        dets[i].doppler_bin = ints[i];
+    float Detection::* cols[5] = {&Detection::range, &Detection::doppler, &Detection::azimuth,
+                                  &Detection::elevation, &Detection::snr};
+    for (int c = 0; c < 5 && ok; c++) {
+        ok = fread(floats.data(), 4, n, fp) == n;
+        for (size_t i = 0; ok && i < n; i++)
+            dets[i].*cols[c] = floats[i];
+    }
+    fclose(fp);
+    if (!ok)
+        fprintf(stderr, "Error: %s is truncated\n", path.c_str());
+    return ok;
+}
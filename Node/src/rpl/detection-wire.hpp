@@ -0,0 +1,203 @@
+#pragma once
+// Binary uplink format for per-frame detection lists, shared by the node (WireEncoder) and the
+// fusion side (wire_decode). Standalone: no OpenCV/FFTW, include it on its own in a server.
+//
+// One message, little endian, every record a fixed size:
+//   WireHeader              24 bytes   magic, version, node id, message sequence, sizes
+//   then per frame (header.frames times):
+//   WireFrame               24 bytes   frame number, detection count, timestamps, Doppler step
+//   WireDetection[count]    40 bytes each
+// A message normally carries one frame, several when frames were batched on a congested link.
+// header.bytes is the whole message, so messages can be cut out of a TCP stream without any
+// other framing (wire_message_size).
+//
+// Versioning: a decoder rejects other major versions. Within a major version fields are only
+// appended to the end of a record; the header carries the record sizes, so an older decoder
+// skips fields it does not know and a newer one zero-fills the ones an older node did not send.
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#define WIRE_MAGIC "RDWP"
+#define WIRE_VERSION 1
+#define WIRE_MAX_FRAMES 256             // per message
+#define WIRE_MAX_DETECTIONS 1024        // per frame
+#define WIRE_FRAME_MORE 0x1             // WireFrame.flags: more records of this frame follow (split frames)
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "detection-wire.hpp writes host structs, big endian hosts need byte swapping"
+#endif
+
+struct WireHeader
+{
+    char magic[4];              // WIRE_MAGIC
+    uint16_t version;           // WIRE_VERSION
+    uint16_t node_id;
+    uint32_t seq;               // per node, +1 per message: gaps are lost messages
+    uint32_t bytes;             // whole message, this header included
+    uint16_t frames;
+    uint16_t frame_size;        // sizeof(WireFrame) of the sender
+    uint16_t detection_size;    // sizeof(WireDetection) of the sender
+    uint16_t reserved;
+};
+
+struct WireFrame
+{
+    uint32_t frame;             // frame number on the node
+    uint16_t detections;
+    uint16_t flags;             // WIRE_FRAME_*
+    int64_t t_wall_ns;          // CLOCK_REALTIME at acquisition, aligns nodes in time
+    uint32_t latency_us;        // acquisition to end of DSP
+    float doppler_step;         // m/s per Doppler bin of the detections, 0 if the sender did not say
+};
+
+// One detection with its measurement variances. Cross terms are not estimated (zero).
+struct WireDetection
+{
+    int16_t range_bin;
+    int16_t doppler_bin;
+    float range;                // m
+    float doppler;              // bins from zero Doppler
+    float azimuth;              // deg
+    float elevation;            // deg
+    float snr;
+    float var_range;            // m^2
+    float var_doppler;          // bins^2
+    float var_azimuth;          // deg^2
+    float var_elevation;        // deg^2
+};
+
+static_assert(sizeof(WireHeader) == 24, "WireHeader layout");
+static_assert(sizeof(WireFrame) == 24, "WireFrame layout");
+static_assert(sizeof(WireDetection) == 40, "WireDetection layout");
+
+// Builds messages into a reused buffer: begin(), add_frame() per frame, finish()
+class WireEncoder
+{
+    std::vector<uint8_t> buf;
+    uint16_t node_id;
+    uint32_t seq;
+    uint16_t frames;
+
+    public:
+        WireEncoder(uint16_t node = 0) : node_id(node), seq(0), frames(0)
+        {
+            begin();
+        }
+
+        void begin()
+        {
+            buf.resize(sizeof(WireHeader));
+            frames = 0;
+        }
+
+        // Returns false when the message is full (WIRE_MAX_FRAMES), send it and begin() again
+        bool add_frame(uint32_t frame, int64_t t_wall_ns, uint32_t latency_us, float doppler_step, const WireDetection* dets, int n, uint16_t flags = 0)
+        {
+            if (frames >= WIRE_MAX_FRAMES)
+                return false;
+            n = std::min(n, WIRE_MAX_DETECTIONS);
+            WireFrame f;
+            memset(&f, 0, sizeof(f));
+            f.frame = frame;
+            f.detections = n;
+            f.flags = flags;
+            f.t_wall_ns = t_wall_ns;
+            f.latency_us = latency_us;
+            f.doppler_step = doppler_step;
+            size_t off = buf.size();
+            buf.resize(off + sizeof(f) + n * sizeof(WireDetection));
+            memcpy(&buf[off], &f, sizeof(f));
+            if (n > 0)
+                memcpy(&buf[off + sizeof(f)], dets, n * sizeof(WireDetection));
+            frames++;
+            return true;
+        }
+
+        int pending() const { return frames; }
+
+        // Fills in the header. The message stays valid until the next begin().
+        const uint8_t* finish(size_t& len)
+        {
+            WireHeader h;
+            memset(&h, 0, sizeof(h));
+            memcpy(h.magic, WIRE_MAGIC, 4);
+            h.version = WIRE_VERSION;
+            h.node_id = node_id;
+            h.seq = seq++;
+            h.bytes = buf.size();
+            h.frames = frames;
+            h.frame_size = sizeof(WireFrame);
+            h.detection_size = sizeof(WireDetection);
+            memcpy(buf.data(), &h, sizeof(h));
+            len = buf.size();
+            return buf.data();
+        }
+};
+
+struct WireFrameRecord
+{
+    WireFrame frame;
+    std::vector<WireDetection> detections;
+};
+
+struct WireMessage
+{
+    WireHeader header;
+    std::vector<WireFrameRecord> frames;
+};
+
+// Size of the message at the start of a byte stream: 0 while fewer than sizeof(WireHeader)
+// bytes are there, -1 if the data is not a message of this major version
+inline long wire_message_size(const uint8_t* data, size_t len)
+{
+    if (len < sizeof(WireHeader))
+        return 0;
+    WireHeader h;
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, WIRE_MAGIC, 4) != 0 || h.version != WIRE_VERSION || h.bytes < sizeof(WireHeader))
+        return -1;
+    return h.bytes;
+}
+
+// Parses one complete message. Returns false on malformed input, with the reason in error.
+inline bool wire_decode(const uint8_t* data, size_t len, WireMessage& out, std::string* error = NULL)
+{
+    auto fail = [&](const char* why) {
+        if (error)
+            *error = why;
+        return false;
+    };
+    long size = wire_message_size(data, len);
+    if (size < 0)
+        return fail("bad magic or version");
+    if (size == 0 || (size_t) size > len)
+        return fail("truncated message");
+    memcpy(&out.header, data, sizeof(WireHeader));
+    const WireHeader& h = out.header;
+    if (h.frame_size < offsetof(WireFrame, doppler_step) || h.detection_size < offsetof(WireDetection, var_range))
+        return fail("record size too small");
+
+    // Records may be longer (newer sender) or shorter (older sender) than ours
+    size_t off = sizeof(WireHeader), end = size;
+    out.frames.resize(h.frames);
+    for (WireFrameRecord& r : out.frames) {
+        if (off + h.frame_size > end)
+            return fail("truncated frame record");
+        memset(&r.frame, 0, sizeof(r.frame));
+        memcpy(&r.frame, data + off, std::min<size_t>(h.frame_size, sizeof(WireFrame)));
+        off += h.frame_size;
+        if (off + (size_t) r.frame.detections * h.detection_size > end)
+            return fail("truncated detection records");
+        r.detections.resize(r.frame.detections);
+        for (WireDetection& d : r.detections) {
+            memset(&d, 0, sizeof(d));
+            memcpy(&d, data + off, std::min<size_t>(h.detection_size, sizeof(WireDetection)));
+            off += h.detection_size;
+        }
+    }
+    return true;
+}
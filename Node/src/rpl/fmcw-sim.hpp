@@ -0,0 +1,331 @@
+#pragma once
+// FMCW radar simulator: ADC cubes for point targets, in the DCA1000 layout the node ingests.
+//
+// Each chirp is the dechirped (beat) signal of every target plus static clutter and receiver
+// noise, sampled as complex int16. Sample order matches RangeDoppler::getIndices():
+//   [chirp loop][tx slot][fast time][I rx0..rxN, Q rx0..rxN]
+// Virtual channel tx*RX + rx sits at the element of steering_mat() it is matched against
+// (SIM_ARRAY below, half-wavelength grid), so angle processing sees the array it expects.
+//
+// A frame is a pure function of its index (targets move along straight lines, the noise is
+// seeded per frame and chirp), so frames can be generated in any order, on any number of
+// threads, and repeat exactly from run to run.
+#include <atomic>
+#include <cmath>
+#include <complex>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#define SIM_SPEED_OF_LIGHT 299792458.0
+#define SIM_REF_RANGE 10.0          // m, range at which SimConfig::amplitude is specified
+
+// (column, row) on the half-wavelength grid of steering_mat() for virtual channels 0-11
+static const int SIM_ARRAY[12][2] = {{0, 1}, {1, 1}, {2, 0}, {2, 1}, {3, 0}, {3, 1},
+                                     {4, 0}, {4, 1}, {5, 0}, {5, 1}, {6, 1}, {7, 1}};
+
+struct SimTarget
+{
+    double range;               // m at frame 0
+    double velocity;            // m/s radial, positive moving away
+    double azimuth;             // deg
+    double elevation;           // deg
+    double rcs;                 // m^2
+};
+
+struct SimConfig
+{
+    // Chirp profile (defaults: the AWR2243 profile of range_doppler_angle_processing.m)
+    double carrier_hz = 77e9;
+    double slope_hz_per_s = 83e12;
+    double sample_rate_hz = 10e6;
+    double chirp_period_s = 60e-6;      // start to start of consecutive TDM chirps
+
+    // Signal levels in ADC counts
+    double amplitude = 400;             // peak of a 1 m^2 target at SIM_REF_RANGE
+    double noise_std = 20;              // per I/Q component
+    double dc_offset = 0;               // added to every sample
+
+    std::vector<SimTarget> targets;
+    int clutter_points = 0;             // static scatterers at random range/azimuth
+    double clutter_rcs = 0.5;
+    uint32_t seed = 1;
+
+    double max_range() const { return sample_rate_hz * SIM_SPEED_OF_LIGHT / (2 * slope_hz_per_s); }
+};
+
+// Reads a scene file, one directive per line, '#' starts a comment:
+//   target <range m> <velocity m/s> <azimuth deg> <elevation deg> <rcs m^2>
+//   clutter <points> [rcs]
+//   noise <std counts>
+//   amplitude <counts>
+//   dc <counts>
+//   seed <n>
+//   profile <carrier Hz> <slope Hz/s> <sample rate Hz> <chirp period s>
+// Returns false (with a message on stderr) if the file cannot be read or a line is malformed.
+inline bool load_sim_scene(const std::string& filename, SimConfig& cfg)
+{
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        fprintf(stderr, "Error: Could not open scene %s\n", filename.c_str());
+        return false;
+    }
+    std::string line;
+    int line_no = 0;
+    while (std::getline(file, line)) {
+        line_no++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos)
+            line.erase(hash);
+        std::istringstream in(line);
+        std::string directive;
+        if (!(in >> directive))
+            continue;
+
+        bool ok = true;
+        if (directive == "target") {
+            SimTarget t;
+            ok = (bool) (in >> t.range >> t.velocity >> t.azimuth >> t.elevation >> t.rcs);
+            if (ok)
+                cfg.targets.push_back(t);
+        }
+        else if (directive == "clutter") {
+            ok = (bool) (in >> cfg.clutter_points);
+            in >> cfg.clutter_rcs;
+        }
+        else if (directive == "noise")
+            ok = (bool) (in >> cfg.noise_std);
+        else if (directive == "amplitude")
+            ok = (bool) (in >> cfg.amplitude);
+        else if (directive == "dc")
+            ok = (bool) (in >> cfg.dc_offset);
+        else if (directive == "seed")
+            ok = (bool) (in >> cfg.seed);
+        else if (directive == "profile")
+            ok = (bool) (in >> cfg.carrier_hz >> cfg.slope_hz_per_s >> cfg.sample_rate_hz >> cfg.chirp_period_s);
+        else {
+            fprintf(stderr, "Error: %s:%d: unknown directive '%s'\n", filename.c_str(), line_no, directive.c_str());
+            return false;
+        }
+        if (!ok) {
+            fprintf(stderr, "Error: %s:%d: bad '%s' line\n", filename.c_str(), line_no, directive.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+class FmcwSimulator
+{
+    // One scatterer as seen by the simulator, angles already turned into channel phases
+    struct Scatterer
+    {
+        double range, velocity, amplitude;
+        std::vector<double> channel_phase;     // per virtual channel
+    };
+
+    FrameGeometry geom;
+    SimConfig cfg;
+    std::vector<Scatterer> scatterers;          // targets first, then clutter
+    std::unique_ptr<WorkStealingExecutor> executor;
+    int parts;
+
+    static uint32_t hash(uint32_t x)
+    {
+        x ^= x >> 16; x *= 0x7feb352d;
+        x ^= x >> 15; x *= 0x846ca68b;
+        x ^= x >> 16;
+        return x;
+    }
+
+    Scatterer make_scatterer(double range, double velocity, double azimuth, double elevation, double rcs)
+    {
+        Scatterer s;
+        s.range = range;
+        s.velocity = velocity;
+        s.amplitude = cfg.amplitude * std::sqrt(rcs);
+        double az = azimuth * M_PI / 180, el = elevation * M_PI / 180;
+        for (int c = 0; c < geom.virt_ants(); c++) {
+            const int* pos = SIM_ARRAY[c % 12];
+            s.channel_phase.push_back(M_PI * (pos[0] * std::sin(az) * std::cos(el) + pos[1] * std::sin(el)));
+        }
+        return s;
+    }
+
+    public:
+        // threads > 1 splits every frame across a worker pool
+        FmcwSimulator(const FrameGeometry& g, const SimConfig& c, int threads = 1) : geom(g), cfg(c), parts(std::max(threads, 1))
+        {
+            // Frames carry the simulated profile, so Doppler bins convert to the simulated speeds
+            geom.chirp_period_us = cfg.chirp_period_s * 1e6;
+            geom.carrier_ghz = cfg.carrier_hz * 1e-9;
+            for (const SimTarget& t : cfg.targets)
+                scatterers.push_back(make_scatterer(t.range, t.velocity, t.azimuth, t.elevation, t.rcs));
+            uint32_t state = hash(cfg.seed ^ 0x5eed);
+            auto uniform = [&state] { state = hash(state + 0x9e3779b9); return state / 4294967296.0; };
+            for (int i = 0; i < cfg.clutter_points; i++) {
+                double range = 1 + uniform() * (0.9 * cfg.max_range() - 1);
+                double azimuth = -60 + 120 * uniform();
+                scatterers.push_back(make_scatterer(range, 0, azimuth, 0, cfg.clutter_rcs));
+            }
+            if (parts > 1)
+                executor.reset(new WorkStealingExecutor(parts - 1));    // the caller takes one part
+        }
+
+        const FrameGeometry& geometry() const { return geom; }
+        const SimConfig& config() const { return cfg; }
+
+        // Fills adc (geom.size_w_iq() samples) with frame `index`, taken at index * frame period
+        void generate(uint32_t index, uint16_t* adc)
+        {
+            TRACE_SCOPE("sim");
+            if (!executor) {
+                generate_loops(index, adc, 0, geom.slow_time);
+                return;
+            }
+            std::mutex m;
+            std::condition_variable cv;
+            int left = parts - 1;
+            for (int p = 1; p < parts; p++) {
+                int begin = geom.slow_time * p / parts, end = geom.slow_time * (p + 1) / parts;
+                executor->submit([&, begin, end] {
+                    generate_loops(index, adc, begin, end);
+                    std::lock_guard<std::mutex> lock(m);
+                    if (--left == 0)
+                        cv.notify_one();
+                });
+            }
+            generate_loops(index, adc, 0, geom.slow_time / parts);
+            std::unique_lock<std::mutex> lock(m);
+            cv.wait(lock, [&] { return left == 0; });
+        }
+
+    private:
+        // Chirp loops [begin, end) of one frame
+        void generate_loops(uint32_t index, uint16_t* adc, int begin, int end)
+        {
+            const int FAST = geom.fast_time, RXg = geom.rx;
+            const double lambda = SIM_SPEED_OF_LIGHT / cfg.carrier_hz;
+            const double t_frame = index * geom.frame_period_ms * 1e-3;
+            std::vector<std::complex<float>> row(FAST);
+
+            for (int loop = begin; loop < end; loop++) {
+                for (int tx = 0; tx < geom.tx; tx++) {
+                    const double t_chirp = t_frame + (loop * geom.tx + tx) * cfg.chirp_period_s;
+                    uint32_t state = hash(cfg.seed * 0x9e3779b9u ^ hash(index * 4099u + loop * geom.tx + tx)) | 1;
+                    for (int rx = 0; rx < RXg; rx++) {
+                        // Receiver noise, approximately Gaussian (sum of four uniforms)
+                        const double scale = cfg.noise_std * std::sqrt(3.0) / 4294967296.0;
+                        for (int s = 0; s < FAST; s++) {
+                            float v[2];
+                            for (int k = 0; k < 2; k++) {
+                                int64_t sum = 0;
+                                for (int u = 0; u < 4; u++) {
+                                    state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+                                    sum += state;
+                                }
+                                v[k] = (sum - 2 * 4294967295.0) * scale;
+                            }
+                            row[s] = std::complex<float>(v[0] + cfg.dc_offset, v[1] + cfg.dc_offset);
+                        }
+
+                        // Beat tone of every scatterer, rotated by a phasor step per sample
+                        const int channel = tx * RXg + rx;
+                        for (const Scatterer& sc : scatterers) {
+                            double r = sc.range + sc.velocity * t_chirp;
+                            if (r <= 0)
+                                continue;
+                            double amp = sc.amplitude * (SIM_REF_RANGE / std::max(r, 0.5)) * (SIM_REF_RANGE / std::max(r, 0.5));
+                            double f_beat = 2 * cfg.slope_hz_per_s * r / SIM_SPEED_OF_LIGHT + 2 * sc.velocity / lambda;
+                            double phase0 = 4 * M_PI * r / lambda + sc.channel_phase[channel];
+                            double step = 2 * M_PI * f_beat / cfg.sample_rate_hz;
+                            std::complex<float> z = std::polar((float) amp, (float) std::fmod(phase0, 2 * M_PI));
+                            std::complex<float> w = std::polar(1.0f, (float) std::fmod(step, 2 * M_PI));
+                            for (int s = 0; s < FAST; s++) {
+                                row[s] += z;
+                                z *= w;
+                            }
+                        }
+
+                        // Quantize into the interleaved int16 layout
+                        uint16_t* out = adc + (size_t) ((loop * geom.tx + tx) * FAST) * IQ * RXg;
+                        for (int s = 0; s < FAST; s++) {
+                            out[s * IQ * RXg + rx] = (uint16_t) quantize(row[s].real());
+                            out[s * IQ * RXg + RXg + rx] = (uint16_t) quantize(row[s].imag());
+                        }
+                    }
+                }
+            }
+        }
+
+        static int16_t quantize(float v)
+        {
+            return (int16_t) std::max(-32768.0f, std::min(32767.0f, std::nearbyint(v)));
+        }
+};
+
+// Source block that feeds simulated frames into the chain in place of DataAcquisition. With
+// realtime set, frames are released at the geometry's frame period, otherwise as fast as the
+// simulator and the downstream blocks allow.
+class SimulatedAcquisition : public RadarBlock
+{
+    FmcwSimulator sim;
+    FramePool pool;
+    FrameRef current;
+    bool realtime;
+    uint32_t next_frame_id;
+    int64_t t_start;
+
+    public:
+        SimulatedAcquisition(const FrameGeometry& g, const SimConfig& cfg, int threads = 1, bool rt = true, int pool_size = FRAME_POOL_SIZE)
+            : RadarBlock(g.size(), g.size()), sim(g, cfg, threads), pool(g, pool_size), realtime(rt), next_frame_id(1), t_start(0)
+        {
+        }
+
+        ~SimulatedAcquisition()
+        {
+            // Frames in flight point back into the pool, drop ours before it goes
+            publishFrame(FrameRef());
+            current.reset();
+        }
+
+        void prefault() override
+        {
+            pool.prefault();
+        }
+
+        void listen() override
+        {
+            // Downstream pacing only when connected the old way (setFramePointer)
+            if (frame == 0 || inputframeptr == NULL)
+                return;
+            wait_for_input();
+        }
+
+        void process() override
+        {
+            TRACE_SCOPE("daq");
+            current = pool.acquire();
+            current->geom = sim.geometry();
+            current->id = next_frame_id++;
+            trace_set_frame(current->id);
+            sim.generate(current->id - 1, current->adc);
+
+            if (realtime) {
+                if (t_start == 0)
+                    t_start = monotonic_ns();
+                int64_t due = t_start + (int64_t) ((current->id - 1) * sim.geometry().frame_period_ms * 1e6);
+                int64_t now = monotonic_ns();
+                if (due > now)
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+            }
+            current->t_acquired_ns = monotonic_ns();
+            current->t_wall_ns = wall_clock_ns();
+            publishFrame(std::move(current));
+        }
+};
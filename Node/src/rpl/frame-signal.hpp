@@ -0,0 +1,123 @@
+#pragma once
+// Frame handoff between RadarBlocks.
+//
+// A producer bumps an atomic frame sequence after each process(). A consumer waits for the
+// sequence to move: it spins for a short, adaptive budget (cheap when the next frame is
+// imminent), then sleeps on a futex so an idle block costs no CPU.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define DEFAULT_SPIN_BUDGET 4000    // Max busy-poll iterations before blocking (~tens of microseconds)
+
+inline int64_t monotonic_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+// Wake-up latency seen by one consumer: time from publish() to the waiter returning
+struct WakeStats
+{
+    uint64_t wakes = 0;         // waits that actually had to wait
+    uint64_t spin_wakes = 0;    // ... of which were satisfied while spinning
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+
+    void record(int64_t latency_ns, bool spun)
+    {
+        if (latency_ns < 0)
+            latency_ns = 0;
+        wakes++;
+        if (spun)
+            spin_wakes++;
+        total_ns += latency_ns;
+        if ((uint64_t) latency_ns > max_ns)
+            max_ns = latency_ns;
+    }
+
+    void print(const char* name) const
+    {
+        if (wakes == 0)
+            return;
+        printf("%s wake-up: avg %.1f us | max %.1f us | %llu wakes (%llu while spinning)\n", name,
+               total_ns / 1000.0 / wakes, max_ns / 1000.0,
+               (unsigned long long) wakes, (unsigned long long) spin_wakes);
+    }
+};
+
+class FrameSignal
+{
+    std::atomic<uint32_t> seq;
+    std::atomic<uint32_t> waiters;
+    std::atomic<int64_t> publish_ns;
+
+    long futex(int op, uint32_t val)
+    {
+        return syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq), op | FUTEX_PRIVATE_FLAG, val, NULL, NULL, 0);
+    }
+
+    public:
+        FrameSignal() : seq(0), waiters(0), publish_ns(0) {}
+
+        // Current frame sequence
+        uint32_t load() const
+        {
+            return seq.load(std::memory_order_acquire);
+        }
+
+        // Announces a new frame. Only enters the kernel if someone is blocked.
+        void publish()
+        {
+            publish_ns.store(monotonic_ns(), std::memory_order_relaxed);
+            seq.fetch_add(1, std::memory_order_seq_cst);
+            if (waiters.load(std::memory_order_seq_cst) > 0)
+                futex(FUTEX_WAKE, INT_MAX);
+        }
+
+        // Returns once the sequence differs from last. Spins for up to *spin_limit iterations,
+        // then blocks. The limit adapts: it doubles (up to spin_budget) when spinning paid off and
+        // halves when the wait ended up blocking anyway.
+        uint32_t wait(uint32_t last, int* spin_limit, int spin_budget, WakeStats* stats = NULL)
+        {
+            uint32_t cur = load();
+            if (cur != last)
+                return cur;
+
+            for (int i = 0; i < *spin_limit; i++) {
+                cpu_relax();
+                cur = load();
+                if (cur != last) {
+                    *spin_limit = std::min(spin_budget, std::max(16, *spin_limit * 2));
+                    if (stats)
+                        stats->record(monotonic_ns() - publish_ns.load(std::memory_order_relaxed), true);
+                    return cur;
+                }
+            }
+
+            waiters.fetch_add(1, std::memory_order_seq_cst);
+            while ((cur = seq.load(std::memory_order_seq_cst)) == last)
+                futex(FUTEX_WAIT, last);
+            waiters.fetch_sub(1, std::memory_order_relaxed);
+
+            *spin_limit = std::max(std::min(spin_budget, 16), *spin_limit / 2);
+            if (stats)
+                stats->record(monotonic_ns() - publish_ns.load(std::memory_order_relaxed), false);
+            return cur;
+        }
+};
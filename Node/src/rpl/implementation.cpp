@@ -12,142 +12,157 @@ using namespace rapidjson;
 
 # define n_pi           3.14159265358979323846 
 
-#define FAST_TIME 512 //Initializes the number of fast time samples | # of range samples
-#define SLOW_TIME 64 //Initializes the number of slow time samples | # of doppler samples
-#define RX 4        // # of Rx
-#define TX 3        // # of Tx
-#define IQ 2 //Types of IQ (I and Q) 
-#define SIZE_W_IQ TX*RX*FAST_TIME*SLOW_TIME*IQ  // Size of the total number of separate IQ sampels from ONE frame
-#define SIZE TX*RX*FAST_TIME*SLOW_TIME          // Size of the total number of COMPLEX samples from ONE frame
+// Frame geometry defaults (FAST_TIME, SLOW_TIME, RX, TX, IQ, ...) live in radar-config.hpp
 
 #define BUFFER_SIZE 2048 
 #define PORT        4098
 #define BYTES_IN_PACKET 1456 // Max packet size - sequence number and byte count = 1466-10 
 
-#define IQ_BYTES 2 
-
 #define IP				"169.231.216.203" // server IP
 #define SERVER_PORT		1210 
 #define MAXLINE 		1024
 
-// Class for multi-node server comms
+// Measurement variances sent with each binary detection: the quantisation of the bins the DSP
+// reports (uniform over one bin, step^2/12). Elevation is not estimated, uniform over +-45 deg.
+#define UPLINK_RANGE_STEP (9.0f / 256.0f)       // m per range bin, as in RangeDoppler::shape_angle_data
+#define UPLINK_AZIMUTH_STEP (180.0f / 64.0f)    // deg per angle bin
+
+inline WireDetection to_wire(const Detection& d)
+{
+    WireDetection w;
+    w.range_bin = d.range_bin;
+    w.doppler_bin = d.doppler_bin;
+    w.range = d.range;
+    w.doppler = d.doppler;
+    w.azimuth = d.azimuth;
+    w.elevation = d.elevation;
+    w.snr = d.snr;
+    w.var_range = UPLINK_RANGE_STEP * UPLINK_RANGE_STEP / 12;
+    w.var_doppler = 1.0f / 12;
+    w.var_azimuth = UPLINK_AZIMUTH_STEP * UPLINK_AZIMUTH_STEP / 12;
+    w.var_elevation = 90.0f * 90.0f / 12;
+    return w;
+}
+
+// Class for multi-node server comms. Every frame is one message: a 4-byte length (network byte
+// order) followed by the JSON object, serialised into a reused buffer. The socket belongs to an
+// AsyncUplink thread (async-uplink.hpp): sending only queues the message, connecting and
+// reconnecting happen in the background, so a bad link costs frames, never the node.
 class JSON_TCP {
     int frame = 1;
     const char *node = "Patrick";    // Patrick or Mike
-    int clientSd;
-    struct sockaddr_in servaddr;
-	socklen_t addr_size;
-    Value s;
-	FILE* fp;
-	FILE* fp_in;
 	string fname;
-	const char *path = "/home/fusionsense/repos/AVR/RadarPipeline/test/non_thread/frame_data";
+	string path = "/home/fusionsense/repos/AVR/RadarPipeline/test/non_thread/frame_data";
 	char buffer[MAXLINE];
-	int n;
 	const char *exit_msg = "Patrick Demo Complete";
+	StringBuffer json;
+	Writer<StringBuffer> writer;
+	std::vector<char> message;      // length prefix + payload, reused
+	AsyncUplink uplink;
+	AsyncFileWriter log_writer;     // optional per-frame JSON files, see setLogDir
+	bool log_frames = false;
     
 	public:
-		void write_json(string fname, float angle, float range, auto duration) {
-		    Document d; 
-		    d.SetObject();
-		    s.SetString(StringRef(node));
-
-		    // Add data to the JSON document
-		    d.AddMember("Node", s, d.GetAllocator());
-		    d.AddMember("Frame Number", frame, d.GetAllocator());
-		    d.AddMember("Elapsed Time (ms)", duration.count(), d.GetAllocator());
-		    d.AddMember("Angle", angle, d.GetAllocator());
-		    d.AddMember("Range", range, d.GetAllocator());
-
-		    // Open the output file
-		    fp = fopen(fname.c_str(), "w");
-
-		    // Write the JSON data to the file
-		    char writeBuffer[65536]; 
-		    FileWriteStream os(fp, writeBuffer, sizeof(writeBuffer)); 
-		    Writer<FileWriteStream> writer(os); 
-		    d.Accept(writer);
-
-		    fclose(fp);
+		JSON_TCP(int queue = UPLINK_QUEUE, UplinkPolicy policy = UPLINK_DROP_OLDEST, int batch = UPLINK_MAX_BATCH)
+			: writer(json), uplink(queue, policy, batch) {}
+
+		// Also keeps every frame's JSON as <dir>/<node>_Frame<n>.json, written on a background
+		// thread (a full queue drops files rather than stalling the frame). Off by default, an
+		// empty dir keeps the frame_data directory the files used to go to.
+		void setLogDir(const string& dir = "") {
+			if (!dir.empty())
+				path = dir;
+			log_frames = true;
+			log_writer.start();
 		}
 
-		void send_file_data(string fname, float angle, float range, auto duration) {
-			write_json(fname, angle, range, duration);    	// Write JSON file with angle data
-		    fp_in = fopen(fname.c_str(), "r");				// Read JSON file with angle data
+		// Frame data as JSON into the reused buffer
+		void write_json(float angle, float range, auto duration) {
+		    json.Clear();
+		    writer.Reset(json);
+		    writer.StartObject();
+		    writer.Key("Node");
+		    writer.String(node);
+		    writer.Key("Frame Number");
+		    writer.Int(frame);
+		    writer.Key("Elapsed Time (ms)");
+		    writer.Int64(duration.count());
+		    writer.Key("Angle");
+		    writer.Double(angle);
+		    writer.Key("Range");
+		    writer.Double(range);
+		    writer.EndObject();
+		}
 
-		    // Read the text file
-		    if (fp_in == NULL) {
-		        perror("[ERROR] reading the file\n");
-		        exit(EXIT_FAILURE);
-		    }
-		    
-		    // Send the data
-		    memset(&buffer, 0, sizeof(buffer));
-		    while (fgets(buffer, MAXLINE, fp_in) != NULL) {
-		        printf("\nSending: %s", buffer);
-
-		        n = sendto(clientSd, buffer, MAXLINE, 0, (struct sockaddr*)&servaddr, sizeof(servaddr));
-		        if (n == -1) {
-		            perror("[ERROR] sending data to the server.\n");
-		            exit(EXIT_FAILURE);
-		        }
-		        memset(&buffer, 0, sizeof(buffer));
-		    }
-
-		    // Send the 'END'
-		    strcpy(buffer, "END");
-		    sendto(clientSd, buffer, MAXLINE, 0, (struct sockaddr*)&servaddr, sizeof(servaddr));
-		    fclose(fp_in);
+		// One length-prefixed message, whole or not at all
+		bool send_message(const char* data, uint32_t len) {
+		    uint32_t prefix = htonl(len);
+		    message.resize(sizeof(prefix) + len);
+		    memcpy(message.data(), &prefix, sizeof(prefix));
+		    memcpy(message.data() + sizeof(prefix), data, len);
+		    return send_raw(message.data(), message.size());
+		}
+
+		// Bytes as they are, for messages that carry their own framing (detection-wire.hpp).
+		// Returns false if the queue policy dropped the message.
+		bool send_raw(const void* data, size_t len) {
+		    return uplink.send(data, len);
+		}
+
+		// Messages waiting for the link, 0 while it keeps up
+		int pending() {
+		    return uplink.pending();
+		}
+
+		// Queue depth, drops, reconnects and send latency of the uplink
+		UplinkStats stats() {
+		    return uplink.stats();
+		}
+
+		void send_data(float angle, float range, auto duration) {
+			write_json(angle, range, duration);
+			send_message(json.GetString(), json.GetSize());
+			if (log_frames)
+				log_writer.write(fname, json.GetString(), json.GetSize());
 		}
 		
-		int socket_setup() {
-			memset(&servaddr, 0, sizeof(servaddr));
-		    
-		    // Socket address properties
-		    servaddr.sin_family = AF_INET;
-			servaddr.sin_addr.s_addr = inet_addr(IP);
-		    servaddr.sin_port = htons(SERVER_PORT);
-		    
-		    // Create a TCP socket
-		    clientSd = socket(AF_INET, SOCK_STREAM, 0);
-		    if (clientSd < 0) {
-		        perror("[ERROR] socket error\n");
-		        exit(EXIT_FAILURE);
-		    }
+		// Starts the uplink thread, which connects (and reconnects) on its own. Always succeeds,
+		// frames sent before the connection is up wait in the queue.
+		int socket_setup(const string& server = IP, int port = SERVER_PORT) {
+		    uplink.start(server, port);
 		    printf("\nClient Setup Complete...\n");
-		    
-		    if (connect(clientSd, (sockaddr*) &servaddr, sizeof(servaddr)) < 0) {
-		    	printf("Error Connecting To Socket!\n");
-		    	exit(EXIT_FAILURE);
-		    }
-		    printf("Connected To Server!\n\n");
 		    return 1;
 		}
 
-		int get_frames() {
+		// Frame count the server sends once connected, 0 if none arrives in time
+		int get_frames(int timeout_ms = 30000) {
 			memset(&buffer, 0, sizeof(buffer));
-			addr_size = sizeof(servaddr);
-			n = recvfrom(clientSd, buffer, MAXLINE, 0, (struct sockaddr*)&servaddr, &addr_size);
+			ssize_t n = uplink.receive(buffer, MAXLINE - 1, timeout_ms);
+			if (n <= 0) {
+				fprintf(stderr, "Error: no frame count from the server\n");
+				return 0;
+			}
 			printf("Capturing %s Frames...\n\n", buffer);
-			return stoi(buffer);
+			return atoi(buffer);
 		}
 
 		void process(float angle, float range, auto start_time) {
 		    auto stop = chrono::high_resolution_clock::now();
 		    auto duration_udp_process = duration_cast<milliseconds>(stop - start_time);		    
 		    
-			fname = format("%s/%s_Frame%d.json", path, node, frame);
-		    send_file_data(fname, angle, range, duration_udp_process); // Send file to server
-		    printf("\nFrame Data Sent To Server\n\n");
+			if (log_frames)
+				fname = format("%s/%s_Frame%d.json", path.c_str(), node, frame);
+		    send_data(angle, range, duration_udp_process); // Send frame to server
 		    
 		    frame++;
 		}
 		
-		void end_stream() {
-			memset(&buffer, 0, sizeof(buffer));
-			strcpy(buffer, exit_msg);
-			n = sendto(clientSd, buffer, MAXLINE, 0, (struct sockaddr*)&servaddr, sizeof(servaddr));
-			close(clientSd);
+		// send_exit = false just closes, for binary streams
+		void end_stream(bool send_exit = true) {
+			if (send_exit)
+				send_message(exit_msg, strlen(exit_msg));
+			uplink.stop();          // sends what is queued, for up to UPLINK_DRAIN_MS
+			log_writer.stop();
 			printf("Demo Complete!\n");
 			printf("Connection Closed...\n\n");
 		}
@@ -158,20 +173,20 @@ class RadarBlock
 {
     int inputsize;
     int outputsize;
-    bool verbose;
 
     public:
         // Public variables
         uint frame = 0;
+        FrameSignal frame_signal;           // published after every process(), downstream blocks wait on it
 
-        uint* inputframeptr;
+        FrameSignal* inputframeptr;
         float* inputbufferptr;
 		float* inputangbufferptr;
 		float* inputrangebuffptr;
 		int* inputangindexptr;
 		float* inputangmapptr;
 
-        uint lastframe;
+        uint32_t lastframe;
 
         // Public functions
         // Class constructor
@@ -180,12 +195,16 @@ class RadarBlock
             inputsize = size_in;
             outputsize = size_out;
             verbose = v;
+            spin_budget = DEFAULT_SPIN_BUDGET;
+            spin_limit = spin_budget;
+            inputframeptr = NULL;
+            input_block = NULL;
 
             printf("New %s created.\n", typeid(*this).name());
         }
 
         // Class deconstructor
-        ~RadarBlock()
+        virtual ~RadarBlock()
         {
             delete[] outputbuffer; 
 
@@ -219,10 +238,49 @@ class RadarBlock
         }
 
         // Sets the input frame pointer
-        void setFramePointer(uint* ptr)
+        void setFramePointer(FrameSignal* ptr)
         {
             inputframeptr = ptr;
-            lastframe = *ptr;
+            lastframe = ptr->load();
+        }
+
+        // Takes frames (and the frame signal) from an upstream block. Replaces setFramePointer
+        // plus the per-buffer setters: everything the block needs travels in the RadarFrame.
+        void setInputBlock(RadarBlock* block)
+        {
+            input_block = block;
+            setFramePointer(block->getFramePointer());
+        }
+
+        // Latest frame published by this block, empty before the first one. The caller
+        // shares ownership, so the block can move on to the next frame without overwriting it.
+        FrameRef getOutputFrame()
+        {
+            std::lock_guard<std::mutex> lock(output_lock);
+            return output_frame;
+        }
+
+        // Core pinning and SCHED_FIFO priority applied by iteration() to the thread running it
+        void setRealtime(const RtThreadConfig& cfg)
+        {
+            rt = cfg;
+        }
+
+        // Touches every buffer the block will use so the first frames do not page fault
+        virtual void prefault()
+        {
+        }
+
+        // Max busy-poll iterations in listen() before the thread sleeps. 0 always blocks.
+        void setSpinBudget(int iterations)
+        {
+            spin_budget = iterations;
+            spin_limit = iterations;
+        }
+
+        const WakeStats& getWakeStats()
+        {
+            return wake_stats;
         }
 
         // Retrieve outputbuffer pointer
@@ -232,9 +290,9 @@ class RadarBlock
         }
 
         // Retrieve frame pointer
-        uint* getFramePointer()
+        FrameSignal* getFramePointer()
         {
-            return &frame;
+            return &frame_signal;
         }
 
         // Complete desired calculations / data manipulation
@@ -243,56 +301,97 @@ class RadarBlock
             printf("Process done!\n");
         }
 
+        // Runs process() on one frame handed over by a Pipeline stage instead of waiting in
+        // listen(). The frame is what getInputFrame() returns for the duration of the call.
+        void processFrame(FrameRef f)
+        {
+            if (f)
+                trace_set_frame(f->id);
+            pushed_input = std::move(f);
+            process();
+            pushed_input.reset();
+            increment_frame();
+        }
+
         // Iterates
         void iteration()
         {
+            if (rt.enabled())
+                apply_thread_rt(rt, typeid(*this).name());
             for(;;)
             {
                 listen();
 
-                // start timer
-                auto start = chrono::high_resolution_clock::now();
-
                 process();
 
-                // stop timer
-                auto stop = chrono::high_resolution_clock::now();
-
-                if(verbose)
+                // Stage timings are in the trace (trace.hpp), print them now and then
+                if(verbose && frame % 100 == 0)
                 {
-                    // calculate elapsed time in microseconds
-                    auto duration = chrono::duration_cast<chrono::microseconds>(stop - start);
-
-                    // print elapsed time
-                    cout << "Elapsed time: " << duration.count() << " microseconds" << endl;
+                    wake_stats.print(typeid(*this).name());
+                    Tracer::instance().print_summary();
                 }
 
                 increment_frame();
             }
         }
 
+        // Per-frame console output and the periodic timing summary, off by default
+        void setVerbose(bool v)
+        {
+            verbose = v;
+        }
+
+    protected:
+        RadarBlock* input_block;
+        bool verbose;
+
+        // Blocks until the upstream block publishes a new frame
+        void wait_for_input()
+        {
+            lastframe = inputframeptr->wait(lastframe, &spin_limit, spin_budget, &wake_stats);
+        }
+
+        // Frame pushed by processFrame(), otherwise the most recent frame of the upstream block
+        // (empty when not connected through setInputBlock)
+        FrameRef getInputFrame()
+        {
+            if (pushed_input)
+                return pushed_input;
+            return input_block ? input_block->getOutputFrame() : FrameRef();
+        }
+
+        // Makes f the block's output. The previously published frame is released outside the lock.
+        void publishFrame(FrameRef f)
+        {
+            {
+                std::lock_guard<std::mutex> lock(output_lock);
+                std::swap(output_frame, f);
+            }
+        }
+
     private:
         // Private variables
         float* outputbuffer;
+        FrameRef output_frame;
+        FrameRef pushed_input;
+        std::mutex output_lock;
+        int spin_budget;
+        int spin_limit;
+        WakeStats wake_stats;
+        RtThreadConfig rt;
 
         // Private functions
         // Listens for previous block (overwritten in some cases)
         virtual void listen()
         {
-            for(;;)
-            {
-                if(*inputframeptr != lastframe)
-                {
-                    lastframe = *inputframeptr;
-                    break;
-                }
-            }
+            wait_for_input();
         }
 
         // Increments frame count
         void increment_frame()
         {
             frame++;
+            frame_signal.publish();
         }
 };
 
@@ -323,17 +422,267 @@ class Visualizer : public RadarBlock
             image(px_height * height/2, px_width * width, CV_8UC1, Scalar(255))
         {
             frame = 1;
-            namedWindow("Image",WINDOW_NORMAL);
-            setWindowProperty("Image", WND_PROP_FULLSCREEN, WINDOW_NORMAL);
+            staticReady = false;
+            windowOpen = false;
+            headless = false;
+            view = VIEW_RDM;
+            wait_time = 1;
+            refresh_hz = 0;
+            posted = 0;
+            display_running = false;
+        }
 
+        ~Visualizer()
+        {
+            stopDisplay();
         }
 
-        // Visualizer's process
+        // Visualizer's process. Draws the frame, or with a refresh rate set only hands it to the
+        // display thread, so the caller never waits on imshow/waitKey.
         void process() override
         {
-            auto start = chrono::high_resolution_clock::now();
+            // Frame input when connected with setInputBlock, otherwise the raw pointers set
+            // through the buffer setters
+            FrameRef input = getInputFrame();
+            if (refresh_hz > 0) {
+                post(std::move(input));
+                return;
+            }
+            std::lock_guard<std::mutex> lock(render_lock);
+            render(std::move(input));
+        }
+
+        void setWaitTime(int num){
+            wait_time = num;
+        }
+
+        // Renders on a display thread at hz from the newest frame process() posted (frames in
+        // between are skipped). 0 draws inline in process(), the default.
+        void setRefreshRate(double hz){
+            stopDisplay();
+            refresh_hz = std::max(0.0, hz);
+            if (refresh_hz > 0) {
+                display_running = true;
+                display_thread = std::thread(&Visualizer::display_loop, this);
+            }
+        }
+
+        // What the left panel shows: the range-doppler map, or the angle spectrum of the frame
+        // (the 4 x 64 angle FFT at the detected range, elevation rows by azimuth columns)
+        enum View { VIEW_RDM, VIEW_ANGLE };
+
+        void setView(int v){
+            std::lock_guard<std::mutex> lock(render_lock);
+            view = v;
+            staticReady = false;
+        }
+
+        // Renders off-screen only, no window is ever opened (nodes without a display). Combine
+        // with streamTo/recordTo to see the canvas.
+        void setHeadless(bool h){
+            headless = h;
+        }
+
+        // Serves the canvas as MJPEG on addr:port, see vis-stream.hpp
+        bool streamTo(int port, const std::string& addr = "127.0.0.1"){
+            if (!stream.serve(port, addr))
+                return false;
+            stream.start();
+            return true;
+        }
+
+        // Records the canvas into a video file at a nominal fps
+        void recordTo(const std::string& path, double fps){
+            stream.record(path, fps);
+            stream.start();
+        }
+
+        // Rescales the RDM panel (320 x 256 px) to a new frame geometry. The canvas keeps its size.
+        void setGeometry(const FrameGeometry& g){
+            std::lock_guard<std::mutex> lock(render_lock);
+            width = g.slow_time;
+            height = g.fast_time;
+            px_width = 2*std::max(1, 320/width);
+            px_height = 2*std::max(1, 256/(height/2));
+            staticReady = false;
+        }
+        
+        // Waits for the upstream block when connected, otherwise draws continuously
+        void listen() override
+        {
+            if (inputframeptr)
+                wait_for_input();
+        }
+
+    private:
+        Mat image;
+        Mat borderedImage;          // static chrome, grey levels
+        Mat staticLayer;            // static chrome, colour mapped
+        Mat colorImage;             // canvas shown, staticLayer plus this frame's dynamic regions
+        cv::Rect rdmRect;
+        Vec3b lut[256];             // COLORMAP_JET, level -> BGR
+        std::vector<uint8_t> levels;
+        int view;
+        cv::Scalar axesColor;       // AXES_COLOR after the colour map
+        cv::Point textPosition_slow, textPosition_fast;
+        std::vector<cv::Rect> dirty;    // regions of colorImage drawn over since the last restore
+        bool staticReady;
+        bool windowOpen;
+        bool headless;
+        VisStream stream;           // MJPEG clients and recording, encoded on its own thread
+        int wait_time;
+
+        // Display thread and its keep-latest mailbox
+        double refresh_hz;
+        std::thread display_thread;
+        std::atomic<bool> display_running;
+        std::mutex mailbox_lock;
+        FrameRef mailbox;
+        uint64_t posted;            // process() calls so far, under mailbox_lock
+        std::mutex render_lock;     // canvas and geometry
+
+        void post(FrameRef f)
+        {
+            FrameRef replaced;      // released outside the lock
+            {
+                std::lock_guard<std::mutex> lock(mailbox_lock);
+                replaced = std::move(mailbox);
+                mailbox = std::move(f);
+                posted++;
+            }
+        }
+
+        void stopDisplay()
+        {
+            display_running = false;
+            if (display_thread.joinable())
+                display_thread.join();
+            std::lock_guard<std::mutex> lock(mailbox_lock);
+            mailbox.reset();
+        }
+
+        // Draws the newest posted frame every 1/refresh_hz s. A late refresh is dropped rather
+        // than caught up, and the GUI keeps handling events while no frame arrives.
+        void display_loop()
+        {
+            Tracer::instance().name_thread("vis display");
+            int64_t period = (int64_t) (1e9 / refresh_hz);
+            int64_t next = monotonic_ns();
+            uint64_t shown = 0;
+            while (display_running) {
+                FrameRef f;
+                uint64_t seq;
+                {
+                    std::lock_guard<std::mutex> lock(mailbox_lock);
+                    f = mailbox;
+                    seq = posted;
+                }
+                if (seq != shown) {
+                    std::lock_guard<std::mutex> lock(render_lock);
+                    render(std::move(f));
+                    shown = seq;
+                }
+                else if (windowOpen)
+                    waitKey(1);
+
+                next += period;
+                int64_t now = monotonic_ns();
+                if (next > now)
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(next - now));
+                else
+                    next = now;
+            }
+        }
+
+        // Draws one frame. The chrome (axes, ticks, captions) is drawn and colour mapped once into
+        // staticLayer; a frame only recolours the RDM panel and draws the detection overlays and
+        // readouts, after restoring the regions the previous frame drew over. The frame is
+        // released as soon as its data is on the canvas, before the (slow) display.
+        void render(FrameRef input)
+        {
+            TRACE_SCOPE("vis");
+            const float* rdm = input ? input->rdm : inputbufferptr;
+
+            if (!staticReady)
+                buildStaticLayer();
+            else
+                restoreDirty();
+
+	    float anglefloat = 0, rangefloat = 0;
+	    int cfar_slow = 0, cfar_fast = 0;
+	    if (input) {
+	        if (input->num_detections > 0) {
+	            const Detection& det = input->detections[0];
+	            anglefloat = det.azimuth;
+	            rangefloat = det.range;
+	            cfar_slow = det.doppler_bin;
+	            cfar_fast = det.range_bin;
+	        }
+	    }
+	    else {
+	        anglefloat = *inputangbufferptr;
+	        cfar_slow = *inputangindexptr/height;
+	        cfar_fast = *inputangindexptr%height;
+	        rangefloat = *inputrangebuffptr;
+	    }
+	    
+	    if (verbose)
+	        printf("Angle Norm size: %f\n", anglefloat);
+            
+            // Panel straight into the colour canvas, the frame is not needed after that
+            if (view == VIEW_ANGLE)
+                blitAngleMap(input ? input->angle_map : inputangmapptr);
+            else
+                blitRdm(rdm);
+            input.reset();
+
+            // Overlays are drawn straight onto the colour canvas in the colour AXES_COLOR maps to
+	    cv::Point detection1(borderLeft - 100 + cfar_slow*px_width/2 - px_width/2, 316 - (cfar_fast*px_height/2 - px_height/2) );
+	    cv::Point detection2(borderLeft - 100 + cfar_slow*px_width/2, 316 - cfar_fast*px_height/2);
+	    if (view == VIEW_RDM) {
+	        cv::rectangle(colorImage, detection1, detection2, axesColor, 3);
+	        markDirty(cv::Rect(detection1, detection2), 3);
+	    }
+	    
+	    float angrad = anglefloat * (M_PI / 180);
+	    int xcoord = 800 + rangefloat*sin(angrad)*32;
+	    int ycoord = 316 - rangefloat*cos(angrad)*28;
+	
+	    cv::Point xyPoint(xcoord, ycoord);
+
+	    cv::line(colorImage, xyPoint, xyPoint, axesColor, 9);	
+	    cv::line(colorImage, cv::Point(800,316), xyPoint, axesColor, 3);	
+	    markDirty(cv::Rect(cv::Point(800,316), xyPoint), 9);
+
+	    setprecision(1);
+	    std::string anglestr = to_string(anglefloat);
+	    std::string rangestr = to_string(rangefloat);
+	    drawReadout(anglestr, textPosition_slow);
+	    drawReadout(rangestr, textPosition_fast);
+
+            // Remote viewers and the recording get a copy, encoded on the stream's thread
+            if (stream.active())
+                stream.submit(colorImage);
+
+            // Display the color image. The window is created by the thread that draws into it.
+            if (!headless) {
+                if (!windowOpen) {
+                    namedWindow("Image",WINDOW_NORMAL);
+                    setWindowProperty("Image", WND_PROP_FULLSCREEN, WINDOW_NORMAL);
+                    windowOpen = true;
+                }
+                imshow("Image", colorImage);
+
+                // Waits 1ms (the display thread never blocks on a key)
+                waitKey(refresh_hz > 0 ? 1 : wait_time);
+            }
+            frame ++;
             
-            //if(frame <= 1){
+        }
+
+        // Draws the chrome and caches it colour mapped, sized for the current geometry
+        void buildStaticLayer()
+        {
                 cv::Scalar borderColor(0, 0, 0); 
 
                 // Add the padded border
@@ -366,8 +715,8 @@ class Visualizer : public RadarBlock
 
 		cv::rectangle(borderedImage, cv::Point(795,321), cv::Point(805,311), cv::Scalar(130, 34, 34), -1);
 
-                std::string label_x = "-     Velocity     +";
-                std::string label_RDM = "RDM";
+                std::string label_x = view == VIEW_ANGLE ? "-     Azimuth      +" : "-     Velocity     +";
+                std::string label_RDM = view == VIEW_ANGLE ? "Angle" : "RDM";
                 std::string label_XY = "XY Plot";
 		std::string label_xXY = "x position";
 
@@ -409,11 +758,12 @@ class Visualizer : public RadarBlock
                 cv::putText(borderedImage, label_XY, textPosition_XY, fontFace, fontScale, cv::Scalar(169, 169, 169), thickness);
                 cv::putText(borderedImage, label_xXY, textPosition_xXY, fontFace, fontScale, cv::Scalar(169, 169, 169), thickness);
 
-                cv::putText(borderedImage, "R", textPosition_r, fontFace, fontScale, cv::Scalar(169, 169, 169), thickness);
-                cv::putText(borderedImage, "a", textPosition_a, fontFace, fontScale, cv::Scalar(169, 169, 169), thickness);
-                cv::putText(borderedImage, "n", textPosition_n, fontFace, fontScale, cv::Scalar(169, 169, 169), thickness);
-                cv::putText(borderedImage, "g", textPosition_g, fontFace, fontScale, cv::Scalar(169, 169, 169), thickness);
-                cv::putText(borderedImage, "e", textPosition_e, fontFace, fontScale, cv::Scalar(169, 169, 169), thickness);
+                const char* caption_y = view == VIEW_ANGLE ? "Elev." : "Range";
+                cv::putText(borderedImage, std::string(1, caption_y[0]), textPosition_r, fontFace, fontScale, cv::Scalar(169, 169, 169), thickness);
+                cv::putText(borderedImage, std::string(1, caption_y[1]), textPosition_a, fontFace, fontScale, cv::Scalar(169, 169, 169), thickness);
+                cv::putText(borderedImage, std::string(1, caption_y[2]), textPosition_n, fontFace, fontScale, cv::Scalar(169, 169, 169), thickness);
+                cv::putText(borderedImage, std::string(1, caption_y[3]), textPosition_g, fontFace, fontScale, cv::Scalar(169, 169, 169), thickness);
+                cv::putText(borderedImage, std::string(1, caption_y[4]), textPosition_e, fontFace, fontScale, cv::Scalar(169, 169, 169), thickness);
 
                 cv::putText(borderedImage, "y", textPosition_y, fontFace, fontScale, cv::Scalar(169, 169, 169), thickness);
                 cv::putText(borderedImage, "p", textPosition_p, fontFace, fontScale, cv::Scalar(169, 169, 169), thickness);
@@ -438,9 +788,11 @@ class Visualizer : public RadarBlock
                     std::ostringstream stream;
                     stream << std::fixed << std::setprecision(0) << i;
                     cv::Point pt(i*32 + 160+220-100, 316);
-                    cv::line(borderedImage, pt, pt - cv::Point(0, -5), cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), 2);
-                    cv::putText(borderedImage, stream.str(), pt + cv::Point(-10, 20),
-                                cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), 2);
+                    if (view == VIEW_RDM) {     // velocity and range scales, the angle view has none
+                        cv::line(borderedImage, pt, pt - cv::Point(0, -5), cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), 2);
+                        cv::putText(borderedImage, stream.str(), pt + cv::Point(-10, 20),
+                                    cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), 2);
+                    }
 
                     cv::line(borderedImage, pt + cv::Point(520,0), pt - cv::Point(0, -5) + cv::Point(520,0), cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), 2);
                     cv::putText(borderedImage, stream.str(), pt + cv::Point(-10, 20) + cv::Point(520,0),
@@ -450,183 +802,218 @@ class Visualizer : public RadarBlock
                     std::ostringstream stream;
                     stream << std::fixed << std::setprecision(0) << 9-i;
                     cv::Point pt(220-100, i*28 + 60);
-                    cv::line(borderedImage, pt, pt + cv::Point(-5, 0), cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), 2);
-                    cv::putText(borderedImage, stream.str(), pt + cv::Point(-30, 10),
-                                cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), 2);
+                    if (view == VIEW_RDM) {
+                        cv::line(borderedImage, pt, pt + cv::Point(-5, 0), cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), 2);
+                        cv::putText(borderedImage, stream.str(), pt + cv::Point(-30, 10),
+                                    cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), 2);
+                    }
 
                     cv::line(borderedImage, pt + cv::Point(520,0), pt + cv::Point(-5, 0) + cv::Point(520,0), cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), 2);
                     cv::putText(borderedImage, stream.str(), pt + cv::Point(-30, 10) + cv::Point(520,0),
                                 cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), 2);
                 }
 
-		  /* Range Angle Map Debug      
-		        for (int i = -90; i <= 90; i += 45) {
-                    std::ostringstream stream;
-                    stream << std::fixed << std::setprecision(0) << i;
-                    cv::Point pt1(400-100, 500 - i);
-                    cv::line(borderedImage, pt1, pt1 + cv::Point(-5, 0), cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), 2);
-                    cv::putText(borderedImage, stream.str(), pt1 + cv::Point(-45, 5),
-                                cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), 2);
-                                
-                }
-                cv::line(borderedImage, cv::Point(300,590), cv::Point(300, 410), cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), 2);
-                
-                
-				for (int i = -90; i <= 90; i += 30) {
-                    std::ostringstream stream;
-                    stream << std::fixed << std::setprecision(0) << i;
-                    cv::Point pt2((i+90)*3.2 + 400-100, 595);
-                    cv::line(borderedImage, pt2, pt2 + cv::Point(0, -5), cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), 2);
-                    cv::putText(borderedImage, stream.str(), pt2 + cv::Point(-10, 20),
-                                cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), 2);
-
-                }
-                cv::line(borderedImage, cv::Point(300,590), cv::Point(876, 590), cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), 2);
-		
-		
-			for (int i = 0; i < 64; i++) {
-                for (int j = 0; j < 4; j++) {
-                    for(int x = 0; x < 9; x++) {
-                        for(int y = 0; y < 45; y++) {
-                            borderedImage.at<uint8_t>(45 * (j) + y + 410, 9 * i + x + 300) = static_cast<uint8_t>(inputangmapptr[64*(4) - ((64-1)*4 - 4 * i + j)]);
-                        }
-                    }
-                }
-            }
-		*/
-
 
-            //}
-		//cv::Point originXY(640,316);
-		//cv::Point cornerXY(960, 60);
-		//cv::rectangle(borderedImage, originXY, cornerXY, cv::Scalar(0,0,0), -1);
 
 
-            int half_offset = 0;
-            if(true)
-                half_offset = height/2;
 
 	    cv::Size textSize1 = cv::getTextSize("-           Velocity           +", cv::FONT_HERSHEY_SIMPLEX, 1.0, 4, 0); 
 	    
-	    /*cv::Point textPosition_ang(borderLeft + 650, (borderedImage.rows-60+4*(textSize.height+24))/2); // OLD ANGLE VISUALIZER
-	    cv::line(borderedImage, textPosition_ang, textPosition_ang + cv::Point(150, 0), cv::Scalar(0, 0, 0), 70);
-	    float anglefloat = *inputangbufferptr; 
-	    setprecision(1);
-	    std::string anglestr = to_string(anglefloat);
-	    cv::putText(borderedImage, anglestr, textPosition_ang, cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(169, 169, 169), 2); */
-	    
- 	    cv::Point textPosition_slow(borderLeft + 475, 100+(borderedImage.rows-60+6*(textSize1.height+24))/2); // for debug its borderleft -200
-	    cv::Point textPosition_fast(borderLeft - 25, 100+(borderedImage.rows-60+6*(textSize1.height+24))/2);
-	    //cv::line(borderedImage, textPosition_slow - cv::Point(150, 0), textPosition_slow + cv::Point(150, 0), cv::Scalar(0, 0, 0), 100);
+ 	    textPosition_slow = cv::Point(borderLeft + 475, 100+(borderedImage.rows-60+6*(textSize1.height+24))/2); // for debug its borderleft -200
+	    textPosition_fast = cv::Point(borderLeft - 25, 100+(borderedImage.rows-60+6*(textSize1.height+24))/2);
 	    cv::Point textPosition_angle(borderLeft + 475, 100+(borderedImage.rows-60+4*(textSize1.height+24))/2); // for debug its borderleft -200
 	    cv::Point textPosition_range(borderLeft - 25, 100+(borderedImage.rows-60+4*(textSize1.height+24))/2);
 	    cv::putText(borderedImage, "Range:", textPosition_range, cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(169, 169, 169), 2);
 	    cv::putText(borderedImage, "Angle:", textPosition_angle, cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(169, 169, 169), 2);
-	    
-	    
-	    float anglefloat = *inputangbufferptr;
-	    
-	    cout << "Angle Norm size: " << anglefloat << endl;
-	    int cfar_slow = *inputangindexptr/FAST_TIME;
-	    int cfar_fast = *inputangindexptr%FAST_TIME;
-	    float rangefloat = *inputrangebuffptr;
-	    setprecision(1);
-	    std::string anglestr = to_string(anglefloat);
-	    std::string slow_str = to_string(cfar_slow);
-	    std::string fast_str = to_string(cfar_fast);
-	    std::string rangestr = to_string(rangefloat);
-	    //std::string fast_str = to_string(*inputangindexptr);  // Testing out the MVDR Angle Estimation
-	    cv::putText(borderedImage, anglestr, textPosition_slow, cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(169, 169, 169), 2);
-	    //cv::putText(borderedImage, slow_str, textPosition_slow, cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(169, 169, 169), 2);
-	    //cv::putText(borderedImage, fast_str, textPosition_fast, cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(169, 169, 169), 2);
-	    cv::putText(borderedImage, rangestr, textPosition_fast, cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(169, 169, 169), 2);
-	    
 
+            // The colour map runs once here, frames look the panel levels up in lut
+            applyColorMap(borderedImage, staticLayer, COLORMAP_JET);
+            staticLayer.copyTo(colorImage);
+            Mat ramp(1, 256, CV_8UC1), rampMapped;
+            for (int i = 0; i < 256; i++)
+                ramp.at<uint8_t>(0, i) = i;
+            applyColorMap(ramp, rampMapped, COLORMAP_JET);
+            for (int i = 0; i < 256; i++)
+                lut[i] = rampMapped.at<Vec3b>(0, i);
+            axesColor = cv::Scalar(lut[AXES_COLOR][0], lut[AXES_COLOR][1], lut[AXES_COLOR][2]);
+
+            if (view == VIEW_ANGLE)
+                rdmRect = cv::Rect(borderLeft-100, borderSize, 320/64 * 64, 256/4 * 4);
+            else
+                rdmRect = cv::Rect(borderLeft-100, borderSize, px_width/2 * width, px_height/2 * (height/2));
+            rdmRect &= cv::Rect(0, 0, colorImage.cols, colorImage.rows);
+            levels.resize(std::max(width * (height/2), ANGLE_BINS));
+            dirty.clear();
+            staticReady = true;
+        }
 
-            
-            //took j to height/2 to height in order to cut Range on RDM in half
+        // Marks a region drawn over the static layer, restored before the next frame
+        void markDirty(cv::Rect r, int pad)
+        {
+            r = cv::Rect(r.x - pad, r.y - pad, r.width + 2*pad + 1, r.height + 2*pad + 1) & cv::Rect(0, 0, colorImage.cols, colorImage.rows);
+            if (r.area() > 0)
+                dirty.push_back(r);
+        }
+
+        void restoreDirty()
+        {
+            for (const cv::Rect& r : dirty)
+                staticLayer(r).copyTo(colorImage(r));
+            dirty.clear();
+        }
+
+        // The far half of the range bins (as before), in levels column by column so both the reads
+        // and the writes are sequential and the clamp-and-convert loop vectorises
+        void blitRdm(const float* rdm)
+        {
+            int rows = height/2;
             for (int i = 0; i < width; i++) {
-                for (int j = half_offset; j < height; j++) {
-                    for(int x = 0; x < px_width/2; x++) {
-                        for(int y = 0; y < px_height/2; y++) {
-                            borderedImage.at<uint8_t>(px_height/2 * (j-height/2) + y + borderSize, px_width/2 * i + x + borderLeft-100) = static_cast<uint8_t>(inputbufferptr[width*(height) - ((width-1)*height - height * i + j)]);
-                        }
-                    }
-                }
+                const float* src = rdm + height * i + 1;    // range bins 1 .. height/2, far range on top
+                uint8_t* dst = levels.data() + i * rows + rows - 1;
+                for (int k = 0; k < rows; k++)
+                    dst[-k] = (uint8_t) std::min(std::max(src[k], 0.0f), 255.0f);
             }
-            
-            
-            
-	    cv::Point detection1(borderLeft - 100 + cfar_slow*px_width/2 - px_width/2, 316 - (cfar_fast*px_height/2 - px_height/2) );
-	    cv::Point detection2(borderLeft - 100 + cfar_slow*px_width/2, 316 - cfar_fast*px_height/2);
-	    cv::rectangle(borderedImage, detection1, detection2, Scalar(169,169,169), 3);
-	    
-	    float angrad = anglefloat * (M_PI / 180);
-	    int xcoord = 800 + rangefloat*sin(angrad)*32;
-	    int ycoord = 316 - rangefloat*cos(angrad)*28;
-	
-	    cv::Point xyPoint(xcoord, ycoord);
-
-	    cv::line(borderedImage, xyPoint, xyPoint, cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), 9);	
-	    cv::line(borderedImage, cv::Point(800,316), xyPoint, cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), 3);	
-
-	    //cv::rectangle(borderedImage, xyPoint, xyPoint + cv::Point(2,2), cv::Scalar(AXES_COLOR, AXES_COLOR, AXES_COLOR), -1);
-	    //cv::line(borderedImage, xyPoint, xyPoint, cv::Scalar(0, 0, 0), 9);	
-
-       
-            // cv::Rect roi(borderLeft, borderedImage.row - borderSize, px_width*width, px_height*height);
-            // cv::Mat roiImage = borderedImage(roi);
-            // Convert the matrix to a color image for visualization
-            applyColorMap(borderedImage, colorImage, COLORMAP_JET);
-            // Display the color image
-            imshow("Image", colorImage);
-
-            // Waits 1ms
-            waitKey(wait_time);
-            auto stop = chrono::high_resolution_clock::now();
-            auto duration_vis_process = duration_cast<microseconds>(stop - start);
-            std::cout << "VIS Process Time " << duration_vis_process.count() << " microseconds" << std::endl;
-            frame ++;
-            
+            blitLevels(levels.data(), rows, width, 1, rows, px_width/2, px_height/2);
         }
 
-        void setWaitTime(int num){
-            wait_time = num;
+        // 4 elevation rows x 64 azimuth bins of log magnitude, scaled to 0-255 per frame
+        void blitAngleMap(const float* map)
+        {
+            float lo = map[0], hi = map[0];
+            for (int i = 1; i < ANGLE_BINS; i++) {
+                lo = std::min(lo, map[i]);
+                hi = std::max(hi, map[i]);
+            }
+            float scale = hi > lo ? 255.0f / (hi - lo) : 0.0f;
+            for (int i = 0; i < ANGLE_BINS; i++)
+                levels[i] = (uint8_t) ((map[i] - lo) * scale);
+            blitLevels(levels.data(), 4, 64, 64, 1, rdmRect.width / 64, rdmRect.height / 4);
         }
-        
-        void listen() override
+
+        // Nearest-neighbour upscale of a rows x cols level map into the panel through the LUT:
+        // every cell becomes pw x ph pixels, the first pixel row of a cell is built and the
+        // others are copies of it. Cell (r, c) is levels[r * r_stride + c * c_stride].
+        void blitLevels(const uint8_t* src, int rows, int cols, int r_stride, int c_stride, int pw, int ph)
         {
-            return;
+            Mat panel = colorImage(rdmRect);
+            rows = std::min(rows, panel.rows / ph);
+            cols = std::min(cols, panel.cols / pw);
+            for (int r = 0; r < rows; r++) {
+                Vec3b* out = panel.ptr<Vec3b>(r * ph);
+                const uint8_t* cell = src + r * r_stride;
+                for (int c = 0; c < cols; c++) {
+                    Vec3b color = lut[cell[c * c_stride]];
+                    for (int x = 0; x < pw; x++)
+                        *out++ = color;
+                }
+                for (int y = 1; y < ph; y++)
+                    memcpy(panel.ptr(r * ph + y), panel.ptr(r * ph), cols * pw * sizeof(Vec3b));
+            }
         }
 
-    private:
-        Mat image;
-        Mat borderedImage;
-        Mat colorImage;
-        int wait_time;
+        void drawReadout(const std::string& text, cv::Point pos)
+        {
+            int baseline = 0;
+            cv::Size size = cv::getTextSize(text, cv::FONT_HERSHEY_SIMPLEX, 1.0, 2, &baseline);
+            cv::putText(colorImage, text, pos, cv::FONT_HERSHEY_SIMPLEX, 1.0, axesColor, 2);
+            markDirty(cv::Rect(pos.x, pos.y - size.height, size.width, size.height + baseline), 2);
+        }
         
 };
 
 
+// Buffers and FFT plans for one frame geometry. RangeDoppler keeps one of these per
+// geometry it has seen so a profile switch only rebinds pointers instead of replanning.
+struct RangeDopplerWorkspace
+{
+    FrameGeometry geom;
+    float *adc_data_flat, *adc_data_reshaped, *rdm_norm, *rdm_avg, *prev_rdm_avg, *zero_rdm_avg, *cfar_cube, *window, *fftshifted;
+    std::complex<float> *adc_data, *rdm_data, *onlyRD_data, *preholding_data, *postholding_data;
+    fftwf_plan plan, plan3;
+
+    RangeDopplerWorkspace(const FrameGeometry& g, const char* win) : geom(g)
+    {
+        const int size = g.size();
+        const int rd_bins = g.rd_bins();
+        adc_data_flat = reinterpret_cast<float*>(malloc(g.size_w_iq()*sizeof(float)));                      // allocate mem for Separate IQ adc data from Data aquisition
+        adc_data=reinterpret_cast<std::complex<float>*>(adc_data_flat);                                     // allocate mem for COMPLEX adc data from Data aquisition 
+        adc_data_reshaped = reinterpret_cast<float*>(malloc(g.size_w_iq()*sizeof(float)));                  // allocate mem for reorganized/reshaped adc data
+        rdm_data = reinterpret_cast<std::complex<float>*>(malloc(size * sizeof(std::complex<float>)));      // allocate mem for processed complex adc data
+        rdm_norm = reinterpret_cast<float*>(malloc(size * sizeof(float)));                                  // allocate mem for processed magnitude adc data
+        rdm_avg = reinterpret_cast<float*>(calloc(rd_bins, sizeof(float)));                                 // allocate mem for averaged adc data across all virtual antennas
+        prev_rdm_avg = reinterpret_cast<float*>(calloc(rd_bins, sizeof(float)));                            // Previous frame allocation
+        zero_rdm_avg = reinterpret_cast<float*>(calloc(rd_bins, sizeof(float)));                            // rdm avg but with 0 doppler removed
+        cfar_cube = reinterpret_cast<float*>(calloc(rd_bins, sizeof(float)));
+        fftshifted = reinterpret_cast<float*>(malloc(rd_bins * sizeof(float)));                             // scratch for fftshift_rdm
+        onlyRD_data = reinterpret_cast<std::complex<float>*>(malloc(size * sizeof(std::complex<float>)));
+        preholding_data = reinterpret_cast<std::complex<float>*>(malloc(g.fast_time * sizeof(std::complex<float>)));
+        postholding_data = reinterpret_cast<std::complex<float>*>(malloc(g.fast_time * sizeof(std::complex<float>)));
+
+        // Window only depends on the geometry, so it is computed once here instead of every frame
+        window = reinterpret_cast<float*>(malloc(g.fast_time * sizeof(float)));
+        for(int i = 0; i<g.fast_time; i++){
+            if(strcmp(win,"blackman") == 0)
+                window[i] = 0.42 - 0.5*cos(2*M_PI*i/(g.fast_time-1))+0.08*cos(4*M_PI*i/(g.fast_time-1));
+            else if(strcmp(win,"hann") == 0)
+                window[i] = 0.5 * (1 - cos((2 * M_PI * i) / (g.fast_time - 1)));
+            else
+                window[i] = 1;
+        }
+
+        // FFT SETUP PARAMETERS
+        const int rank = 2;     // Determines the # of dimensions for FFT
+        const int n[] = {g.slow_time, g.fast_time};
+        const int howmany = g.virt_ants();
+        const int idist = rd_bins;
+        const int odist = rd_bins;
+        const int istride = 1;
+        const int ostride = 1;
+        plan = fftwf_plan_many_dft(rank, n, howmany,
+                            reinterpret_cast<fftwf_complex*>(adc_data), n, istride, idist,
+                            reinterpret_cast<fftwf_complex*>(rdm_data), n, ostride, odist,
+                            FFTW_FORWARD, FFTW_ESTIMATE);      // create the FFT plan
+
+        // Range-only FFT used for angle estimation, planned once instead of on every frame
+        plan3 = fftwf_plan_dft_1d(g.fast_time, reinterpret_cast<fftwf_complex*>(preholding_data), reinterpret_cast<fftwf_complex*>(postholding_data), FFTW_FORWARD, FFTW_ESTIMATE);
+    }
+
+    void prefault()
+    {
+        const size_t size = geom.size(), rd_bins = geom.rd_bins();
+        prefault_pages(adc_data_flat, geom.size_w_iq()*sizeof(float));
+        prefault_pages(adc_data_reshaped, geom.size_w_iq()*sizeof(float));
+        prefault_pages(rdm_data, size*sizeof(std::complex<float>));
+        prefault_pages(rdm_norm, size*sizeof(float));
+        prefault_pages(onlyRD_data, size*sizeof(std::complex<float>));
+        float* maps[] = {rdm_avg, prev_rdm_avg, zero_rdm_avg, cfar_cube, fftshifted};
+        for (float* m : maps)
+            prefault_pages(m, rd_bins*sizeof(float));
+    }
+
+    ~RangeDopplerWorkspace()
+    {
+        fftwf_destroy_plan(plan);
+        fftwf_destroy_plan(plan3);
+        free(adc_data_flat); free(adc_data_reshaped); free(rdm_data); free(rdm_norm); free(rdm_avg);
+        free(prev_rdm_avg); free(zero_rdm_avg); free(cfar_cube); free(fftshifted); free(onlyRD_data);
+        free(preholding_data); free(postholding_data); free(window);
+    }
+};
+
 // Processes IQ data to make Range-Doppler map
 class RangeDoppler : public RadarBlock
 {
     public:
-        RangeDoppler(const char* win = "blackman") : RadarBlock(SIZE,SIZE)
+        RangeDoppler(const char* win = "blackman", const FrameGeometry& g = FrameGeometry()) : RadarBlock(g.size(),g.size())
         {
             // RANGE DOPPLER PARAMETER INITIALIZATION
             WINDOW_TYPE = win;          //Determines what type of windowing will be done
             SET_SNR = false;
-            adc_data_flat = reinterpret_cast<float*>(malloc(SIZE_W_IQ*sizeof(float)));                          // allocate mem for Separate IQ adc data from Data aquisition
-            adc_data=reinterpret_cast<std::complex<float>*>(adc_data_flat);                                     // allocate mem for COMPLEX adc data from Data aquisition 
-            adc_data_reshaped = reinterpret_cast<float*>(malloc(SIZE_W_IQ*sizeof(float)));                      // allocate mem for reorganized/reshaped adc data
-            rdm_data = reinterpret_cast<std::complex<float>*>(malloc(SIZE * sizeof(std::complex<float>)));      // allocate mem for processed complex adc data
-            rdm_norm = reinterpret_cast<float*>(malloc(SIZE * sizeof(float)));                                  // allocate mem for processed magnitude adc data
-            rdm_avg = reinterpret_cast<float*>(calloc(SLOW_TIME*FAST_TIME, sizeof(float)));                     // allocate mem for averaged adc data across all virtual antennas
-			prev_rdm_avg = reinterpret_cast<float*>(calloc(SLOW_TIME*FAST_TIME, sizeof(float))); // Previous frame allocation
-			zero_rdm_avg = reinterpret_cast<float*>(calloc(SLOW_TIME*FAST_TIME, sizeof(float))); // rdm avg but with 0 doppler removed
-
-			cfar_cube = reinterpret_cast<float*>(calloc(SLOW_TIME*FAST_TIME, sizeof(float)));
+            ws = NULL;
+            input = NULL;
+            shm_slot = NULL;
+
+            // Angle buffers follow the 3TX x 4RX virtual array, not the chirp geometry
 			angle_data = reinterpret_cast<std::complex<float>*>(calloc(256, sizeof(std::complex<float>)));
 			angfft_data = reinterpret_cast<std::complex<float>*>(calloc(256, sizeof(std::complex<float>)));
 			angle_norm = reinterpret_cast<float*>(malloc(256 * sizeof(float)));
@@ -636,26 +1023,6 @@ class RangeDoppler : public RadarBlock
 			//Rmatrix = reinterpret_cast<complex<float>*>(malloc(64 * sizeof(complex<float>)));
 			Rmatrix = reinterpret_cast<complex<float>*>(malloc(144 * sizeof(complex<float>)));
 
-            onlyRD_data = reinterpret_cast<std::complex<float>*>(malloc(SIZE * sizeof(std::complex<float>)));
-            //preholding_data = reinterpret_cast<std::complex<float>*>(malloc(SLOW_TIME*FAST_TIME * sizeof(std::complex<float>)));
-            //postholding_data = reinterpret_cast<std::complex<float>*>(malloc(SLOW_TIME*FAST_TIME * sizeof(std::complex<float>)));
-            preholding_data = reinterpret_cast<std::complex<float>*>(malloc(FAST_TIME * sizeof(std::complex<float>)));
-            postholding_data = reinterpret_cast<std::complex<float>*>(malloc(FAST_TIME * sizeof(std::complex<float>)));
-            
-            
-            // FFT SETUP PARAMETERS
-            const int rank = 2;     // Determines the # of dimensions for FFT
-            const int n[] = {SLOW_TIME, FAST_TIME};
-            const int howmany = TX*RX;
-            const int idist = SLOW_TIME*FAST_TIME;
-            const int odist = SLOW_TIME*FAST_TIME;
-            const int istride = 1;
-            const int ostride = 1;
-            plan = fftwf_plan_many_dft(rank, n, howmany,
-                                reinterpret_cast<fftwf_complex*>(adc_data), n, istride, idist,
-                                reinterpret_cast<fftwf_complex*>(rdm_data), n, ostride, odist,
-                                FFTW_FORWARD, FFTW_ESTIMATE);      // create the FFT plan
-			
 			const int rank2 = 2;     // Determines the # of dimensions for FFT
 			const int n2[] = {4, 64};
 			const int howmany2 = 1;
@@ -667,24 +1034,74 @@ class RangeDoppler : public RadarBlock
 				            reinterpret_cast<fftwf_complex*>(angle_data), n2, istride2, idist2,
 				            reinterpret_cast<fftwf_complex*>(angfft_data), n2, ostride2, odist2,
 				            FFTW_FORWARD, FFTW_ESTIMATE);      // create the FFT plan
-				            
-			/*	            
-			const int rank3 = 1;     // Determines the # of dimensions for FFT
-            const int n3[] = {SLOW_TIME};
-            const int howmany3 = FAST_TIME;
-            const int idist3 = 1;
-            const int odist3 = 1;
-            const int istride3 = FAST_TIME;
-            const int ostride3 = FAST_TIME;
-            plan3 = fftwf_plan_many_dft(rank3, n3, howmany3,
-                                reinterpret_cast<fftwf_complex*>(preholding_data), n3, istride3, idist3,
-                                reinterpret_cast<fftwf_complex*>(postholding_data), n3, ostride3, odist3,
-                                FFTW_FORWARD, FFTW_ESTIMATE);      // create the FFT plan
-			*/
-
-
-			int frame = 1;
-			int maxidx = 0;
+
+            setGeometry(g);
+        }
+
+        ~RangeDoppler()
+        {
+            for (auto& entry : workspaces)
+                delete entry.second;
+            fftwf_destroy_plan(plan2);
+        }
+
+        // Builds (or reuses) the buffers and FFT plans for a geometry without making it active.
+        // Call at startup for every profile the node may switch to so the switch itself is free.
+        void preloadGeometry(const FrameGeometry& g)
+        {
+            // The FFTW planner is not thread safe, frame-parallel instances may plan at the same time
+            static std::mutex planner_lock;
+            std::lock_guard<std::mutex> lock(planner_lock);
+            if (workspaces.find(g) == workspaces.end())
+                workspaces[g] = new RangeDopplerWorkspace(g, WINDOW_TYPE);
+        }
+
+        // Switches the processing chain to a new frame geometry. Consumers holding
+        // getBufferPointer() must fetch it again since the RDM buffer belongs to the geometry.
+        void setGeometry(const FrameGeometry& g)
+        {
+            preloadGeometry(g);
+            ws = workspaces[g];
+            geom = g;
+
+            adc_data_flat = ws->adc_data_flat;
+            adc_data = ws->adc_data;
+            adc_data_reshaped = ws->adc_data_reshaped;
+            rdm_data = ws->rdm_data;
+            rdm_norm = ws->rdm_norm;
+            rdm_avg = ws->rdm_avg;
+            prev_rdm_avg = ws->prev_rdm_avg;
+            zero_rdm_avg = ws->zero_rdm_avg;
+            cfar_cube = ws->cfar_cube;
+            onlyRD_data = ws->onlyRD_data;
+            preholding_data = ws->preholding_data;
+            postholding_data = ws->postholding_data;
+            plan = ws->plan;
+            plan3 = ws->plan3;
+
+            // The cached map is from an earlier visit to this geometry, do not difference against it
+            fresh_geometry = true;
+            print_geometry(geom);
+        }
+
+        const FrameGeometry& getGeometry()
+        {
+            return geom;
+        }
+
+        // Buffers of every preloaded geometry
+        void prefault() override
+        {
+            for (auto& entry : workspaces)
+                entry.second->prefault();
+        }
+
+        // Also writes every frame into a shared-memory ring for local readers (shm-ring.hpp): map,
+        // angle map, detections, and the range FFT cube if the ring was created with room for it.
+        // Frame-parallel lanes share one ring.
+        void setShm(std::shared_ptr<ShmRingWriter> ring)
+        {
+            shm = ring;
         }
         
     /*    
@@ -709,12 +1126,10 @@ class RangeDoppler : public RadarBlock
     
     void compute_range_fft(complex<float>* adc_data, complex<float>* onlyRD_data, complex<float>* preholding_data, complex<float>* postholding_data) {
     
-    	const int RD_bins = SLOW_TIME*FAST_TIME;
-    	const int N3 = FAST_TIME;
-        const int howmany3 = SLOW_TIME*TX*RX;
+    	const int N3 = geom.fast_time;
+        const int howmany3 = geom.slow_time*geom.virt_ants();
         const int idist3 = N3;
         const int istride3 = 1;
-        plan3 = fftwf_plan_dft_1d(N3, reinterpret_cast<fftwf_complex*>(preholding_data), reinterpret_cast<fftwf_complex*>(postholding_data), FFTW_FORWARD, FFTW_ESTIMATE);
         
         for (int k=0; k<howmany3; k++) {
         	for (int j=0; j<N3; j++) {
@@ -732,12 +1147,12 @@ class RangeDoppler : public RadarBlock
     }
 
 	void remove_zero_dop(float* rdm_avg, float* zero_rdm_avg) {
-	    for(int i=0; i<SLOW_TIME*FAST_TIME; i++) {
+	    for(int i=0; i<geom.rd_bins(); i++) {
 		zero_rdm_avg[i] = rdm_avg[i];
             }
-	    for(int i=32; i<34; i++) {
-		for(int j=0; j<FAST_TIME; j++) {
-		    int idx = i*FAST_TIME + j;
+	    for(int i=geom.slow_time/2; i<geom.slow_time/2+2; i++) {
+		for(int j=0; j<geom.fast_time; j++) {
+		    int idx = i*geom.fast_time + j;
 		    zero_rdm_avg[idx] = 0;
                 }
             }
@@ -904,7 +1319,8 @@ class RangeDoppler : public RadarBlock
 	    	
 	    }
 
-		std::cout << "Index of the complex number with the maximum magnitude: " << idxmaxmag*2 - 90 << std::endl;
+		if (verbose)
+			printf("Index of the complex number with the maximum magnitude: %d\n", idxmaxmag*2 - 90);
 		//cfar_max[0] = idxmaxmag*2 - 90;
 		
 	}
@@ -930,14 +1346,14 @@ class RangeDoppler : public RadarBlock
 	    cfar_max[0] = cfar_matrix(rdm_avg, prev_rdm_avg, cfar_cube);
 	    int maxidx = cfar_max[0];
 
-		const int range_bin = (maxidx % FAST_TIME);
-		const int RD_bins = SLOW_TIME*FAST_TIME;
+		const int range_bin = (maxidx % geom.fast_time);
+		const int RD_bins = geom.rd_bins();
 		
 		Matrix<complex<float>,12,12> sum_mat;
 		sum_mat.setZero();
 		
 		
-		for (int j=range_bin; j<RD_bins; j+=FAST_TIME) {
+		for (int j=range_bin; j<RD_bins; j+=geom.fast_time) {
 		
 			complex<float> xn_values[12] = {0};
 			getADCaverage(j, xn_values, adc_data);
@@ -1011,7 +1427,8 @@ class RangeDoppler : public RadarBlock
 	    }
 	    
 
-		std::cout << "Index of the complex number with the maximum magnitude: " << idxmaxmag - 90 << std::endl;
+		if (verbose)
+			printf("Index of the complex number with the maximum magnitude: %d\n", idxmaxmag - 90);
 		//cfar_max[0] = idxmaxmag*2 - 90;
 		final_angle[0] = idxmaxmag - 90;
 	}
@@ -1060,8 +1477,8 @@ class RangeDoppler : public RadarBlock
 	}
 
 	void getADCaverage(int index_1D, complex<float>* xnvalues, complex<float>* adc_data) {
-	    const int RD_bins = SLOW_TIME*FAST_TIME;
-	    for(int i=0; i<TX*RX; i++) {
+	    const int RD_bins = geom.rd_bins();
+	    for(int i=0; i<angle_ants(); i++) {
 			xnvalues[i] = adc_data[i*RD_bins + index_1D];
 		}
 	    
@@ -1124,12 +1541,13 @@ class RangeDoppler : public RadarBlock
 
 
 	int cfar_matrix(float* rdm_avg, float* prev_rdm_avg, float* cfar_cube) {
-	    for(int i=0; i<SLOW_TIME*FAST_TIME; i++) {
+	    const int RD_bins = geom.rd_bins();
+	    for(int i=0; i<RD_bins; i++) {
 		cfar_cube[i] = rdm_avg[i] - prev_rdm_avg[i];
 	    }
-	    float max = *std::max_element(cfar_cube, cfar_cube + SLOW_TIME*FAST_TIME);
+	    float max = *std::max_element(cfar_cube, cfar_cube + RD_bins);
 	    float threshold = max;
-	    for(int i=0; i<SLOW_TIME*FAST_TIME; i++) {
+	    for(int i=0; i<RD_bins; i++) {
 		if (cfar_cube[i] >= threshold) {
 		    cfar_cube[i] = 1;
 		    return i;
@@ -1143,8 +1561,8 @@ class RangeDoppler : public RadarBlock
 	
 
 	void getADCindices(int index_1D, int* indices) {
-	    const int RD_bins = SLOW_TIME*FAST_TIME;
-	    for(int i=0; i<TX*RX; i++) {
+	    const int RD_bins = geom.rd_bins();
+	    for(int i=0; i<angle_ants(); i++) {
 		indices[i] = i*RD_bins + index_1D;
 	    }
 	}
@@ -1152,10 +1570,10 @@ class RangeDoppler : public RadarBlock
 
 	float mean_noise_rdm(float* rdm_avg) {
 	    float MNF = 0;
-	    for(int i=0; i<SLOW_TIME*FAST_TIME; i++) {
+	    for(int i=0; i<geom.rd_bins(); i++) {
 		MNF = MNF + rdm_avg[i];
 	    }
-	    MNF = MNF/(SLOW_TIME*FAST_TIME);
+	    MNF = MNF/(geom.rd_bins());
 	    return MNF;
 	}
 
@@ -1166,10 +1584,10 @@ class RangeDoppler : public RadarBlock
 	    int maxidx = cfar_max[0];
 	    
 	    float multiplier = 9.0f / 256.0f;
-	    float rangeval = (maxidx%FAST_TIME) * multiplier;
+	    float rangeval = (maxidx%geom.fast_time) * multiplier;
 	    final_range[0] = rangeval;
 	    
-	    //std::cout << "max index: " << maxidx%FAST_TIME << std::endl;
+	    //std::cout << "max index: " << maxidx%geom.fast_time << std::endl;
 
 	    int indices[12] = {0};
 	    getADCindices(maxidx, indices);
@@ -1220,7 +1638,7 @@ class RangeDoppler : public RadarBlock
                 
                 int i = 0;
                 while (std::getline(file, line)) {
-                    if(i > SIZE_W_IQ){
+                    if(i >= geom.size_w_iq()){
                         std::cerr << "Error: More samples than SIZE " << filename << std::endl;
                         break;
                     }
@@ -1269,16 +1687,18 @@ class RangeDoppler : public RadarBlock
         }
         // output indices --> {IQ, FAST_TIME, SLOW_TIME, RX, TX}
         void getIndices(int index_1D, int* indices){
-            int i0 = index_1D/(RX*IQ*FAST_TIME*TX);
-            int i1 = index_1D%(RX*IQ*FAST_TIME*TX);
-            int i2 = i1%(RX*IQ*FAST_TIME);
-            int i3 = i2%(RX*IQ);
-            int i4 = i3%(RX);
+            const int RXg = geom.rx;
+            const int FAST = geom.fast_time;
+            int i0 = index_1D/(RXg*IQ*FAST*geom.tx);
+            int i1 = index_1D%(RXg*IQ*FAST*geom.tx);
+            int i2 = i1%(RXg*IQ*FAST);
+            int i3 = i2%(RXg*IQ);
+            int i4 = i3%(RXg);
             
             indices[2] = i0;                    // SLOW_TIME | Chirp#
-            indices[0] = i1/(RX*IQ*FAST_TIME);  // TX#
-            indices[3] = i2/(RX*IQ);            // FAST_TIME | Range#
-            indices[4] = i3/(RX);                 // IQ
+            indices[0] = i1/(RXg*IQ*FAST);      // TX#
+            indices[3] = i2/(RXg*IQ);           // FAST_TIME | Range#
+            indices[4] = i3/(RXg);              // IQ
             indices[1] = i4;                    // RX#
         }
 
@@ -1289,25 +1709,19 @@ class RangeDoppler : public RadarBlock
             int fast_time=0;
             int slow_time=0;
             int indices[5] = {0};
-            float window[FAST_TIME];
-            if(strcmp(WINDOW_TYPE,"blackman") == 0)
-                blackman_window(window, FAST_TIME);
-            else if(strcmp(WINDOW_TYPE,"hann") == 0)
-                hann_window(window, FAST_TIME);
-            else
-                no_window(window, FAST_TIME);
+            const float* window = ws->window;   // precomputed per geometry
             
-            for (int i =0; i<SIZE_W_IQ; i++) {
+            for (int i =0; i<geom.size_w_iq(); i++) {
                 getIndices(i, indices);
-                tx=indices[0]*RX*SLOW_TIME*FAST_TIME*IQ;
-                rx=indices[1]*SLOW_TIME*FAST_TIME*IQ;
-                slow_time=indices[2]*FAST_TIME*IQ;
+                tx=indices[0]*geom.rx*geom.rd_bins()*IQ;
+                rx=indices[1]*geom.rd_bins()*IQ;
+                slow_time=indices[2]*geom.fast_time*IQ;
                 fast_time=indices[3]*IQ;
                 iq=indices[4];
                 mid[tx+rx+slow_time+fast_time+iq]=in[i]*window[fast_time/IQ];
             }
 
-            for(int i=0; i<SIZE; i++){
+            for(int i=0; i<geom.size(); i++){
                 out[i]=std::complex<float>(mid[2*i+0], mid[2*i+1]);
             }
         }
@@ -1320,7 +1734,7 @@ class RangeDoppler : public RadarBlock
         
         void scale_rdm_values(float* arr, float max_val, float min_val){
             // fill in the matrix with the values scaled to 0-255 range
-            for (int i = 0; i < FAST_TIME*SLOW_TIME; i++) {
+            for (int i = 0; i < geom.rd_bins(); i++) {
                 arr[i] = (arr[i] - min_val) / (max_val - min_val) * 255;
                 if (arr[i] < 0)
                     arr[i] = 0; 
@@ -1328,25 +1742,25 @@ class RangeDoppler : public RadarBlock
         }
 
         void fftshift_rdm(float* arr){
-            int midRow = FAST_TIME / 2;
-            int midColumn = SLOW_TIME / 2;
-            float fftshifted[SLOW_TIME*FAST_TIME];
+            const int FAST = geom.fast_time;
+            const int SLOW = geom.slow_time;
+            int midRow = FAST / 2;
+            float* fftshifted = ws->fftshifted;
            
-            for (int i = 0; i < FAST_TIME; i++) {
-                for (int j = 0; j < SLOW_TIME; j++) {
-                    int newRow = (i + midRow) % FAST_TIME;          // ROW WISE FFTSHIFT
-                    int newColumn = (j + midColumn) % SLOW_TIME;    // COLUMN WISE FFTSHIFT
-                    fftshifted[newRow * SLOW_TIME + j] = arr[i * SLOW_TIME + j]; // only newRow is used so only row wise fftshift
+            for (int i = 0; i < FAST; i++) {
+                for (int j = 0; j < SLOW; j++) {
+                    int newRow = (i + midRow) % FAST;          // ROW WISE FFTSHIFT
+                    fftshifted[newRow * SLOW + j] = arr[i * SLOW + j]; // only newRow is used so only row wise fftshift
                 }
             }
-            for(int i = 0; i < FAST_TIME*SLOW_TIME; i++)
+            for(int i = 0; i < FAST*SLOW; i++)
                 arr[i] = fftshifted[i];
         }
 
         int compute_mag_norm(std::complex<float>* rdm_complex, float* rdm_magnitude) {
             float norm, log;
             std::complex<float> val; 
-            for(int i=0; i<SIZE; i++) {
+            for(int i=0; i<geom.size(); i++) {
                 val=rdm_complex[i];
                 norm=std::norm(val);
                 log=log2f(norm)/2.0f;
@@ -1357,8 +1771,8 @@ class RangeDoppler : public RadarBlock
         // rdm_avg should be zero-filled
         int averaged_rdm(float* rdm_norm, float* rdm_avg) {
             int idx;
-            const int VIRT_ANTS = TX*RX;
-            const int RD_BINS = SLOW_TIME*FAST_TIME;
+            const int VIRT_ANTS = geom.virt_ants();
+            const int RD_BINS = geom.rd_bins();
             if(!SET_SNR){
                 float max, min;
             }
@@ -1386,51 +1800,268 @@ class RangeDoppler : public RadarBlock
             //std::cout << "MAX: " << max << "      |        MIN:  " << min << std::endl;
             
             scale_rdm_values(rdm_avg, max, min);
+            TRACE_SCOPE("fftshift");
             fftshift_rdm(rdm_avg);
             return 0;   
         }
         
         void process() override
         {
-        	auto start = chrono::high_resolution_clock::now();
-
-            for(int i = 0; i<SIZE_W_IQ; i++){
-                adc_data_flat[i] = (float)input[i];
+            TRACE_SCOPE("rdm");
+
+            // Frame input when connected with setInputBlock. Results are written straight into the
+            // frame and the previous output frame stays referenced as the CFAR background.
+            FrameRef in_frame = getInputFrame();
+            if (in_frame) {
+                if (in_frame->geom != geom)
+                    setGeometry(in_frame->geom);    // profile changes travel with the frames
+                input = in_frame->adc;
+                claim_shm(in_frame.get());
             }
-	    if (frame <=1) {
-		for(int i=0; i<SLOW_TIME*FAST_TIME; i++) {
+            else if (input == NULL)
+                return;                             // nothing acquired yet
+
+	    if (frame <=1 || fresh_geometry) {
+		for(int i=0; i<geom.rd_bins(); i++) {
 		    prev_rdm_avg[i] = 0;
 	        }
+		fresh_geometry = false;
 	    }
 	    else {
-		for(int i=0; i<SLOW_TIME*FAST_TIME; i++) {
+		for(int i=0; i<geom.rd_bins(); i++) {
 		    prev_rdm_avg[i] = zero_rdm_avg[i];
 	        }
 	    }
-            shape_cube(adc_data_flat, adc_data_reshaped, adc_data);
-            compute_range_doppler();
-            compute_mag_norm(rdm_data, rdm_norm);
-            averaged_rdm(rdm_norm, rdm_avg);
-	    remove_zero_dop(rdm_avg, zero_rdm_avg);
-	    //compute_doppler_fft(adc_data, onlyRD_data, preholding_data, postholding_data);
-	    compute_range_fft(adc_data, onlyRD_data, preholding_data, postholding_data);
-	    shape_angle_data(zero_rdm_avg, prev_rdm_avg, cfar_cube, onlyRD_data, angle_data, cfar_max, final_range);
-	    //correlation_matrix(zero_rdm_avg, prev_rdm_avg, cfar_cube, onlyRD_data, cfar_max, Rmatrix, final_range, final_angle);
-	    compute_angle_est();
-	    compute_angmag_norm(angfft_data, angle_norm);
-	    //fftshift_ang_est(angle_norm);
-	    find_azimuth_angle(angle_norm, final_angle);
+	    if (in_frame)
+		zero_rdm_avg = in_frame->rdm;
+	    compute_rdm();
+	    compute_detection(in_frame ? in_frame->angle_map : angle_norm);
+
+	    if (in_frame) {
+		fill_detections(in_frame.get());
+		in_frame->t_processed_ns = monotonic_ns();
+		publishFrame(in_frame);
+		last_output = in_frame;
+		publish_shm(in_frame.get());
+	    }
 	    
 
             // string str = ("./out") + to_string(frame) + ".txt";
             // save_1d_array(rdm_avg, FAST_TIME, SLOW_TIME, str);
-
-             auto stop = chrono::high_resolution_clock::now();
-             auto duration_rdm_process = duration_cast<microseconds>(stop - start);
-             std::cout << "RDM Process Time " << duration_rdm_process.count() << " microseconds" << std::endl;
 	    
 	    frame ++;
-	    std::cout << "Frame: " << frame << std::endl;
+        }
+
+        // Frame-parallel entry points. The only state carried from one frame to the next is the
+        // previous frame's map (the CFAR background), so it is passed in explicitly instead of
+        // living in the block. Several RangeDoppler instances can then work on consecutive frames
+        // at the same time, see parallel-dsp.hpp.
+
+        // First half: range-doppler map of f into f->rdm, plus the range FFT kept for the second half
+        void process_rdm(RadarFrame* f)
+        {
+            trace_set_frame(f->id);
+            TRACE_SCOPE("rdm.map");
+            if (f->geom != geom)
+                setGeometry(f->geom);
+            input = f->adc;
+            zero_rdm_avg = f->rdm;
+            claim_shm(f);
+            compute_rdm();
+        }
+
+        // Second half, on the same instance as process_rdm(f): CFAR against prev_rdm (NULL for none),
+        // angle estimate and detections
+        void process_detect(RadarFrame* f, const float* prev_rdm)
+        {
+            trace_set_frame(f->id);
+            TRACE_SCOPE("rdm.detect");
+            if (prev_rdm)
+                memcpy(prev_rdm_avg, prev_rdm, geom.rd_bins()*sizeof(float));
+            else
+                memset(prev_rdm_avg, 0, geom.rd_bins()*sizeof(float));
+            compute_detection(f->angle_map);
+            fill_detections(f);
+            f->t_processed_ns = monotonic_ns();
+            publish_shm(f);
+        }
+
+        // Takes the frame's slot in the shared-memory ring before the DSP starts on it. The range FFT
+        // cube (the bulk of a slot) is then computed into the slot instead of the workspace, readers
+        // get it without a copy.
+        void claim_shm(const RadarFrame* f)
+        {
+            if (!shm || !shm->isOpen())
+                return;
+            shm_slot = shm->begin(f->id);
+            if (shm_slot && geom.size() > 0 && (uint32_t) geom.size() <= shm->getHeader().max_cube)
+                onlyRD_data = reinterpret_cast<std::complex<float>*>(shm->cube(shm_slot));
+        }
+
+        // Completes and publishes the slot taken by claim_shm(). The map stays in the frame for the
+        // stages after the DSP, so it, the angle map and the detections are copied (a 512x64 map is
+        // 128 KB, against 3 MB of range FFT cube computed in place).
+        void publish_shm(const RadarFrame* f)
+        {
+            if (!shm_slot)
+                return;
+            TRACE_SCOPE("shm");
+            ShmSlotHeader* s = shm_slot;
+            s->t_wall_ns = f->t_wall_ns;
+            s->t_acquired_ns = f->t_acquired_ns;
+            s->t_processed_ns = f->t_processed_ns;
+            s->fast_time = geom.fast_time;
+            s->slow_time = geom.slow_time;
+            s->rx = geom.rx;
+            s->tx = geom.tx;
+            static_assert(ANGLE_BINS == SHM_ANGLE_BINS, "angle map size in the ring");
+            memcpy(shm->angle_map(s), f->angle_map, sizeof(f->angle_map));
+            int n = std::min<int>(f->num_detections, shm->getHeader().max_detections);
+            for (int i = 0; i < n; i++)
+                shm->detections(s)[i] = to_wire(f->detections[i]);
+            s->num_detections = n;
+            // A geometry larger than the ring was made for leaves the arrays out (counts stay 0)
+            if ((uint32_t) geom.rd_bins() <= shm->getHeader().max_rd_bins) {
+                memcpy(shm->rdm(s), f->rdm, geom.rd_bins()*sizeof(float));
+                s->rd_bins = geom.rd_bins();
+            }
+            if (onlyRD_data != ws->onlyRD_data) {
+                s->cube_samples = geom.size();
+                onlyRD_data = ws->onlyRD_data;
+            }
+            shm->end(s);
+            shm_slot = NULL;
+        }
+
+        // ADC cube -> scaled range-doppler map with zero Doppler removed (zero_rdm_avg) and the
+        // per-channel range FFT (onlyRD_data)
+        void compute_rdm()
+        {
+            {
+                TRACE_SCOPE("shape_cube");
+                ingest_cube();
+            }
+            {
+                TRACE_SCOPE("rd_fft");
+                compute_range_doppler();
+            }
+            {
+                TRACE_SCOPE("mag_norm");
+                compute_mag_norm(rdm_data, rdm_norm);
+            }
+            {
+                TRACE_SCOPE("integrate");
+                averaged_rdm(rdm_norm, rdm_avg);
+	        remove_zero_dop(rdm_avg, zero_rdm_avg);
+            }
+	    //compute_doppler_fft(adc_data, onlyRD_data, preholding_data, postholding_data);
+            {
+                TRACE_SCOPE("range_fft");
+	        compute_range_fft(adc_data, onlyRD_data, preholding_data, postholding_data);
+            }
+        }
+
+        // Raw ADC samples -> windowed complex cube (adc_data)
+        void ingest_cube()
+        {
+            for(int i = 0; i<geom.size_w_iq(); i++){
+                adc_data_flat[i] = (float)input[i];
+            }
+            shape_cube(adc_data_flat, adc_data_reshaped, adc_data);
+        }
+
+        // CFAR of zero_rdm_avg against prev_rdm_avg, then the angle FFT at the peak
+        void compute_detection(float* angle_out)
+        {
+            {
+                TRACE_SCOPE("cfar");
+	        shape_angle_data(zero_rdm_avg, prev_rdm_avg, cfar_cube, onlyRD_data, angle_data, cfar_max, final_range);
+            }
+	    //correlation_matrix(zero_rdm_avg, prev_rdm_avg, cfar_cube, onlyRD_data, cfar_max, Rmatrix, final_range, final_angle);
+            TRACE_SCOPE("angle");
+	    compute_angle_est();
+	    compute_angmag_norm(angfft_data, angle_out);
+	    //fftshift_ang_est(angle_norm);
+	    find_azimuth_angle(angle_out, final_angle);
+        }
+
+        // Single kernels of the chain on the current buffers, for the microbenchmarks (tools/bench).
+        // Run process_rdm() and process_detect() on a frame first so every buffer holds real data.
+        enum Kernel { KERNEL_INGEST, KERNEL_RD_FFT, KERNEL_MAG_NORM, KERNEL_INTEGRATE, KERNEL_FFTSHIFT,
+                      KERNEL_RANGE_FFT, KERNEL_CFAR, KERNEL_ANGLE_FFT, KERNEL_MVDR, NUM_KERNELS };
+
+        static const char* kernelName(int k)
+        {
+            static const char* names[NUM_KERNELS] = {"ingest", "rd_fft", "mag_norm", "integrate", "fftshift",
+                                                     "range_fft", "cfar", "angle_fft", "mvdr"};
+            return names[k];
+        }
+
+        // Work of one call: samples in and bytes read + written (FFT internals not counted)
+        void kernelWork(int k, uint64_t& samples, uint64_t& bytes)
+        {
+            const uint64_t w = geom.size_w_iq(), n = geom.size(), rd = geom.rd_bins();
+            switch (k) {
+                case KERNEL_INGEST:    samples = n;  bytes = 2*w + 8*w + 8*w + 4*w; break;  // u16 -> float -> reshaped -> complex
+                case KERNEL_RD_FFT:    samples = n;  bytes = 16*n; break;
+                case KERNEL_MAG_NORM:  samples = n;  bytes = 12*n; break;
+                case KERNEL_INTEGRATE: samples = n;  bytes = 4*n + 28*rd; break;            // incl. scaling, fftshift, zero Doppler
+                case KERNEL_FFTSHIFT:  samples = rd; bytes = 16*rd; break;
+                case KERNEL_RANGE_FFT: samples = n;  bytes = 32*n; break;                   // through the 1-D holding buffers
+                case KERNEL_CFAR:      samples = rd; bytes = 20*rd; break;
+                case KERNEL_ANGLE_FFT: samples = ANGLE_BINS; bytes = 28*ANGLE_BINS; break;
+                default:               samples = angle_ants()*geom.slow_time; bytes = 8*samples + 20*rd; break;  // CFAR + snapshots
+            }
+        }
+
+        void runKernel(int k)
+        {
+            switch (k) {
+                case KERNEL_INGEST:
+                    ingest_cube();
+                    break;
+                case KERNEL_RD_FFT:
+                    compute_range_doppler();
+                    break;
+                case KERNEL_MAG_NORM:
+                    compute_mag_norm(rdm_data, rdm_norm);
+                    break;
+                case KERNEL_INTEGRATE:
+                    averaged_rdm(rdm_norm, rdm_avg);
+                    remove_zero_dop(rdm_avg, zero_rdm_avg);
+                    break;
+                case KERNEL_FFTSHIFT:
+                    fftshift_rdm(rdm_avg);
+                    break;
+                case KERNEL_RANGE_FFT:
+                    compute_range_fft(adc_data, onlyRD_data, preholding_data, postholding_data);
+                    break;
+                case KERNEL_CFAR:
+                    shape_angle_data(zero_rdm_avg, prev_rdm_avg, cfar_cube, onlyRD_data, angle_data, cfar_max, final_range);
+                    break;
+                case KERNEL_ANGLE_FFT:
+                    compute_angle_est();
+                    compute_angmag_norm(angfft_data, angle_norm);
+                    find_azimuth_angle(angle_norm, final_angle);
+                    break;
+                case KERNEL_MVDR:
+                    correlation_matrix(zero_rdm_avg, prev_rdm_avg, cfar_cube, onlyRD_data, cfar_max, Rmatrix, final_range, final_angle);
+                    break;
+            }
+        }
+
+        // Stores the current CFAR peak as the frame's detection list
+        void fill_detections(RadarFrame* f)
+        {
+            Detection& det = f->detections[0];
+            det.range_bin = cfar_max[0] % geom.fast_time;
+            det.doppler_bin = cfar_max[0] / geom.fast_time;
+            det.range = final_range[0];
+            det.doppler = det.doppler_bin - geom.slow_time/2;
+            det.azimuth = final_angle[0];
+            det.elevation = 0;
+            det.snr = zero_rdm_avg[cfar_max[0]] - mean_noise_rdm(zero_rdm_avg);
+            f->num_detections = 1;
         }
 
         private: 
@@ -1442,6 +2073,17 @@ class RangeDoppler : public RadarBlock
             const char *WINDOW_TYPE;
             bool SET_SNR;
             float max,min;
+
+            FrameGeometry geom;
+            RangeDopplerWorkspace* ws;                                  // buffers for the active geometry
+            std::map<FrameGeometry, RangeDopplerWorkspace*> workspaces; // plan/buffer cache keyed by geometry
+            bool fresh_geometry;
+            FrameRef last_output;                                       // keeps the previous map alive for CFAR
+            std::shared_ptr<ShmRingWriter> shm;                         // optional, see setShm
+            ShmSlotHeader* shm_slot;                                    // claimed for the frame in progress
+
+            // The angle FFT layout is built for the 3TX x 4RX virtual array (12 channels)
+            int angle_ants() { return std::min(geom.virt_ants(), 12); }
         
 };
 
@@ -1449,18 +2091,48 @@ class RangeDoppler : public RadarBlock
 class DataAcquisition : public RadarBlock
 { 
     public:
-        DataAcquisition() : RadarBlock(SIZE,SIZE)
+        DataAcquisition(const FrameGeometry& g = FrameGeometry(), int pool_size = FRAME_POOL_SIZE) : RadarBlock(g.size(),g.size())
         {
-            
-            frame_data = reinterpret_cast<uint16_t*>(malloc(SIZE_W_IQ*sizeof(uint16_t)));
-            BYTES_IN_FRAME = SLOW_TIME*FAST_TIME*RX*TX*IQ*IQ_BYTES;
-            BYTES_IN_FRAME_CLIPPED = BYTES_IN_FRAME/BYTES_IN_PACKET*BYTES_IN_PACKET;
-            PACKETS_IN_FRAME_CLIPPED = BYTES_IN_FRAME / BYTES_IN_PACKET;
             UINT16_IN_PACKET = BYTES_IN_PACKET / 2; //728 entries in packet
-            UINT16_IN_FRAME = BYTES_IN_FRAME / 2;
             packets_read = 0;
             buffer=reinterpret_cast<char*>(malloc(BUFFER_SIZE*sizeof(char)));
             packet_data=reinterpret_cast<uint16_t*>(malloc(UINT16_IN_PACKET*sizeof(uint16_t)));     
+            pool_frames = pool_size;    // frames preallocated per geometry
+            next_frame_id = 1;
+            setGeometry(g);
+        }
+
+        ~DataAcquisition()
+        {
+            // Frames in flight point back into the pools, drop ours before freeing them
+            publishFrame(FrameRef());
+            current.reset();
+            for (auto& entry : pools)
+                delete entry.second;
+        }
+
+        // Switches to a new frame geometry. Frame pools are cached per geometry, so going back
+        // to a previous profile does not allocate. Frames carry their geometry downstream.
+        void setGeometry(const FrameGeometry& g)
+        {
+            auto it = pools.find(g);
+            if (it == pools.end())
+                it = pools.insert(std::make_pair(g, new FramePool(g, pool_frames))).first;
+            pool = it->second;
+            geom = g;
+
+            BYTES_IN_FRAME = g.bytes_in_frame();
+            BYTES_IN_FRAME_CLIPPED = BYTES_IN_FRAME/BYTES_IN_PACKET*BYTES_IN_PACKET;
+            PACKETS_IN_FRAME_CLIPPED = BYTES_IN_FRAME / BYTES_IN_PACKET;
+            UINT16_IN_FRAME = BYTES_IN_FRAME / 2;
+            packets_read = 0;
+        }
+
+        // Frames of every pool
+        void prefault() override
+        {
+            for (auto& entry : pools)
+                entry.second->prefault();
         }
 
         // create_bind_socket - returns a socket object titled sockfd
@@ -1573,29 +2245,28 @@ class DataAcquisition : public RadarBlock
         }
 
 
+        // ADC buffer of the most recently acquired frame. Only valid until that frame is recycled,
+        // downstream blocks should connect with setInputBlock instead.
         uint16_t* getBufferPointer(){
             return frame_data;
         }
 
         void listen() override
         {
-             for(;;)
-            {
-                if(frame==0){
-                    break;
-                }
-                if(*inputframeptr != lastframe)
-                {   
-                    lastframe = *inputframeptr;
-                    break;
-                }
-            }
+            // The first frame is acquired without waiting for downstream
+            if(frame==0)
+                return;
+            wait_for_input();
         }
 
         void process() override
         {
+            TRACE_SCOPE("daq");
 
-            auto start = chrono::high_resolution_clock::now();
+            // Waits for a free frame if every pooled frame is still referenced downstream
+            current = pool->acquire();
+            current->geom = geom;
+            frame_data = current->adc;
 
             create_bind_socket();
             
@@ -1636,10 +2307,11 @@ class DataAcquisition : public RadarBlock
             // auto duration = duration_cast<microseconds>(stop - start);
             // std::cout << "Process Time " << duration.count() << std::endl;
             // std::cout << std::endl;
-            auto stop = chrono::high_resolution_clock::now();
-            auto duration_daq_process = duration_cast<microseconds>(stop - start);
-            std::cout << "DAQ Process Time " << duration_daq_process.count() << " microseconds" << std::endl;
-            std::cout << "~~~~~~~~~~~~~~~~~~~END OF SINGLE FRAME~~~~~~~~~~~~~~~~~~~~" << std::endl;
+            current->id = next_frame_id++;
+            current->t_acquired_ns = monotonic_ns();
+            current->t_wall_ns = wall_clock_ns();
+            trace_set_frame(current->id);
+            publishFrame(std::move(current));
 
 
         }
@@ -1653,7 +2325,14 @@ class DataAcquisition : public RadarBlock
             char* buffer;
             int n;  // n is the packet size in bytes (including sequence number and byte count)
             
-            uint16_t *packet_data, *frame_data;  
+            uint16_t *packet_data, *frame_data;
+
+            FrameGeometry geom;
+            FramePool* pool;                                // pool of the active geometry
+            std::map<FrameGeometry, FramePool*> pools;      // one preallocated pool per geometry
+            FrameRef current;                               // frame being filled
+            int pool_frames;
+            uint32_t next_frame_id;  
             uint32_t packet_num;
             uint64_t BYTES_IN_FRAME, BYTES_IN_FRAME_CLIPPED, PACKETS_IN_FRAME_CLIPPED, UINT16_IN_PACKET, UINT16_IN_FRAME, packets_read;
             
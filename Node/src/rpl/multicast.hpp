@@ -0,0 +1,218 @@
+#pragma once
+// UDP multicast of a node's frames to any number of listeners on the LAN (fusion server, logger,
+// dashboard): the node sends every datagram once, whoever joined the group receives it.
+// Standalone like detection-wire.hpp, subscribers include it on its own.
+//
+// Two kinds of datagrams go to the group, each at most MCAST_PAYLOAD bytes so nothing is
+// fragmented on an Ethernet MTU:
+//  - detections: a detection-wire.hpp message with one frame. A frame with more detections than
+//    fit is split over several messages of the same frame number, all but the last flagged
+//    WIRE_FRAME_MORE. WireHeader.seq counts these datagrams.
+//  - RDM tiles (optional): the range-Doppler map max-pooled by a decimation factor, as 8-bit
+//    levels, cut into tiles of MCAST_TILE x MCAST_TILE cells, one RdmTileHeader + levels each.
+//    RdmTileHeader.seq counts tile datagrams.
+// UDP gives no delivery guarantee: a jump in either sequence number is that many lost datagrams.
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "detection-wire.hpp"
+
+#define MCAST_GROUP "239.255.12.10"     // administratively scoped, stays on the site
+#define MCAST_PORT 1211
+#define MCAST_PAYLOAD 1472              // UDP payload of a 1500 byte MTU
+#define MCAST_TILE 32                   // tile edge in decimated cells (1 KB of levels)
+#define MCAST_MAX_DATAGRAMS 64          // sent with one sendmmsg, a larger frame takes several
+#define RDM_TILE_MAGIC "RDMT"
+#define RDM_TILE_VERSION 1
+
+struct RdmTileHeader
+{
+    char magic[4];              // RDM_TILE_MAGIC
+    uint16_t version;           // RDM_TILE_VERSION
+    uint16_t node_id;
+    uint32_t seq;               // per node, +1 per tile datagram
+    uint32_t frame;
+    int64_t t_wall_ns;
+    uint16_t range_bins;        // decimated map
+    uint16_t doppler_bins;
+    uint16_t range0;            // first cell of this tile in the decimated map
+    uint16_t doppler0;
+    uint16_t tile_range;        // cells in this tile, smaller at the map edges
+    uint16_t tile_doppler;
+    uint8_t decimation;         // RDM bins per cell along each axis
+    uint8_t reserved;
+    uint16_t tiles;             // tiles of this frame
+    // then tile_doppler x tile_range levels, Doppler major like RadarFrame::rdm
+};
+
+static_assert(sizeof(RdmTileHeader) == 40, "RdmTileHeader layout");
+static_assert(sizeof(RdmTileHeader) + MCAST_TILE * MCAST_TILE <= MCAST_PAYLOAD, "tile fits a datagram");
+
+// Detections that fit one datagram next to the wire header and frame record
+#define MCAST_DETECTIONS_PER_DATAGRAM ((MCAST_PAYLOAD - sizeof(WireHeader) - sizeof(WireFrame)) / sizeof(WireDetection))
+
+// Sending side: one non-blocking UDP socket for the group
+class MulticastPublisher
+{
+    int fd;
+    struct sockaddr_in group;
+    std::vector<std::vector<uint8_t>> datagrams;    // waiting to be sent, reused
+    int used;
+    uint64_t sent, dropped;
+
+    public:
+        MulticastPublisher() : fd(-1), used(0), sent(0), dropped(0)
+        {
+            memset(&group, 0, sizeof(group));
+        }
+
+        ~MulticastPublisher()
+        {
+            if (fd >= 0)
+                close(fd);
+        }
+
+        // ttl 1 keeps the datagrams on the local subnet. iface is the local address of the
+        // interface to send on, empty for the default route's.
+        bool open(const std::string& addr = MCAST_GROUP, int port = MCAST_PORT, int ttl = 1, const std::string& iface = "")
+        {
+            group.sin_family = AF_INET;
+            group.sin_port = htons(port);
+            if (inet_pton(AF_INET, addr.c_str(), &group.sin_addr) != 1 || !IN_MULTICAST(ntohl(group.sin_addr.s_addr))) {
+                fprintf(stderr, "Error: '%s' is not a multicast group\n", addr.c_str());
+                return false;
+            }
+            fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+            if (fd < 0) {
+                perror("[ERROR] creating the multicast socket\n");
+                return false;
+            }
+            unsigned char t = std::max(0, std::min(ttl, 255)), loop = 1;
+            setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &t, sizeof(t));
+            setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));    // listeners on the node itself
+            if (!iface.empty()) {
+                struct in_addr ia;
+                if (inet_pton(AF_INET, iface.c_str(), &ia) != 1 || setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &ia, sizeof(ia)) != 0) {
+                    fprintf(stderr, "Error: cannot send multicast on interface %s\n", iface.c_str());
+                    return false;
+                }
+            }
+            printf("Multicasting to %s:%d (ttl %d)\n", addr.c_str(), port, ttl);
+            return true;
+        }
+
+        // Starts the datagrams of a frame
+        void begin()
+        {
+            used = 0;
+        }
+
+        // Buffer for the next datagram of the frame. Once MCAST_MAX_DATAGRAMS are waiting they are
+        // sent first, so a frame of any size goes out (a 1024x128 map undecimated is 128 tiles).
+        std::vector<uint8_t>* add()
+        {
+            if (used >= MCAST_MAX_DATAGRAMS)
+                flush();
+            if ((int) datagrams.size() <= used)
+                datagrams.emplace_back();
+            datagrams[used].clear();
+            return &datagrams[used++];
+        }
+
+        // Sends the waiting datagrams with one system call. A full socket buffer drops the rest
+        // (counted), the frame path never waits for the network.
+        void flush()
+        {
+            struct mmsghdr msgs[MCAST_MAX_DATAGRAMS];
+            struct iovec iov[MCAST_MAX_DATAGRAMS];
+            memset(msgs, 0, sizeof(mmsghdr) * used);
+            for (int i = 0; i < used; i++) {
+                iov[i].iov_base = datagrams[i].data();
+                iov[i].iov_len = datagrams[i].size();
+                msgs[i].msg_hdr.msg_name = &group;
+                msgs[i].msg_hdr.msg_namelen = sizeof(group);
+                msgs[i].msg_hdr.msg_iov = &iov[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+            int done = 0;
+            while (done < used) {
+                int n = sendmmsg(fd, msgs + done, used - done, 0);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    break;
+                done += n;
+            }
+            sent += done;
+            dropped += used - done;
+            used = 0;
+        }
+
+        uint64_t getSent() const { return sent; }
+        uint64_t getDropped() const { return dropped; }
+};
+
+// Max-pools a Doppler-major fast x slow map by d along both axes into 8-bit levels
+// (the map is scaled to 0-255 by the DSP, see RangeDoppler)
+inline void decimate_rdm(const float* rdm, int fast, int slow, int d, std::vector<uint8_t>& out, int& range_bins, int& doppler_bins)
+{
+    range_bins = fast / d;
+    doppler_bins = slow / d;
+    out.assign((size_t) range_bins * doppler_bins, 0);
+    for (int v = 0; v < doppler_bins; v++) {
+        uint8_t* row = out.data() + (size_t) v * range_bins;
+        for (int dv = 0; dv < d; dv++) {
+            const float* src = rdm + (size_t) (v * d + dv) * fast;
+            for (int r = 0; r < range_bins; r++) {
+                float m = src[r * d];
+                for (int dr = 1; dr < d; dr++)
+                    m = std::max(m, src[r * d + dr]);
+                uint8_t level = (uint8_t) std::min(std::max(m, 0.0f), 255.0f);
+                row[r] = std::max(row[r], level);
+            }
+        }
+    }
+}
+
+// Receiving side: a socket that has joined the group, bound to its port. Several subscribers on
+// one host can share the port. iface as for MulticastPublisher::open. Returns the socket or -1.
+inline int mcast_subscribe(const std::string& addr = MCAST_GROUP, int port = MCAST_PORT, const std::string& iface = "")
+{
+    struct ip_mreq mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    if (inet_pton(AF_INET, addr.c_str(), &mreq.imr_multiaddr) != 1) {
+        fprintf(stderr, "Error: bad multicast group '%s'\n", addr.c_str());
+        return -1;
+    }
+    mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (!iface.empty() && inet_pton(AF_INET, iface.c_str(), &mreq.imr_interface) != 1) {
+        fprintf(stderr, "Error: bad interface address '%s'\n", iface.c_str());
+        return -1;
+    }
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        perror("[ERROR] creating the multicast socket\n");
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    sa.sin_addr = mreq.imr_multiaddr;           // only this group's datagrams
+    if (bind(fd, (struct sockaddr*) &sa, sizeof(sa)) != 0 || setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0) {
+        perror("[ERROR] joining the multicast group\n");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
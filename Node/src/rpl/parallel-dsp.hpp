@@ -0,0 +1,200 @@
+#pragma once
+// Frame-parallel range-doppler processing.
+//
+// A frame only depends on the previous one through its map (prev_rdm_avg, the CFAR background).
+// Each frame is split in two tasks on a work-stealing pool:
+//  1. process_rdm: ADC cube -> range-doppler map, independent of every other frame
+//  2. process_detect: CFAR against the previous frame's map, angle and detections. Runs as soon
+//     as both this frame's and the previous frame's maps exist.
+// The two halves of a frame run on the same RangeDoppler "lane" (buffers + FFT plans), lanes
+// are handed out in frame order so the oldest frame always has one. Finished frames wait in
+// a reorder ring and are delivered downstream strictly in frame order.
+//
+// This raises throughput when one frame takes longer than the frame period, the latency of
+// a single frame stays the same.
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class ParallelRangeDopplerStage : public PipelineStage
+{
+    struct Job
+    {
+        uint64_t seq;
+        FrameRef frame;
+        FrameRef prev;          // previous frame, its map is this frame's CFAR background
+        RangeDoppler* lane;
+        bool rdm_done;          // first half finished, frame->rdm is valid
+        bool waiting;           // first half finished, previous map not ready yet
+        bool done;              // detections filled, waiting for its turn downstream
+    };
+
+    std::vector<std::unique_ptr<RangeDoppler>> lanes;
+    std::vector<RangeDoppler*> free_lanes;
+    std::vector<Job> jobs;      // reorder ring, frame seq lives in jobs[seq % jobs.size()]
+    uint64_t next_seq;
+    uint64_t next_deliver;
+    bool delivering;
+    FrameRef last_frame;
+    std::mutex m;
+    std::condition_variable slot_cv;
+    RtThreadConfig worker_rt;
+    WorkStealingExecutor executor;
+
+    public:
+        // workers threads, one lane per worker plus one so a new frame can start while the
+        // oldest waits on its predecessor. in_flight bounds the frames between submission and
+        // delivery (at least the number of lanes). With worker_rt.cpus listing at least one core
+        // per worker, worker i is pinned to the i-th core, otherwise all workers share the list.
+        ParallelRangeDopplerStage(const std::string& n, const char* win, const FrameGeometry& g, int workers, ExecPolicy e,
+                                  const RtThreadConfig& wrt = RtThreadConfig(), int in_flight = 0)
+            : PipelineStage(n, e), next_seq(0), next_deliver(0), delivering(false), worker_rt(wrt),
+              executor(workers, [this, workers](int i) { start_worker(i, workers); })
+        {
+            int num_lanes = std::max(workers, 1) + 1;
+            for (int i = 0; i < num_lanes; i++) {
+                lanes.emplace_back(new RangeDoppler(win, g));
+                free_lanes.push_back(lanes.back().get());
+            }
+            jobs.resize(std::max(in_flight, 2 * num_lanes));
+            for (Job& j : jobs) {
+                j.seq = UINT64_MAX;
+                j.lane = NULL;
+                j.rdm_done = j.waiting = j.done = false;
+            }
+        }
+
+        ~ParallelRangeDopplerStage()
+        {
+            executor.stop();
+        }
+
+        void finish() override
+        {
+            executor.stop();
+        }
+
+        // Queues the frame and returns right away. Waits only when every lane or every reorder
+        // slot is taken, which holds up the input edge like a slow block would.
+        FrameRef run(FrameRef in) override
+        {
+            if (!in)
+                return FrameRef();
+            Job* j;
+            {
+                std::unique_lock<std::mutex> lock(m);
+                slot_cv.wait(lock, [this] {
+                    return !free_lanes.empty() && next_seq - next_deliver < jobs.size();
+                });
+                j = &jobs[next_seq % jobs.size()];
+                j->seq = next_seq++;
+                j->frame = in;
+                j->prev = std::move(last_frame);
+                j->lane = free_lanes.back();
+                free_lanes.pop_back();
+                j->rdm_done = j->waiting = j->done = false;
+                last_frame = std::move(in);
+            }
+            executor.submit([this, j] { first_half(j); });
+            return FrameRef();          // results go out through deliver(), in frame order
+        }
+
+        void prefault() override
+        {
+            for (auto& lane : lanes)
+                lane->prefault();
+        }
+
+        void realtimeCpus(std::vector<int>& cpus) override
+        {
+            PipelineStage::realtimeCpus(cpus);
+            cpus.insert(cpus.end(), worker_rt.cpus.begin(), worker_rt.cpus.end());
+        }
+
+        // Every lane writes its frames into the same ring
+        void setShm(std::shared_ptr<ShmRingWriter> ring)
+        {
+            for (auto& lane : lanes)
+                lane->setShm(ring);
+        }
+
+        int getWorkers() const { return executor.size(); }
+        uint64_t getSteals() const { return executor.getSteals(); }
+
+    private:
+        void start_worker(int i, int workers)
+        {
+            if (!worker_rt.enabled())
+                return;
+            RtThreadConfig cfg = worker_rt;
+            if ((int) cfg.cpus.size() >= workers)
+                cfg.cpus = std::vector<int>(1, worker_rt.cpus[i]);
+            apply_thread_rt(cfg, (name + " worker " + std::to_string(i)).c_str());
+        }
+
+        // Called with m held
+        bool prev_ready(Job* j)
+        {
+            if (!j->prev)
+                return true;
+            Job& p = jobs[(j->seq - 1) % jobs.size()];
+            return p.seq != j->seq - 1 || p.rdm_done;       // slot reused means it was delivered
+        }
+
+        void first_half(Job* j)
+        {
+            j->lane->process_rdm(j->frame.get());
+
+            bool ready;
+            Job* next = NULL;
+            {
+                std::lock_guard<std::mutex> lock(m);
+                j->rdm_done = true;
+                ready = prev_ready(j);
+                j->waiting = !ready;
+                Job& n = jobs[(j->seq + 1) % jobs.size()];
+                if (n.seq == j->seq + 1 && n.waiting) {
+                    n.waiting = false;
+                    next = &n;
+                }
+            }
+            if (next)
+                executor.submit([this, next] { second_half(next); });
+            if (ready)
+                second_half(j);         // same worker, the lane's buffers are still in cache
+        }
+
+        void second_half(Job* j)
+        {
+            const RadarFrame* prev = j->prev.get();
+            j->lane->process_detect(j->frame.get(), (prev && prev->geom == j->frame->geom) ? prev->rdm : NULL);
+
+            std::unique_lock<std::mutex> lock(m);
+            free_lanes.push_back(j->lane);
+            j->lane = NULL;
+            j->prev.reset();
+            j->done = true;
+            slot_cv.notify_all();
+            if (delivering)
+                return;                 // the thread already delivering will pick this one up
+
+            // One thread delivers at a time so consumers see the frames in order
+            delivering = true;
+            for (;;) {
+                Job& d = jobs[next_deliver % jobs.size()];
+                if (next_deliver == next_seq || d.seq != next_deliver || !d.done)
+                    break;
+                FrameRef out = std::move(d.frame);
+                d.done = false;
+                next_deliver++;
+                lock.unlock();
+                slot_cv.notify_all();
+                if (deliver)
+                    deliver(out);
+                out.reset();
+                lock.lock();
+            }
+            delivering = false;
+        }
+};
@@ -0,0 +1,373 @@
+#pragma once
+// Text description of a Pipeline, see test/Pipeline/pipeline.cfg for an example.
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Builds a pipeline from a config file. One directive per line, '#' starts a comment:
+//   pool_threads <n> [cpu=<list>] [prio=<1-99>]
+//   stage <name> <type> <thread|pool|inline> [key=value ...]
+//   edge <from> <to> <block|drop_oldest|drop_newest|latest> [capacity]
+//   mlockall
+// Edge policies are described at FrameEdge, "latest" is a mailbox and ignores capacity.
+// Real-time profile (realtime.hpp): every stage takes cpu=<list> (e.g. 3, 2-3 or 0,4) and
+// prio=<1-99> (SCHED_FIFO) for its own thread, pool_threads takes the same for the pool.
+// mlockall locks all memory once the stages are built and pre-faulted.
+// Stage types and their options:
+//   daq                                 DataAcquisition (source, must use thread)
+//   sim            scene=<file>         SimulatedAcquisition in place of daq, scene as in load_sim_scene()
+//                  threads=1            simulator threads per frame
+//                  realtime=1           0 releases frames as fast as they are consumed
+//   range_doppler  window=blackman      RangeDoppler (blackman or hann)
+//                  workers=1            > 1 processes that many frames at once (parallel-dsp.hpp)
+//                  worker_cpus=<list>   cores of the workers, one each if the list is long enough
+//                  worker_prio=<1-99>   SCHED_FIFO priority of the workers
+//                  shm=<name>           also writes every frame into a shared-memory ring (shm-ring.hpp), e.g. /rpl_node
+//                  shm_slots=8          frames the ring holds
+//                  shm_cube=0           1 also publishes the range FFT cube of every channel
+//   visualizer     wait=1               Visualizer (waitKey time in ms)
+//                  refresh=0            > 0 draws on a display thread at that many Hz
+//                  view=rdm             angle shows the angle spectrum in place of the RDM
+//                  headless=0           1 never opens a window (no display on the node)
+//                  stream=[addr:]port   serves the canvas as MJPEG (addr defaults to 127.0.0.1)
+//                  record=<file.avi>    records the canvas (at refresh Hz, else the frame rate)
+//   uplink         log=<dir>            JSON_TCP to the multi-node server, log= also keeps the JSON files
+//                  format=json          binary sends every detection in the detection-wire.hpp format
+//                  node=0               node id in binary messages
+//                  server=<ip>[:port]   multi-node server (IP:SERVER_PORT of implementation.cpp)
+//                  queue=64             messages waiting for the link, then policy applies
+//                  policy=drop_oldest   drop_newest, or latest (only the newest message waits)
+//                  batch=16             max queued messages coalesced into one write
+//                  frames=8             binary: max frames folded into one message while messages are queued
+//   multicast      group=<ip>[:port]    UDP group for detections (multicast.hpp, default 239.255.12.10:1211)
+//                  node=0               node id in the datagrams
+//                  rdm=0                > 0 also sends the RDM max-pooled by that factor, as 8-bit tiles
+//                  rdm_every=1          ... every that many frames
+//                  ttl=1                hops (1 stays on the subnet), iface=<local ip> picks the interface
+//   rdm_stream     server=<ip>[:port]   compressed RDM to a remote viewer (rdm-stream.hpp, default 127.0.0.1:1212)
+//                  node=0               node id in the messages
+//                  threshold=0          level changes left out (lossy, noise compresses to nothing), 0-255
+//                  tiles=0              1 sends only the 32x32 tiles that changed
+//                  key_every=50         frames between keyframes
+//                  every=1              streams every that many frames
+//                  pending=2            messages waiting for the link before frames are skipped
+//   tracker        model=cv             EKF tracker on the detections (tracker.hpp), cv or ca
+//                  sigma_process=       process noise, m/s^2 (cv, default 0.25) or m/s^3 (ca, default 1)
+//                  sigma_range=0.035    measurement noise: m,
+//                  sigma_azimuth=10     ... deg,
+//                  sigma_range_rate=0.1 ... m/s
+//                  doppler_step=        m/s per Doppler bin, overrides the radar profile's (FrameGeometry)
+//                  gate=16.27           chi-square gate (3 degrees of freedom)
+//                  assoc=gnn            gnn (global nearest neighbour) or jpda (dense scenes)
+//                  pd=0.8               JPDA: detection probability,
+//                  clutter=0.0177       ... false detections per m x rad x m/s
+//                  confirm=3            updates in the last window frames that confirm a track (M of N)
+//                  window=5             ... N, at most 32
+//                  misses=10            frames a confirmed track coasts without an update
+//                  capacity=512         tracks held at most, tentative ones included
+//                  log=<file.csv>       appends the confirmed and coasting tracks of every frame
+//   recorder       path=frames.bin      binary frame log, see RecorderStage
+// The blocks are created for geometry g and owned by the pipeline. Returns false (with a
+// message on stderr) if the file cannot be read or describes an invalid graph.
+inline bool build_pipeline(const std::string& filename, const FrameGeometry& g, Pipeline& p)
+{
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        fprintf(stderr, "Error: Could not open pipeline config %s\n", filename.c_str());
+        return false;
+    }
+
+    struct StageSpec { std::string name, type; ExecPolicy exec; std::map<std::string, std::string> opts; RtThreadConfig rt, worker_rt; };
+    struct EdgeSpec { std::string from, to; EdgePolicy policy; int capacity; };
+    std::vector<StageSpec> stage_specs;
+    std::vector<EdgeSpec> edge_specs;
+
+    // cpu= / prio= style options into a thread profile
+    auto parse_rt = [&](std::map<std::string, std::string>& opts, const char* cpu_key, const char* prio_key,
+                        RtThreadConfig& rt, int line_no) {
+        if (opts.count(cpu_key) && !parse_cpu_list(opts[cpu_key], rt.cpus)) {
+            fprintf(stderr, "Error: %s:%d: bad cpu list '%s'\n", filename.c_str(), line_no, opts[cpu_key].c_str());
+            return false;
+        }
+        if (opts.count(prio_key)) {
+            rt.priority = atoi(opts[prio_key].c_str());
+            if (rt.priority < 1 || rt.priority > 99) {
+                fprintf(stderr, "Error: %s:%d: %s must be 1-99\n", filename.c_str(), line_no, prio_key);
+                return false;
+            }
+        }
+        return true;
+    };
+
+    std::string line;
+    int line_no = 0;
+    while (std::getline(file, line)) {
+        line_no++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos)
+            line.erase(hash);
+        std::istringstream in(line);
+        std::string directive;
+        if (!(in >> directive))
+            continue;
+
+        if (directive == "pool_threads") {
+            int n = 0;
+            std::string opt;
+            std::map<std::string, std::string> opts;
+            in >> n;
+            if (n > 0)
+                p.setPoolThreads(n);
+            while (in >> opt) {
+                size_t eq = opt.find('=');
+                if (eq != std::string::npos)
+                    opts[opt.substr(0, eq)] = opt.substr(eq + 1);
+            }
+            RtThreadConfig rt;
+            if (!parse_rt(opts, "cpu", "prio", rt, line_no))
+                return false;
+            p.setPoolRealtime(rt);
+        }
+        else if (directive == "mlockall") {
+            p.setMemoryLock(true);
+        }
+        else if (directive == "stage") {
+            StageSpec spec;
+            std::string exec, opt;
+            if (!(in >> spec.name >> spec.type >> exec) || !parse_exec_policy(exec, spec.exec)) {
+                fprintf(stderr, "Error: %s:%d: expected 'stage <name> <type> <thread|pool|inline>'\n", filename.c_str(), line_no);
+                return false;
+            }
+            while (in >> opt) {
+                size_t eq = opt.find('=');
+                if (eq != std::string::npos)
+                    spec.opts[opt.substr(0, eq)] = opt.substr(eq + 1);
+            }
+            if (!parse_rt(spec.opts, "cpu", "prio", spec.rt, line_no) ||
+                !parse_rt(spec.opts, "worker_cpus", "worker_prio", spec.worker_rt, line_no))
+                return false;
+            stage_specs.push_back(spec);
+        }
+        else if (directive == "edge") {
+            EdgeSpec spec;
+            std::string policy;
+            spec.capacity = 1;
+            if (!(in >> spec.from >> spec.to >> policy) || !parse_edge_policy(policy, spec.policy)) {
+                fprintf(stderr, "Error: %s:%d: expected 'edge <from> <to> <block|drop_oldest|drop_newest|latest> [capacity]'\n", filename.c_str(), line_no);
+                return false;
+            }
+            in >> spec.capacity;
+            edge_specs.push_back(spec);
+        }
+        else {
+            fprintf(stderr, "Error: %s:%d: unknown directive '%s'\n", filename.c_str(), line_no, directive.c_str());
+            return false;
+        }
+    }
+
+    // Size the DAQ frame pool for the whole graph so a slow consumer never stalls acquisition
+    int pool_frames = 1;
+    for (const EdgeSpec& e : edge_specs)
+        pool_frames += e.policy == EDGE_LATEST ? 1 : std::max(e.capacity, 1);
+    for (StageSpec& s : stage_specs) {
+        int workers = s.opts.count("workers") ? atoi(s.opts["workers"].c_str()) : 1;
+        pool_frames += (s.type == "range_doppler" && workers > 1) ? 2 * (workers + 1) + 1 : 2;
+        if (s.type == "visualizer" && s.opts.count("refresh") && atof(s.opts["refresh"].c_str()) > 0)
+            pool_frames += 1;       // the display mailbox
+    }
+
+    for (StageSpec& s : stage_specs) {
+        PipelineStage* stage;
+        if (s.type == "daq") {
+            stage = p.addBlock(s.name, new DataAcquisition(g, pool_frames), s.exec, true);
+        }
+        else if (s.type == "sim") {
+            SimConfig cfg;
+            if (s.opts.count("scene") && !load_sim_scene(s.opts["scene"], cfg))
+                return false;
+            int threads = s.opts.count("threads") ? atoi(s.opts["threads"].c_str()) : 1;
+            bool realtime = !s.opts.count("realtime") || atoi(s.opts["realtime"].c_str()) != 0;
+            stage = p.addBlock(s.name, new SimulatedAcquisition(g, cfg, threads, realtime, pool_frames), s.exec, true);
+        }
+        else if (s.type == "range_doppler") {
+            // RangeDoppler keeps the window name pointer, so pass a literal
+            const char* window = (s.opts.count("window") && s.opts["window"] == "hann") ? "hann" : "blackman";
+            int workers = s.opts.count("workers") ? atoi(s.opts["workers"].c_str()) : 1;
+            std::shared_ptr<ShmRingWriter> shm;
+            if (s.opts.count("shm")) {
+                int slots = s.opts.count("shm_slots") ? atoi(s.opts["shm_slots"].c_str()) : SHM_RING_SLOTS;
+                bool cube = s.opts.count("shm_cube") && atoi(s.opts["shm_cube"].c_str()) != 0;
+                shm = std::make_shared<ShmRingWriter>();
+                if (!shm->create(s.opts["shm"], slots, g.rd_bins(), cube ? g.size() : 0, MAX_DETECTIONS))
+                    return false;
+            }
+            if (workers > 1) {
+                ParallelRangeDopplerStage* rd = new ParallelRangeDopplerStage(s.name, window, g, workers, s.exec, s.worker_rt);
+                if (shm)
+                    rd->setShm(shm);
+                stage = p.addStage(rd);
+            }
+            else {
+                RangeDoppler* rd = new RangeDoppler(window, g);
+                if (shm)
+                    rd->setShm(shm);
+                stage = p.addBlock(s.name, rd, s.exec, true);
+            }
+        }
+        else if (s.type == "visualizer") {
+            Visualizer* vis = new Visualizer(g.rd_bins(), 0);
+            vis->setGeometry(g);
+            vis->setWaitTime(s.opts.count("wait") ? atoi(s.opts["wait"].c_str()) : 1);
+            double refresh = s.opts.count("refresh") ? atof(s.opts["refresh"].c_str()) : 0;
+            if (s.opts.count("view"))
+                vis->setView(s.opts["view"] == "angle" ? Visualizer::VIEW_ANGLE : Visualizer::VIEW_RDM);
+            vis->setHeadless(s.opts.count("headless") && atoi(s.opts["headless"].c_str()) != 0);
+            if (s.opts.count("stream")) {
+                std::string addr = "127.0.0.1", port = s.opts["stream"];
+                size_t colon = port.rfind(':');
+                if (colon != std::string::npos) {
+                    addr = port.substr(0, colon);
+                    port.erase(0, colon + 1);
+                }
+                if (!vis->streamTo(atoi(port.c_str()), addr)) {
+                    delete vis;
+                    return false;
+                }
+            }
+            if (s.opts.count("record"))
+                vis->recordTo(s.opts["record"], refresh > 0 ? refresh : 1000.0 / g.frame_period_ms);
+            if (refresh > 0)
+                vis->setRefreshRate(refresh);
+            stage = p.addBlock(s.name, vis, s.exec, true);
+        }
+        else if (s.type == "uplink") {
+            bool binary = s.opts.count("format") && s.opts["format"] == "binary";
+            int node_id = s.opts.count("node") ? atoi(s.opts["node"].c_str()) : 0;
+            std::string server = IP;
+            int port = SERVER_PORT;
+            if (s.opts.count("server")) {
+                server = s.opts["server"];
+                size_t colon = server.find(':');
+                if (colon != std::string::npos) {
+                    port = atoi(server.c_str() + colon + 1);
+                    server.erase(colon);
+                }
+            }
+            int queue = s.opts.count("queue") ? atoi(s.opts["queue"].c_str()) : UPLINK_QUEUE;
+            int batch = s.opts.count("batch") ? atoi(s.opts["batch"].c_str()) : UPLINK_MAX_BATCH;
+            int frames = s.opts.count("frames") ? atoi(s.opts["frames"].c_str()) : 8;
+            UplinkPolicy policy = UPLINK_DROP_OLDEST;
+            if (s.opts.count("policy") && !parse_uplink_policy(s.opts["policy"], policy)) {
+                fprintf(stderr, "Error: %s: unknown uplink policy '%s'\n", filename.c_str(), s.opts["policy"].c_str());
+                return false;
+            }
+            if (queue < 1 || batch < 1 || batch > UPLINK_MAX_BATCH || frames < 1 || frames > WIRE_MAX_FRAMES) {
+                fprintf(stderr, "Error: %s: uplink needs queue >= 1, batch in 1-%d and frames in 1-%d\n",
+                        filename.c_str(), UPLINK_MAX_BATCH, WIRE_MAX_FRAMES);
+                return false;
+            }
+            stage = p.addStage(new UplinkStage(s.name, s.exec, s.opts.count("log") ? s.opts["log"] : "", binary, node_id,
+                                               server, port, queue, policy, batch, frames));
+        }
+        else if (s.type == "multicast") {
+            std::string group = MCAST_GROUP;
+            int port = MCAST_PORT;
+            if (s.opts.count("group")) {
+                group = s.opts["group"];
+                size_t colon = group.find(':');
+                if (colon != std::string::npos) {
+                    port = atoi(group.c_str() + colon + 1);
+                    group.erase(colon);
+                }
+            }
+            int node_id = s.opts.count("node") ? atoi(s.opts["node"].c_str()) : 0;
+            int rdm = s.opts.count("rdm") ? atoi(s.opts["rdm"].c_str()) : 0;
+            int every = s.opts.count("rdm_every") ? atoi(s.opts["rdm_every"].c_str()) : 1;
+            int ttl = s.opts.count("ttl") ? atoi(s.opts["ttl"].c_str()) : 1;
+            if (rdm < 0 || rdm > 255 || (rdm > 0 && (g.fast_time / rdm < 1 || g.slow_time / rdm < 1))) {
+                fprintf(stderr, "Error: %s: rdm=%d does not fit the %dx%d map\n", filename.c_str(), rdm, g.fast_time, g.slow_time);
+                return false;
+            }
+            stage = p.addStage(new MulticastStage(s.name, s.exec, group, port, node_id, rdm, every, ttl,
+                                                  s.opts.count("iface") ? s.opts["iface"] : ""));
+        }
+        else if (s.type == "rdm_stream") {
+            std::string server = "127.0.0.1";
+            int port = RDMS_PORT;
+            if (s.opts.count("server")) {
+                server = s.opts["server"];
+                size_t colon = server.find(':');
+                if (colon != std::string::npos) {
+                    port = atoi(server.c_str() + colon + 1);
+                    server.erase(colon);
+                }
+            }
+            int node_id = s.opts.count("node") ? atoi(s.opts["node"].c_str()) : 0;
+            int threshold = s.opts.count("threshold") ? atoi(s.opts["threshold"].c_str()) : 0;
+            bool tiles = s.opts.count("tiles") && atoi(s.opts["tiles"].c_str()) != 0;
+            int key_every = s.opts.count("key_every") ? atoi(s.opts["key_every"].c_str()) : RDMS_KEY_EVERY;
+            int every = s.opts.count("every") ? atoi(s.opts["every"].c_str()) : 1;
+            int pending = s.opts.count("pending") ? atoi(s.opts["pending"].c_str()) : 2;
+            if (threshold < 0 || threshold > 255 || key_every < 1 || every < 1 || pending < 1) {
+                fprintf(stderr, "Error: %s: rdm_stream needs threshold in 0-255 and key_every, every, pending >= 1\n", filename.c_str());
+                return false;
+            }
+            stage = p.addStage(new RdmStreamStage(s.name, s.exec, server, port, node_id, tiles, threshold, key_every, every, pending));
+        }
+        else if (s.type == "tracker") {
+            TrackerConfig cfg;
+            if (s.opts.count("model") && !parse_motion_model(s.opts["model"], cfg.model)) {
+                fprintf(stderr, "Error: %s: unknown motion model '%s'\n", filename.c_str(), s.opts["model"].c_str());
+                return false;
+            }
+            if (cfg.model == MOTION_CA)
+                cfg.sigma_process = TRACK_SIGMA_JERK;
+            if (s.opts.count("assoc") && !parse_association_mode(s.opts["assoc"], cfg.association.mode)) {
+                fprintf(stderr, "Error: %s: unknown association '%s'\n", filename.c_str(), s.opts["assoc"].c_str());
+                return false;
+            }
+            auto opt = [&](const char* key, double& value) {
+                if (s.opts.count(key))
+                    value = atof(s.opts[key].c_str());
+            };
+            opt("sigma_process", cfg.sigma_process);
+            opt("sigma_range", cfg.sigma_range);
+            opt("sigma_azimuth", cfg.sigma_azimuth);
+            opt("sigma_range_rate", cfg.sigma_range_rate);
+            opt("doppler_step", cfg.doppler_step);
+            opt("gate", cfg.gate_chi2);
+            opt("pd", cfg.association.pd);
+            opt("clutter", cfg.association.clutter_density);
+            if (s.opts.count("confirm"))
+                cfg.confirm_hits = atoi(s.opts["confirm"].c_str());
+            if (s.opts.count("window"))
+                cfg.confirm_window = atoi(s.opts["window"].c_str());
+            if (s.opts.count("misses"))
+                cfg.max_misses = atoi(s.opts["misses"].c_str());
+            if (s.opts.count("capacity"))
+                cfg.capacity = atoi(s.opts["capacity"].c_str());
+            if (cfg.sigma_process <= 0 || cfg.sigma_range <= 0 || cfg.sigma_azimuth <= 0 || cfg.sigma_range_rate <= 0 ||
+                cfg.gate_chi2 <= 0 || cfg.confirm_hits < 1 || cfg.confirm_hits > cfg.confirm_window || cfg.confirm_window > 32 || cfg.max_misses < 0 || cfg.capacity < 1 ||
+                cfg.association.pd <= 0 || cfg.association.pd >= 1 || cfg.association.clutter_density <= 0) {
+                fprintf(stderr, "Error: %s: tracker needs positive noise levels, gate and clutter, pd in (0, 1), 1 <= confirm <= window <= 32, misses >= 0 and capacity >= 1\n", filename.c_str());
+                return false;
+            }
+            stage = p.addStage(new TrackerStage(s.name, s.exec, cfg, s.opts.count("log") ? s.opts["log"] : ""));
+        }
+        else if (s.type == "recorder") {
+            stage = p.addStage(new RecorderStage(s.name, s.opts.count("path") ? s.opts["path"] : "frames.bin", s.exec));
+        }
+        else {
+            fprintf(stderr, "Error: %s: unknown stage type '%s'\n", filename.c_str(), s.type.c_str());
+            return false;
+        }
+        stage->rt = s.rt;
+    }
+
+    for (const EdgeSpec& e : edge_specs)
+        if (!p.connect(e.from, e.to, e.policy, e.capacity))
+            return false;
+    return true;
+}
@@ -0,0 +1,898 @@
+#pragma once
+// Pipeline graph: RadarBlocks and sinks wired together by frame edges.
+//
+// Each stage has one input edge (none for sources) and any number of output edges, so the
+// range-doppler output can fan out to the display, the uplink and a recorder at once. Every
+// stage picks how it runs:
+//  - thread: its own thread, blocking on its input edge
+//  - pool:   scheduled on a shared worker pool whenever its input edge has frames
+//  - inline: run directly on the producer's thread after the producer has queued its other edges
+// Edges only hold FrameRefs, so fan-out never copies a frame. Only a "block" edge can hold up
+// its producer, with any other policy a slow consumer sees fewer frames (counted per edge) but
+// never throttles DAQ -> DSP.
+//
+// The graph can be built in code (addBlock/addStage + connect) or from a config file, see
+// pipeline-config.hpp and test/Pipeline/pipeline.cfg.
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum ExecPolicy { EXEC_THREAD, EXEC_POOL, EXEC_INLINE };
+enum EdgePolicy { EDGE_BLOCK, EDGE_DROP_OLDEST, EDGE_DROP_NEWEST, EDGE_LATEST };
+
+#define DEFAULT_POOL_THREADS 2
+
+inline bool parse_exec_policy(const std::string& s, ExecPolicy& e)
+{
+    if (s == "thread")      e = EXEC_THREAD;
+    else if (s == "pool")   e = EXEC_POOL;
+    else if (s == "inline") e = EXEC_INLINE;
+    else return false;
+    return true;
+}
+
+inline bool parse_edge_policy(const std::string& s, EdgePolicy& e)
+{
+    if (s == "block")            e = EDGE_BLOCK;
+    else if (s == "drop_oldest") e = EDGE_DROP_OLDEST;
+    else if (s == "drop_newest") e = EDGE_DROP_NEWEST;
+    else if (s == "latest")      e = EDGE_LATEST;
+    else return false;
+    return true;
+}
+
+inline const char* edge_policy_name(EdgePolicy e)
+{
+    switch (e) {
+        case EDGE_BLOCK:       return "block";
+        case EDGE_DROP_OLDEST: return "drop_oldest";
+        case EDGE_DROP_NEWEST: return "drop_newest";
+        default:               return "latest";
+    }
+}
+
+class PipelineStage;
+
+// Bounded frame queue between two stages. What push() does when the queue is full:
+//  - EDGE_BLOCK:       waits for the consumer (lossless, for the critical path)
+//  - EDGE_DROP_OLDEST: drops the oldest queued frame, the consumer catches up on recent history
+//  - EDGE_DROP_NEWEST: drops the incoming frame, the queued ones are kept in order
+//  - EDGE_LATEST:      mailbox of one, the consumer always gets the newest frame
+class FrameEdge
+{
+    std::deque<FrameRef> q;
+    size_t capacity;
+    EdgePolicy policy;
+    bool closed;
+    std::mutex m;
+    std::condition_variable not_empty, not_full;
+    std::atomic<uint64_t> pushed;       // frames offered by the producer
+    std::atomic<uint64_t> dropped;      // ... of which never reached the consumer
+    std::atomic<uint64_t> blocked;      // pushes that had to wait (EDGE_BLOCK)
+
+    public:
+        PipelineStage* from;
+        PipelineStage* to;
+
+        FrameEdge(PipelineStage* src, PipelineStage* dst, EdgePolicy p, int cap)
+            : capacity(p == EDGE_LATEST || cap < 1 ? 1 : cap), policy(p), closed(false),
+              pushed(0), dropped(0), blocked(0), from(src), to(dst)
+        {
+        }
+
+        // Returns false if the frame was not queued (dropped or edge closed)
+        bool push(FrameRef f)
+        {
+            FrameRef evicted;                           // released outside the lock
+            pushed.fetch_add(1, std::memory_order_relaxed);
+            {
+                std::unique_lock<std::mutex> lock(m);
+                if (policy == EDGE_BLOCK && !closed && q.size() >= capacity) {
+                    blocked.fetch_add(1, std::memory_order_relaxed);
+                    not_full.wait(lock, [this] { return closed || q.size() < capacity; });
+                }
+                if (closed)
+                    return false;
+                if (q.size() >= capacity) {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    if (policy == EDGE_DROP_NEWEST)
+                        return false;
+                    evicted = std::move(q.front());
+                    q.pop_front();
+                }
+                q.push_back(std::move(f));
+            }
+            not_empty.notify_one();
+            return true;
+        }
+
+        // Waits for a frame. Returns false once the edge is closed.
+        bool pop(FrameRef& f)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m);
+                not_empty.wait(lock, [this] { return closed || !q.empty(); });
+                if (q.empty())
+                    return false;
+                f = std::move(q.front());
+                q.pop_front();
+            }
+            not_full.notify_one();
+            return true;
+        }
+
+        bool try_pop(FrameRef& f)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m);
+                if (q.empty())
+                    return false;
+                f = std::move(q.front());
+                q.pop_front();
+            }
+            not_full.notify_one();
+            return true;
+        }
+
+        // Wakes everyone and drops the queued frames so they go back to their pool
+        void close()
+        {
+            std::deque<FrameRef> drained;
+            {
+                std::lock_guard<std::mutex> lock(m);
+                closed = true;
+                drained.swap(q);
+            }
+            not_empty.notify_all();
+            not_full.notify_all();
+        }
+
+        int size()
+        {
+            std::lock_guard<std::mutex> lock(m);
+            return q.size();
+        }
+
+        int getCapacity() const { return capacity; }
+        EdgePolicy getPolicy() const { return policy; }
+        uint64_t getPushed() const { return pushed.load(); }
+        uint64_t getDropped() const { return dropped.load(); }
+        uint64_t getBlocked() const { return blocked.load(); }
+};
+
+// One node of the graph
+class PipelineStage
+{
+    public:
+        std::string name;
+        const char* trace_name;             // interned copy of name, outlives the stage
+        ExecPolicy exec;
+        FrameEdge* input;
+        std::vector<FrameEdge*> outputs;
+        std::atomic<bool> scheduled;        // pool stages: queued on or running in the pool
+        std::atomic<uint64_t> frames;       // frames handled
+        RtThreadConfig rt;                  // pinning/priority of the stage's own thread (EXEC_THREAD)
+        // Set by the pipeline: sends a frame to the stage's consumers. For stages that produce
+        // output asynchronously instead of returning it from run().
+        std::function<void(const FrameRef&)> deliver;
+
+        PipelineStage(const std::string& n, ExecPolicy e) : name(n), trace_name(Tracer::instance().intern(n)), exec(e), input(NULL), scheduled(false), frames(0) {}
+        virtual ~PipelineStage() {}
+
+        // Called on the thread that starts the pipeline, before any frame
+        virtual void start() {}
+        // Touches the stage's buffers before the first frame, see realtime.hpp
+        virtual void prefault() {}
+        // Cores the stage's threads are pinned to
+        virtual void realtimeCpus(std::vector<int>& cpus)
+        {
+            cpus.insert(cpus.end(), rt.cpus.begin(), rt.cpus.end());
+        }
+        // Called once the stage's thread has stopped
+        virtual void finish() {}
+        // Handles one input frame (empty for sources). Returns the frame to send downstream,
+        // or an empty FrameRef if there is nothing new.
+        virtual FrameRef run(FrameRef in) = 0;
+};
+
+// Drives a RadarBlock through processFrame() and forwards what it publishes
+class BlockStage : public PipelineStage
+{
+    RadarBlock* block;
+    std::unique_ptr<RadarBlock> owned;
+    uint32_t last_id;
+
+    public:
+        BlockStage(const std::string& n, RadarBlock* b, ExecPolicy e, bool take_ownership = false)
+            : PipelineStage(n, e), block(b), owned(take_ownership ? b : NULL), last_id(0)
+        {
+        }
+
+        FrameRef run(FrameRef in) override
+        {
+            block->processFrame(std::move(in));
+            FrameRef out = block->getOutputFrame();
+            if (!out || out->id == last_id)
+                return FrameRef();
+            last_id = out->id;
+            return out;
+        }
+
+        void prefault() override
+        {
+            block->prefault();
+        }
+
+        RadarBlock* getBlock() { return block; }
+};
+
+// Terminal stage around a callback
+class SinkStage : public PipelineStage
+{
+    std::function<void(const RadarFrame&)> fn;
+
+    public:
+        SinkStage(const std::string& n, std::function<void(const RadarFrame&)> f, ExecPolicy e)
+            : PipelineStage(n, e), fn(f)
+        {
+        }
+
+        FrameRef run(FrameRef in) override
+        {
+            if (in)
+                fn(*in);
+            return FrameRef();
+        }
+};
+
+// Sends every frame to the multi-node server through JSON_TCP: the strongest detection as JSON,
+// or (binary) the whole detection list in the detection-wire.hpp format. run() only serialises and
+// queues, the socket is JSON_TCP's uplink thread; stats go out with finish().
+class UplinkStage : public PipelineStage
+{
+    JSON_TCP client;
+    std::string log_dir, server;
+    int port;
+    bool binary;
+    int max_frames;
+    WireEncoder encoder;
+    WireDetection dets[MAX_DETECTIONS];
+    std::chrono::high_resolution_clock::time_point t0;
+
+    void flush()
+    {
+        if (encoder.pending() == 0)
+            return;
+        size_t len;
+        const uint8_t* msg = encoder.finish(len);
+        client.send_raw(msg, len);
+        encoder.begin();
+    }
+
+    public:
+        // A non-empty log_dir also keeps every frame's JSON there (written asynchronously). queue,
+        // policy and batch size the uplink queue (async-uplink.hpp), frames caps the frames folded
+        // into one binary message while the link is backed up.
+        UplinkStage(const std::string& n, ExecPolicy e, const std::string& log = "", bool bin = false, uint16_t node_id = 0,
+                    const std::string& host = IP, int server_port = SERVER_PORT,
+                    int queue = UPLINK_QUEUE, UplinkPolicy policy = UPLINK_DROP_OLDEST, int batch = UPLINK_MAX_BATCH, int frames = 8)
+            : PipelineStage(n, e), client(queue, policy, batch), log_dir(log), server(host), port(server_port), binary(bin),
+              max_frames(std::max(1, std::min(frames, WIRE_MAX_FRAMES))), encoder(node_id) {}
+
+        void start() override
+        {
+            if (!log_dir.empty())
+                client.setLogDir(log_dir);
+            client.socket_setup(server, port);
+            t0 = std::chrono::high_resolution_clock::now();
+        }
+
+        void finish() override
+        {
+            if (binary)
+                flush();
+            client.end_stream(!binary);
+        }
+
+        FrameRef run(FrameRef in) override
+        {
+            if (!in)
+                return FrameRef();
+            if (!binary) {
+                if (in->num_detections > 0)
+                    client.process(in->detections[0].azimuth, in->detections[0].range, t0);
+                return FrameRef();
+            }
+
+            // Frames without detections are sent too, they tell the fusion side the node is alive.
+            // While the link keeps up every frame is a message of its own. Once messages wait in
+            // the uplink queue, frames are folded into one message (up to max_frames) until the
+            // queue has drained: fewer, larger messages, and fewer for the queue policy to drop.
+            for (int i = 0; i < in->num_detections; i++)
+                dets[i] = to_wire(in->detections[i]);
+            int64_t latency_ns = in->t_processed_ns - in->t_acquired_ns;
+            uint32_t latency_us = latency_ns > 0 ? latency_ns / 1000 : 0;
+            if (!encoder.add_frame(in->id, in->t_wall_ns, latency_us, in->geom.doppler_step(), dets, in->num_detections)) {
+                flush();
+                encoder.add_frame(in->id, in->t_wall_ns, latency_us, in->geom.doppler_step(), dets, in->num_detections);
+            }
+            if (encoder.pending() >= max_frames || client.pending() == 0)
+                flush();
+            return FrameRef();
+        }
+};
+
+// Multicasts every frame's detections, and with rdm_decimation > 0 the decimated RDM every
+// rdm_every frames, to a UDP group (multicast.hpp). One sendmmsg per frame whatever the number of
+// listeners; datagrams the socket cannot take are dropped, never waited for.
+class MulticastStage : public PipelineStage
+{
+    MulticastPublisher pub;
+    std::string group, iface;
+    int port, ttl;
+    int decimation, every;
+    WireEncoder encoder;
+    uint16_t node_id;
+    uint32_t tile_seq;
+    WireDetection dets[MAX_DETECTIONS];
+    std::vector<uint8_t> levels;
+
+    void add_detections(const RadarFrame& f)
+    {
+        int64_t latency_ns = f.t_processed_ns - f.t_acquired_ns;
+        uint32_t latency_us = latency_ns > 0 ? latency_ns / 1000 : 0;
+        for (int i = 0; i < f.num_detections; i++)
+            dets[i] = to_wire(f.detections[i]);
+        // Frames without detections go out too (one empty record): listeners see the node is alive
+        int per = MCAST_DETECTIONS_PER_DATAGRAM, first = 0;
+        do {
+            std::vector<uint8_t>* d = pub.add();
+            int n = std::min(per, f.num_detections - first);
+            encoder.begin();
+            encoder.add_frame(f.id, f.t_wall_ns, latency_us, f.geom.doppler_step(), dets + first, n, first + n < f.num_detections ? WIRE_FRAME_MORE : 0);
+            size_t len;
+            const uint8_t* msg = encoder.finish(len);
+            d->assign(msg, msg + len);
+            first += n;
+        } while (first < f.num_detections);
+    }
+
+    void add_tiles(const RadarFrame& f)
+    {
+        int range_bins, doppler_bins;
+        decimate_rdm(f.rdm, f.geom.fast_time, f.geom.slow_time, decimation, levels, range_bins, doppler_bins);
+        int tiles_r = (range_bins + MCAST_TILE - 1) / MCAST_TILE, tiles_d = (doppler_bins + MCAST_TILE - 1) / MCAST_TILE;
+        RdmTileHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, RDM_TILE_MAGIC, 4);
+        h.version = RDM_TILE_VERSION;
+        h.node_id = node_id;
+        h.frame = f.id;
+        h.t_wall_ns = f.t_wall_ns;
+        h.range_bins = range_bins;
+        h.doppler_bins = doppler_bins;
+        h.decimation = decimation;
+        h.tiles = tiles_r * tiles_d;
+        for (int td = 0; td < tiles_d; td++) {
+            for (int tr = 0; tr < tiles_r; tr++) {
+                std::vector<uint8_t>* d = pub.add();
+                h.seq = tile_seq++;
+                h.range0 = tr * MCAST_TILE;
+                h.doppler0 = td * MCAST_TILE;
+                h.tile_range = std::min(MCAST_TILE, range_bins - h.range0);
+                h.tile_doppler = std::min(MCAST_TILE, doppler_bins - h.doppler0);
+                d->resize(sizeof(h) + h.tile_range * h.tile_doppler);
+                memcpy(d->data(), &h, sizeof(h));
+                uint8_t* out = d->data() + sizeof(h);
+                for (int v = 0; v < h.tile_doppler; v++, out += h.tile_range)
+                    memcpy(out, &levels[(size_t) (h.doppler0 + v) * range_bins + h.range0], h.tile_range);
+            }
+        }
+    }
+
+    public:
+        MulticastStage(const std::string& n, ExecPolicy e, const std::string& addr = MCAST_GROUP, int p = MCAST_PORT,
+                       uint16_t node = 0, int rdm_decimation = 0, int rdm_every = 1, int t = 1, const std::string& interface = "")
+            : PipelineStage(n, e), group(addr), iface(interface), port(p), ttl(t), decimation(rdm_decimation),
+              every(std::max(1, rdm_every)), encoder(node), node_id(node), tile_seq(0) {}
+
+        void start() override
+        {
+            if (!pub.open(group, port, ttl, iface))
+                fprintf(stderr, "Error: multicast stage %s disabled\n", name.c_str());
+        }
+
+        void finish() override
+        {
+            printf("%s: %llu datagrams multicast, %llu dropped\n", name.c_str(),
+                   (unsigned long long) pub.getSent(), (unsigned long long) pub.getDropped());
+        }
+
+        FrameRef run(FrameRef in) override
+        {
+            if (!in)
+                return FrameRef();
+            pub.begin();
+            add_detections(*in);
+            if (decimation > 0 && in->id % every == 0)
+                add_tiles(*in);
+            pub.flush();
+            return FrameRef();
+        }
+};
+
+// Streams the range-Doppler map to a remote viewer (tools/rdm-viewer) over TCP, quantised,
+// delta coded and compressed (rdm-stream.hpp). The encoding runs on this stage's executor, off the
+// DSP thread, and the socket on the uplink's. A slow link skips frames here instead of queueing
+// them: a frame is only encoded while fewer than max_pending messages wait. A message the uplink
+// drops (full queue, broken connection) makes the next one a keyframe.
+class RdmStreamStage : public PipelineStage
+{
+    AsyncUplink uplink;
+    RdmStreamEncoder encoder;
+    std::string server;
+    int port, every, max_pending;
+    uint64_t seen_dropped;
+    uint64_t encoded, skipped, keyframes, bytes, float_bytes;
+    LatencyHistogram encode_time;
+    int64_t t_first_ns, t_last_ns;
+
+    public:
+        RdmStreamStage(const std::string& n, ExecPolicy e, const std::string& host, int server_port = RDMS_PORT,
+                       uint16_t node = 0, bool tiles = false, int threshold = 0, int key_every = RDMS_KEY_EVERY,
+                       int frame_every = 1, int pending = 2)
+            : PipelineStage(n, e), uplink(std::max(1, pending), UPLINK_DROP_OLDEST, 1),
+              encoder(node, tiles, threshold, key_every), server(host), port(server_port),
+              every(std::max(1, frame_every)), max_pending(std::max(1, pending)), seen_dropped(0),
+              encoded(0), skipped(0), keyframes(0), bytes(0), float_bytes(0), t_first_ns(0), t_last_ns(0) {}
+
+        void start() override
+        {
+            uplink.start(server, port);
+        }
+
+        // Bandwidth and latency report
+        void finish() override
+        {
+            uplink.stop();
+            double s = (t_last_ns - t_first_ns) * 1e-9;
+            printf("%s: %llu maps encoded (%llu keyframes), %llu skipped for the link | %.1f KB/map, %.1f kbit/s, "
+                   "%.1fx smaller than float | encode p50 %.3f ms p99 %.3f ms max %.3f ms\n",
+                   name.c_str(), (unsigned long long) encoded, (unsigned long long) keyframes, (unsigned long long) skipped,
+                   encoded ? bytes / 1024.0 / encoded : 0.0, s > 0 ? bytes * 8 / 1000.0 / s : 0.0, bytes ? (double) float_bytes / bytes : 0.0,
+                   encode_time.percentile(0.5) / 1e6, encode_time.percentile(0.99) / 1e6, encode_time.max() / 1e6);
+        }
+
+        FrameRef run(FrameRef in) override
+        {
+            if (!in || in->id % every != 0)
+                return FrameRef();
+            if (uplink.pending() >= max_pending) {
+                skipped++;
+                return FrameRef();
+            }
+            uint64_t dropped = uplink.getDropped();
+            if (dropped != seen_dropped) {
+                seen_dropped = dropped;
+                encoder.forceKey();
+            }
+
+            int64_t t0 = monotonic_ns();
+            size_t len;
+            const uint8_t* msg = encoder.encode(in->rdm, in->geom.fast_time, in->geom.slow_time, in->id,
+                                                in->t_wall_ns, in->t_acquired_ns, len);
+            int64_t t1 = monotonic_ns();
+            encode_time.add(t1 - t0);
+            const RdmStreamHeader* h = reinterpret_cast<const RdmStreamHeader*>(msg);
+            keyframes += (h->flags & RDMS_KEY) != 0;
+            if (!uplink.send(msg, len))
+                encoder.forceKey();
+            if (encoded++ == 0)
+                t_first_ns = t1;
+            t_last_ns = t1;
+            bytes += len;
+            float_bytes += (uint64_t) in->geom.rd_bins() * sizeof(float);
+            return FrameRef();
+        }
+};
+
+// Tracks the targets in every frame's detections (tracker.hpp) and forwards the frame with its
+// confirmed and coasting tracks in RadarFrame::tracks. Feed it through a block edge: the
+// prediction follows the frame timestamps across a gap, but M-of-N confirmation and coasting count
+// the frames the tracker sees, so frames dropped in front are counted and reported. Without a doppler_step override the Doppler
+// bins are converted with the profile each frame carries (FrameGeometry::doppler_step), so a
+// profile change is followed. log= appends the tracks to a CSV file.
+class TrackerStage : public PipelineStage
+{
+    std::unique_ptr<Tracker> tracker;
+    bool follow_profile;
+    std::string log_path;
+    FILE* log;
+    LatencyHistogram timing;
+    int max_tracks, max_cluster, capacity;
+    long births_dropped;
+    uint32_t last_id;
+    long frames_missed, frames_copied;
+    std::map<FrameGeometry, std::unique_ptr<FramePool>> pools;     // copies of shared frames, per geometry
+
+    // The frame to put the tracks in. Other stages fed by the same producer may still be reading
+    // a shared frame, so the tracks go into a copy from the stage's own pool: metadata, detections,
+    // angle map and RDM, not the raw ADC cube. A frame only this stage holds is written in place.
+    FrameRef writable(FrameRef in)
+    {
+        if (in->refs.load(std::memory_order_acquire) == 1)
+            return in;
+        std::unique_ptr<FramePool>& pool = pools[in->geom];
+        if (!pool)
+            pool.reset(new FramePool(in->geom));
+        FrameRef out = pool->acquire();
+        out->id = in->id;
+        out->t_acquired_ns = in->t_acquired_ns;
+        out->t_wall_ns = in->t_wall_ns;
+        out->t_processed_ns = in->t_processed_ns;
+        memcpy(out->rdm, in->rdm, in->geom.rd_bins() * sizeof(float));
+        memcpy(out->angle_map, in->angle_map, sizeof(in->angle_map));
+        memcpy(out->detections, in->detections, in->num_detections * sizeof(Detection));
+        out->num_detections = in->num_detections;
+        frames_copied++;
+        return out;
+    }
+
+    public:
+        TrackerStage(const std::string& n, ExecPolicy e, const TrackerConfig& cfg, const std::string& log_file = "")
+            : PipelineStage(n, e), tracker(make_tracker(cfg)), follow_profile(cfg.doppler_step == 0), log_path(log_file), log(NULL),
+              max_tracks(0), max_cluster(0), capacity(cfg.capacity), births_dropped(0), last_id(0), frames_missed(0), frames_copied(0) {}
+
+        ~TrackerStage()
+        {
+            if (log)
+                fclose(log);
+        }
+
+        void start() override
+        {
+            if (log_path.empty())
+                return;
+            log = fopen(log_path.c_str(), "w");
+            if (log == NULL) {
+                perror("[ERROR] opening the track log\n");
+                return;
+            }
+            fprintf(log, "frame,t_wall_ns,track,x,y,vx,vy,range,azimuth,range_rate,hits,misses\n");
+        }
+
+        void finish() override
+        {
+            if (log)
+                fflush(log);
+            printf("%s: %d tracks held at most, association clusters up to %d | per frame p50 %.3f ms p99 %.3f ms max %.3f ms\n",
+                   name.c_str(), max_tracks, max_cluster, timing.percentile(0.5) / 1e6, timing.percentile(0.99) / 1e6, timing.max() / 1e6);
+            if (births_dropped > 0)
+                printf("%s: track store full (%d), %ld detections could not start a track\n", name.c_str(), capacity, births_dropped);
+            if (frames_missed > 0)
+                printf("%s: %ld frames never reached the tracker, M-of-N counted only the frames it saw (feed it through a block edge)\n",
+                       name.c_str(), frames_missed);
+            if (frames_copied > 0)
+                printf("%s: %ld shared frames copied to add the tracks\n", name.c_str(), frames_copied);
+        }
+
+        FrameRef run(FrameRef in) override
+        {
+            if (!in)
+                return FrameRef();
+            int64_t t0 = monotonic_ns();
+            if (last_id != 0 && in->id > last_id + 1)
+                frames_missed += in->id - last_id - 1;
+            last_id = in->id;
+            if (follow_profile && in->geom.doppler_step() != tracker->getDopplerStep()) {
+                tracker->setDopplerStep(in->geom.doppler_step());
+                printf("%s: %.3f m/s per Doppler bin\n", name.c_str(), tracker->getDopplerStep());
+            }
+            tracker->process(in->detections, in->num_detections, in->t_acquired_ns);
+            in = writable(std::move(in));
+            in->num_tracks = tracker->report(in->tracks, MAX_TRACKS);
+            timing.add(monotonic_ns() - t0);
+            max_tracks = std::max(max_tracks, tracker->size());
+            const AssociationStats& a = tracker->associationStats();
+            max_cluster = std::max(max_cluster, a.largest_tracks + a.largest_detections);
+            births_dropped += a.births_dropped;
+            if (log) {
+                for (int i = 0; i < in->num_tracks; i++) {
+                    const TrackEstimate& t = in->tracks[i];
+                    fprintf(log, "%u,%lld,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.2f,%.3f,%d,%d\n", in->id, (long long) in->t_wall_ns, t.id,
+                            t.x, t.y, t.vx, t.vy, t.range, t.azimuth, t.range_rate, t.hits, t.misses);
+                }
+            }
+            return in;
+        }
+};
+
+// Appends every frame to a binary file:
+// [uint32 id][int64 t_wall_ns][int32 fast, slow, rx, tx][int32 n][n x Detection][fast*slow x float rdm]
+class RecorderStage : public PipelineStage
+{
+    std::string path;
+    FILE* fp;
+
+    public:
+        RecorderStage(const std::string& n, const std::string& p, ExecPolicy e) : PipelineStage(n, e), path(p), fp(NULL) {}
+
+        ~RecorderStage()
+        {
+            if (fp)
+                fclose(fp);
+        }
+
+        void start() override
+        {
+            fp = fopen(path.c_str(), "wb");
+            if (fp == NULL) {
+                perror("[ERROR] opening the frame recording\n");
+                fprintf(stderr, "Error: recorder stage %s disabled\n", name.c_str());
+            }
+        }
+
+        void finish() override
+        {
+            if (fp)
+                fflush(fp);
+        }
+
+        FrameRef run(FrameRef in) override
+        {
+            if (!in || fp == NULL)
+                return FrameRef();
+            const RadarFrame& f = *in;
+            int32_t shape[4] = {f.geom.fast_time, f.geom.slow_time, f.geom.rx, f.geom.tx};
+            int32_t n = f.num_detections;
+            fwrite(&f.id, sizeof(f.id), 1, fp);
+            fwrite(&f.t_wall_ns, sizeof(f.t_wall_ns), 1, fp);
+            fwrite(shape, sizeof(shape), 1, fp);
+            fwrite(&n, sizeof(n), 1, fp);
+            fwrite(f.detections, sizeof(Detection), n, fp);
+            fwrite(f.rdm, sizeof(float), f.geom.rd_bins(), fp);
+            return FrameRef();
+        }
+};
+
+class Pipeline
+{
+    std::vector<std::unique_ptr<PipelineStage>> stages;
+    std::vector<std::unique_ptr<FrameEdge>> edges;
+    std::vector<std::thread> threads;
+    int pool_threads;
+    RtThreadConfig pool_rt;
+    bool lock_mem;
+    std::atomic<bool> running;
+
+    // Shared pool: stages with pending frames
+    std::deque<PipelineStage*> ready;
+    std::mutex pool_m;
+    std::condition_variable pool_cv;
+
+    public:
+        Pipeline(int pool_size = DEFAULT_POOL_THREADS) : pool_threads(pool_size), lock_mem(false), running(false) {}
+
+        ~Pipeline()
+        {
+            stop();
+            // Consumers first: their frames point back into the source's pools
+            while (!stages.empty())
+                stages.pop_back();
+        }
+
+        // Takes ownership of the stage
+        PipelineStage* addStage(PipelineStage* s)
+        {
+            stages.emplace_back(s);
+            return s;
+        }
+
+        PipelineStage* addBlock(const std::string& name, RadarBlock* block, ExecPolicy e, bool take_ownership = false)
+        {
+            return addStage(new BlockStage(name, block, e, take_ownership));
+        }
+
+        PipelineStage* find(const std::string& name)
+        {
+            for (auto& s : stages)
+                if (s->name == name)
+                    return s.get();
+            return NULL;
+        }
+
+        // Connects two stages. A stage has exactly one input. capacity is ignored for EDGE_LATEST.
+        bool connect(const std::string& from, const std::string& to, EdgePolicy policy = EDGE_LATEST, int capacity = 1)
+        {
+            PipelineStage* src = find(from);
+            PipelineStage* dst = find(to);
+            if (src == NULL || dst == NULL) {
+                fprintf(stderr, "Error: Unknown stage in edge %s -> %s\n", from.c_str(), to.c_str());
+                return false;
+            }
+            if (dst->input != NULL) {
+                fprintf(stderr, "Error: Stage %s already has an input\n", to.c_str());
+                return false;
+            }
+            edges.emplace_back(new FrameEdge(src, dst, policy, capacity));
+            src->outputs.push_back(edges.back().get());
+            dst->input = edges.back().get();
+            return true;
+        }
+
+        void setPoolThreads(int n) { pool_threads = n; }
+        void setPoolRealtime(const RtThreadConfig& cfg) { pool_rt = cfg; }
+        // mlockall() at start(), after every buffer has been allocated
+        void setMemoryLock(bool on) { lock_mem = on; }
+
+        // Most frames the graph can hold at the same time: everything queued on the edges, one
+        // frame per stage being processed and one published output per stage. A frame pool at
+        // least this big never makes the source wait on a slow consumer.
+        int framesInFlight()
+        {
+            int n = 1;
+            for (auto& e : edges)
+                n += e->getCapacity();
+            return n + 2 * stages.size();
+        }
+
+        bool start()
+        {
+            for (auto& s : stages) {
+                if (s->input == NULL && s->exec != EXEC_THREAD) {
+                    fprintf(stderr, "Error: Source stage %s needs its own thread\n", s->name.c_str());
+                    return false;
+                }
+            }
+
+            // Real-time profile: check the kernel setup, then lock and touch memory before any
+            // thread starts working on frames
+            std::vector<int> cpus(pool_rt.cpus);
+            for (auto& s : stages)
+                s->realtimeCpus(cpus);
+            check_rt_environment(cpus);
+            if (lock_mem)
+                lock_memory();
+            for (auto& s : stages)
+                s->prefault();
+
+            running = true;
+            for (auto& s : stages) {
+                PipelineStage* st = s.get();
+                st->deliver = [this, st](const FrameRef& f) { emit(st, f); };
+                st->start();
+            }
+            bool use_pool = false;
+            for (auto& s : stages) {
+                if (s->exec == EXEC_THREAD)
+                    threads.emplace_back(&Pipeline::stage_loop, this, s.get());
+                use_pool |= (s->exec == EXEC_POOL);
+            }
+            for (int i = 0; use_pool && i < pool_threads; i++)
+                threads.emplace_back(&Pipeline::pool_loop, this);
+            return true;
+        }
+
+        // Closes every edge and joins the stage threads. A source blocked in recvfrom() only
+        // returns with its next packet.
+        void stop()
+        {
+            if (!running.exchange(false))
+                return;
+            for (auto& e : edges)
+                e->close();
+            pool_cv.notify_all();
+            for (auto& t : threads)
+                t.join();
+            threads.clear();
+            for (auto& s : stages)
+                s->finish();
+        }
+
+        void printStats()
+        {
+            for (auto& s : stages) {
+                printf("%-12s %8llu frames", s->name.c_str(), (unsigned long long) s->frames.load());
+                FrameEdge* e = s->input;
+                if (e && s->exec == EXEC_INLINE)
+                    printf(" | inline");
+                else if (e) {
+                    printf(" | %-11s queued %d/%d | dropped %llu of %llu", edge_policy_name(e->getPolicy()),
+                           e->size(), e->getCapacity(), (unsigned long long) e->getDropped(), (unsigned long long) e->getPushed());
+                    if (e->getPolicy() == EDGE_BLOCK)
+                        printf(" | producer blocked %llu times", (unsigned long long) e->getBlocked());
+                }
+                printf("\n");
+            }
+            Tracer::instance().print_summary();
+        }
+
+    private:
+        // Hands a stage's output to its consumers. Queued edges first, so the consumers on
+        // other threads are not delayed by inline ones.
+        void emit(PipelineStage* s, const FrameRef& out)
+        {
+            for (FrameEdge* e : s->outputs) {
+                if (e->to->exec == EXEC_INLINE)
+                    continue;
+                e->push(out);
+                if (e->to->exec == EXEC_POOL)
+                    schedule(e->to);
+            }
+            for (FrameEdge* e : s->outputs) {
+                if (e->to->exec == EXEC_INLINE)
+                    step(e->to, out);
+            }
+        }
+
+        void step(PipelineStage* s, FrameRef in)
+        {
+            if (in)
+                trace_set_frame(in->id);
+            FrameRef out;
+            {
+                TraceScope scope(s->trace_name);
+                out = s->run(std::move(in));
+            }
+            s->frames++;
+            if (out)
+                emit(s, out);
+        }
+
+        void stage_loop(PipelineStage* s)
+        {
+            Tracer::instance().name_thread(s->name);
+            if (s->rt.enabled())
+                apply_thread_rt(s->rt, s->trace_name);
+            while (running) {
+                FrameRef in;
+                if (s->input && !s->input->pop(in))
+                    break;
+                step(s, std::move(in));
+            }
+        }
+
+        void schedule(PipelineStage* s)
+        {
+            if (s->scheduled.exchange(true))
+                return;                             // already queued or running
+            {
+                std::lock_guard<std::mutex> lock(pool_m);
+                ready.push_back(s);
+            }
+            pool_cv.notify_one();
+        }
+
+        // A pool stage runs on one worker at a time (blocks are not reentrant) and drains its
+        // input before giving the worker back
+        void pool_loop()
+        {
+            Tracer::instance().name_thread("pool");
+            if (pool_rt.enabled())
+                apply_thread_rt(pool_rt, "pool");
+            for (;;) {
+                PipelineStage* s;
+                {
+                    std::unique_lock<std::mutex> lock(pool_m);
+                    pool_cv.wait(lock, [this] { return !running || !ready.empty(); });
+                    if (!running)
+                        return;
+                    s = ready.front();
+                    ready.pop_front();
+                }
+                FrameRef in;
+                while (running && s->input->try_pop(in))
+                    step(s, std::move(in));
+                s->scheduled = false;
+                if (running && s->input->size() > 0)
+                    schedule(s);                    // a frame arrived after the last try_pop
+            }
+        }
+};
@@ -10,6 +10,7 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h> // read(), write(), close()
+#include <poll.h>
 #include <opencv2/opencv.hpp>
 #include <iostream>
 #include <thread>
@@ -40,4 +41,25 @@
 #include <thread>
 #include <vector>
 
+#include "radar-config.hpp"
+#include "frame-signal.hpp"
+#include "trace.hpp"
+#include "realtime.hpp"
+#include "radar-frame.hpp"
+#include "vis-stream.hpp"
+#include "detection-log.hpp"
+#include "async-writer.hpp"
+#include "detection-wire.hpp"
+#include "async-uplink.hpp"
+#include "multicast.hpp"
+#include "shm-ring.hpp"
+#include "rdm-stream.hpp"
+#include "association.hpp"
+#include "track-manager.hpp"
+#include "tracker.hpp"
 #include "implementation.cpp"
+#include "work-stealing.hpp"
+#include "fmcw-sim.hpp"
+#include "pipeline.hpp"
+#include "parallel-dsp.hpp"
+#include "pipeline-config.hpp"
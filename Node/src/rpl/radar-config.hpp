@@ -0,0 +1,179 @@
+#pragma once
+// Frame geometry shared by the DAQ, DSP and display blocks.
+//
+// The compile-time macros below are only the defaults. At runtime the node reads the
+// same mmwaveconfig.txt that setup_radar (mmw_config.c) uses to program the AWR2243, so
+// the processing chain always matches the profile that is actually on the radar.
+#include <sys/stat.h>
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <tuple>
+
+#define FAST_TIME 512 //Initializes the number of fast time samples | # of range samples
+#define SLOW_TIME 64 //Initializes the number of slow time samples | # of doppler samples
+#define RX 4        // # of Rx
+#define TX 3        // # of Tx
+#define IQ 2 //Types of IQ (I and Q)
+#define SIZE_W_IQ TX*RX*FAST_TIME*SLOW_TIME*IQ  // Size of the total number of separate IQ sampels from ONE frame
+#define SIZE TX*RX*FAST_TIME*SLOW_TIME          // Size of the total number of COMPLEX samples from ONE frame
+#define IQ_BYTES 2
+#define FRAME_PERIOD_MS 100.0f                  // Frame periodicity of the default profile
+#define CHIRP_PERIOD_US 67.0f                   // Idle + ramp end time of the default profile
+#define CARRIER_GHZ 77.0f                       // Start frequency of the default profile
+#define SPEED_OF_LIGHT 299792458.0
+
+// Size of one radar frame. Two geometries that compare equal can share FFT plans and buffers.
+struct FrameGeometry
+{
+    int fast_time = FAST_TIME;                  // ADC samples per chirp | # of range bins
+    int slow_time = SLOW_TIME;                  // Chirp loops per frame | # of doppler bins
+    int rx = RX;                                // # of enabled Rx channels
+    int tx = TX;                                // # of chirps (Tx slots) per loop
+    float frame_period_ms = FRAME_PERIOD_MS;    // Not part of the key, buffers do not depend on it
+    float chirp_period_us = CHIRP_PERIOD_US;    // Start to start of consecutive chirps, not part of the key
+    float carrier_ghz = CARRIER_GHZ;            // Not part of the key
+
+    int virt_ants() const { return tx*rx; }
+    int rd_bins() const { return slow_time*fast_time; }
+    int size() const { return tx*rx*fast_time*slow_time; }
+    int size_w_iq() const { return size()*IQ; }
+    uint64_t bytes_in_frame() const { return (uint64_t) size_w_iq()*IQ_BYTES; }
+
+    // Radial velocity of one Doppler bin (m/s): lambda / (2 * the slow-time span of tx chirps per loop)
+    double doppler_step() const { return SPEED_OF_LIGHT / (carrier_ghz*1e9) / (2.0*tx*slow_time*chirp_period_us*1e-6); }
+
+    bool valid() const
+    {
+        return fast_time > 0 && slow_time > 0 && rx > 0 && tx > 0;
+    }
+
+    bool operator<(const FrameGeometry& o) const
+    {
+        return std::tie(fast_time, slow_time, rx, tx) < std::tie(o.fast_time, o.slow_time, o.rx, o.tx);
+    }
+
+    bool operator==(const FrameGeometry& o) const
+    {
+        return fast_time == o.fast_time && slow_time == o.slow_time && rx == o.rx && tx == o.tx;
+    }
+
+    bool operator!=(const FrameGeometry& o) const
+    {
+        return !(*this == o);
+    }
+};
+
+inline void print_geometry(const FrameGeometry& g)
+{
+    printf("Geometry: %d fast x %d slow x %d Rx x %d Tx | %.1f ms frame period | %.1f us chirps, %.3f m/s per Doppler bin\n",
+           g.fast_time, g.slow_time, g.rx, g.tx, g.frame_period_ms, g.chirp_period_us, g.doppler_step());
+}
+
+// Reads the frame geometry out of an mmwaveconfig.txt ("name=value;" lines, '#' comments).
+//  - numAdcSamples                  -> fast_time
+//  - loopCount                      -> slow_time
+//  - channelRx (bit mask)           -> rx
+//  - chirpEndIdxFCF-chirpStartIdxFCF+1 -> tx, the number of TDM chirps in one loop
+//  - periodicity (5 ns units)       -> frame_period_ms
+//  - idleTimeConst + rampEndTime (10 ns units) -> chirp_period_us
+//  - startFreqConst (3.6 GHz / 2^26 units)     -> carrier_ghz
+// Fields missing from the file keep the value already in geom. Returns false if the file
+// cannot be read or the resulting geometry is not valid, in which case geom is untouched.
+inline bool load_mmwave_config(const std::string& filename, FrameGeometry& geom)
+{
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::fprintf(stderr, "Error: Could not open radar config %s\n", filename.c_str());
+        return false;
+    }
+
+    FrameGeometry g = geom;
+    int chirp_start = -1, chirp_end = -1;
+    long idle_time = -1, ramp_end = -1;
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t hash = line.find('#');
+        if (hash != std::string::npos)
+            line.erase(hash);
+        size_t eq = line.find('=');
+        if (eq == std::string::npos)
+            continue;
+
+        std::string name = line.substr(0, eq);
+        std::string value = line.substr(eq + 1);
+        name.erase(0, name.find_first_not_of(" \t"));
+        name.erase(name.find_last_not_of(" \t\r") + 1);
+        const char* v = value.c_str();
+
+        if (name == "numAdcSamples")
+            g.fast_time = atoi(v);
+        else if (name == "loopCount")
+            g.slow_time = atoi(v);
+        else if (name == "channelRx")
+            g.rx = __builtin_popcount((unsigned) atoi(v));
+        else if (name == "chirpStartIdxFCF")
+            chirp_start = atoi(v);
+        else if (name == "chirpEndIdxFCF")
+            chirp_end = atoi(v);
+        else if (name == "periodicity")
+            g.frame_period_ms = strtoul(v, NULL, 10) * 5e-6f;
+        else if (name == "idleTimeConst")
+            idle_time = strtol(v, NULL, 10);
+        else if (name == "rampEndTime")
+            ramp_end = strtol(v, NULL, 10);
+        else if (name == "startFreqConst")
+            g.carrier_ghz = strtoul(v, NULL, 10) * (3.6 / 67108864.0);
+    }
+
+    if (chirp_start >= 0 && chirp_end >= chirp_start)
+        g.tx = chirp_end - chirp_start + 1;
+    if (idle_time >= 0 && ramp_end > 0)
+        g.chirp_period_us = (idle_time + ramp_end) * 0.01f;
+
+    if (!g.valid() || g.chirp_period_us <= 0 || g.carrier_ghz <= 0) {
+        std::fprintf(stderr, "Error: Invalid frame geometry in %s\n", filename.c_str());
+        return false;
+    }
+    geom = g;
+    return true;
+}
+
+// Watches a radar config file so the node can follow profile changes without a restart.
+// poll() costs a single stat() and only re-parses when the modification time changes.
+class RadarConfigWatcher
+{
+    std::string filename;
+    struct timespec last_mtime;
+
+    public:
+        RadarConfigWatcher(const std::string& fname) : filename(fname)
+        {
+            memset(&last_mtime, 0, sizeof(last_mtime));
+            struct stat st;
+            if (stat(filename.c_str(), &st) == 0)
+                last_mtime = st.st_mtim;
+        }
+
+        // Returns true (and updates geom) when the file changed to a different geometry.
+        bool poll(FrameGeometry& geom)
+        {
+            struct stat st;
+            if (stat(filename.c_str(), &st) != 0)
+                return false;
+            if (st.st_mtim.tv_sec == last_mtime.tv_sec && st.st_mtim.tv_nsec == last_mtime.tv_nsec)
+                return false;
+            last_mtime = st.st_mtim;
+
+            FrameGeometry g = geom;
+            if (!load_mmwave_config(filename, g))
+                return false;
+            bool changed = (g != geom) || (g.frame_period_ms != geom.frame_period_ms) ||
+                           (g.chirp_period_us != geom.chirp_period_us) || (g.carrier_ghz != geom.carrier_ghz);
+            geom = g;
+            return changed;
+        }
+};
@@ -0,0 +1,242 @@
+#pragma once
+// Typed frame objects passed between RadarBlocks.
+//
+// A RadarFrame carries everything produced for one radar frame (raw ADC cube, range-doppler
+// map, angle map, detections and timing metadata). Frames come from a FramePool that is
+// allocated once per geometry and are handed around through FrameRef, an intrusive
+// reference-counted handle. When the last FrameRef is dropped the frame goes back to its pool,
+// so a producer never overwrites a buffer a consumer is still reading and no stage copies data.
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include <time.h>
+#include <stdint.h>
+
+#define MAX_DETECTIONS 64       // Detections stored per frame
+#define ANGLE_BINS 256          // 4 x 64 angle FFT
+#define MAX_TRACKS 64           // Confirmed tracks reported per frame
+#define FRAME_POOL_SIZE 4       // Frames per pool: one per stage plus a spare
+
+// One detected target
+struct Detection
+{
+    int range_bin;          // fast-time bin
+    int doppler_bin;        // slow-time bin after fftshift
+    float range;            // m
+    float doppler;          // bins from zero Doppler (signed)
+    float azimuth;          // deg
+    float elevation;        // deg
+    float snr;              // peak over mean of the scaled RDM
+};
+
+// One confirmed or coasting track of the node's tracker (tracker.hpp), in the radar's frame: x along
+// boresight, y = range * sin(azimuth)
+struct TrackEstimate
+{
+    int id;                 // stable for the life of the track
+    float x, y;             // m
+    float vx, vy;           // m/s
+    float range;            // m
+    float azimuth;          // deg
+    float range_rate;       // m/s, positive moving away
+    float var_x, var_y;     // m^2
+    int hits;               // detections associated so far
+    int misses;             // frames since the last one, > 0 while the track coasts
+};
+
+class FramePool;
+
+struct RadarFrame
+{
+    // Metadata
+    uint32_t id;                // frame number assigned by the acquiring block
+    int64_t t_acquired_ns;      // steady clock, last packet of the frame received
+    int64_t t_wall_ns;          // CLOCK_REALTIME at acquisition, for cross-node alignment
+    int64_t t_processed_ns;     // steady clock, DSP finished
+    FrameGeometry geom;
+
+    // Payload
+    uint16_t* adc;              // interleaved IQ samples from the DCA1000, geom.size_w_iq()
+    float* rdm;                 // scaled range-doppler map (zero Doppler removed), geom.rd_bins()
+    float angle_map[ANGLE_BINS];
+    Detection detections[MAX_DETECTIONS];
+    int num_detections;
+    TrackEstimate tracks[MAX_TRACKS];      // filled by a tracker stage for the stages after it
+    int num_tracks;
+
+    // Pool bookkeeping
+    std::atomic<int> refs;
+    FramePool* pool;
+
+    // Clears the per-frame results, buffers are left as they are (they get overwritten)
+    void reset()
+    {
+        id = 0;
+        t_acquired_ns = t_wall_ns = t_processed_ns = 0;
+        num_detections = 0;
+        num_tracks = 0;
+    }
+};
+
+// Intrusive reference-counted handle to a pooled RadarFrame
+class FrameRef
+{
+    RadarFrame* f;
+
+    public:
+        FrameRef() : f(NULL) {}
+        explicit FrameRef(RadarFrame* frame) : f(frame)     // adopts a frame with refs already at 1
+        {
+        }
+        FrameRef(const FrameRef& o) : f(o.f)
+        {
+            if (f)
+                f->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        FrameRef(FrameRef&& o) : f(o.f)
+        {
+            o.f = NULL;
+        }
+        ~FrameRef()
+        {
+            reset();
+        }
+
+        FrameRef& operator=(const FrameRef& o)
+        {
+            if (o.f)
+                o.f->refs.fetch_add(1, std::memory_order_relaxed);
+            reset();
+            f = o.f;
+            return *this;
+        }
+        FrameRef& operator=(FrameRef&& o)
+        {
+            if (this != &o) {
+                reset();
+                f = o.f;
+                o.f = NULL;
+            }
+            return *this;
+        }
+
+        inline void reset();
+
+        RadarFrame* get() const { return f; }
+        RadarFrame* operator->() const { return f; }
+        RadarFrame& operator*() const { return *f; }
+        explicit operator bool() const { return f != NULL; }
+        int use_count() const { return f ? f->refs.load(std::memory_order_relaxed) : 0; }
+};
+
+// Fixed set of frames for one geometry. Nothing is allocated after construction.
+// The pool must outlive every FrameRef taken from it.
+class FramePool
+{
+    FrameGeometry geom;
+    std::vector<RadarFrame*> frames;
+    std::vector<RadarFrame*> free_list;
+    std::mutex m;
+    std::condition_variable cv;
+
+    public:
+        FramePool(const FrameGeometry& g, int count = FRAME_POOL_SIZE) : geom(g)
+        {
+            frames.reserve(count);
+            free_list.reserve(count);
+            for (int i = 0; i < count; i++) {
+                RadarFrame* f = new RadarFrame();
+                f->geom = g;
+                f->adc = reinterpret_cast<uint16_t*>(calloc(g.size_w_iq(), sizeof(uint16_t)));
+                f->rdm = reinterpret_cast<float*>(calloc(g.rd_bins(), sizeof(float)));
+                f->refs.store(0);
+                f->pool = this;
+                f->reset();
+                frames.push_back(f);
+                free_list.push_back(f);
+            }
+        }
+
+        ~FramePool()
+        {
+            for (RadarFrame* f : frames) {
+                free(f->adc);
+                free(f->rdm);
+                delete f;
+            }
+        }
+
+        // Takes a free frame, waiting for one to be released if the pool is exhausted
+        FrameRef acquire()
+        {
+            std::unique_lock<std::mutex> lock(m);
+            cv.wait(lock, [this] { return !free_list.empty(); });
+            return take();
+        }
+
+        // Takes a free frame, or returns an empty FrameRef if none is available
+        FrameRef try_acquire()
+        {
+            std::lock_guard<std::mutex> lock(m);
+            if (free_list.empty())
+                return FrameRef();
+            return take();
+        }
+
+        // Makes every frame buffer resident, see realtime.hpp
+        void prefault()
+        {
+            for (RadarFrame* f : frames) {
+                prefault_pages(f->adc, geom.size_w_iq() * sizeof(uint16_t));
+                prefault_pages(f->rdm, geom.rd_bins() * sizeof(float));
+                prefault_pages(f, sizeof(RadarFrame));
+            }
+        }
+
+        int available()
+        {
+            std::lock_guard<std::mutex> lock(m);
+            return free_list.size();
+        }
+
+        int capacity() const { return frames.size(); }
+        const FrameGeometry& geometry() const { return geom; }
+
+        // Called by FrameRef when the last reference goes away
+        void release(RadarFrame* f)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m);
+                free_list.push_back(f);
+            }
+            cv.notify_one();
+        }
+
+    private:
+        FrameRef take()
+        {
+            RadarFrame* f = free_list.back();
+            free_list.pop_back();
+            f->reset();
+            f->refs.store(1, std::memory_order_relaxed);
+            return FrameRef(f);
+        }
+};
+
+inline void FrameRef::reset()
+{
+    if (f && f->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        f->pool->release(f);
+    f = NULL;
+}
+
+// CLOCK_REALTIME in ns (chrony keeps nodes aligned, see Time-Synchronization/)
+inline int64_t wall_clock_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
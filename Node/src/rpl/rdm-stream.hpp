@@ -0,0 +1,465 @@
+#pragma once
+// Compressed range-Doppler map stream for remote viewing over a thin link (cellular backhaul),
+// shared by the node (RdmStreamEncoder) and the viewer (RdmStreamDecoder). Standalone like
+// detection-wire.hpp, include it on its own in a viewer.
+//
+// Every frame the scaled map (0-255 floats, Doppler major like RadarFrame::rdm) is quantised to
+// 8-bit levels and coded as the byte-wise difference to the previous map the decoder has, so
+// static clutter and an empty scene become runs of zeros. The result is compressed with an LZ
+// codec in the LZ4 block format (rdm_lz_compress; any LZ4 block decoder reads it too). Every
+// key_every frames, and whenever the encoder is told a message was lost, the levels are sent
+// whole (a keyframe) so a viewer can join or resynchronise.
+//
+// The noise floor changes by a few levels every frame, which no LZ codec compresses. threshold > 0
+// makes the differences lossy: a bin whose level moved by at most threshold is sent as 0 and the
+// viewer keeps the old level, so the error is at most threshold levels and noise codes as zeros.
+// The encoder keeps the map as the decoder rebuilds it, so left-out changes do not add up.
+// Changed-tiles mode also cuts the map into RDMS_TILE x RDMS_TILE tiles and sends only the tiles
+// with such a change, after a bitmap of them.
+//
+// One message, little endian: RdmStreamHeader, then header.bytes - sizeof(header) bytes of payload
+// (compressed unless RDMS_RAW). Decompressed the payload is, for a keyframe, fast x slow levels;
+// for a delta, fast x slow differences or, with RDMS_TILES, the tile bitmap (bit t of byte t / 8,
+// tiles numbered range-fastest) followed by the differences of the flagged tiles, each tile row by
+// row. header.bytes cuts messages out of a TCP stream (rdm_stream_message_size).
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <time.h>
+
+#define RDMS_MAGIC "RDMS"
+#define RDMS_VERSION 1
+#define RDMS_PORT 1212                  // viewer's listening port
+#define RDMS_TILE 32                    // changed-tile edge in bins
+#define RDMS_KEY_EVERY 50               // frames between keyframes
+#define RDMS_MAX_BINS (1 << 20)         // largest map a decoder accepts
+#define RDMS_LZ_HASH_BITS 12            // match finder table, 16 KB on the stack
+
+#define RDMS_KEY 0x1                    // flags: levels, not differences
+#define RDMS_TILES 0x2                  // payload starts with the changed-tile bitmap
+#define RDMS_RAW 0x4                    // payload stored, compression did not pay
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "rdm-stream.hpp writes host structs, big endian hosts need byte swapping"
+#endif
+
+struct RdmStreamHeader
+{
+    char magic[4];              // RDMS_MAGIC
+    uint16_t version;           // RDMS_VERSION
+    uint16_t node_id;
+    uint32_t seq;               // per node, +1 per message: a delta only applies on top of seq - 1
+    uint32_t frame;
+    int64_t t_wall_ns;          // CLOCK_REALTIME at acquisition
+    uint16_t fast_time;         // map size in bins
+    uint16_t slow_time;
+    uint16_t tile;              // RDMS_TILE of the sender
+    uint16_t flags;             // RDMS_*
+    uint32_t raw_bytes;         // payload decompressed
+    uint32_t bytes;             // whole message, this header included
+    uint32_t latency_us;        // acquisition to encoded on the node
+    uint16_t tiles_sent;        // RDMS_TILES: tiles in the payload
+    uint16_t threshold;         // largest change left out, in levels
+};
+
+static_assert(sizeof(RdmStreamHeader) == 48, "RdmStreamHeader layout");
+
+// ---- LZ4 block format codec -------------------------------------------------------------------
+// A sequence is a token (literal count << 4 | match length - 4), extra length bytes for either
+// nibble at 15, the literals, a 2-byte offset back into the output and the match. The last
+// sequence has literals only; the last 5 bytes are always literals and no match starts in the
+// last 12, as the format requires.
+
+// Largest output of rdm_lz_compress for n bytes
+inline size_t rdm_lz_bound(size_t n)
+{
+    return n + n / 255 + 16;
+}
+
+inline uint32_t rdm_lz_read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint8_t* rdm_lz_length(uint8_t* op, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = (uint8_t) len;
+    return op;
+}
+
+inline uint8_t* rdm_lz_sequence(uint8_t* op, const uint8_t* literals, size_t lit, size_t offset, size_t match)
+{
+    uint8_t* token = op++;
+    *token = (uint8_t) (std::min<size_t>(lit, 15) << 4);
+    if (lit >= 15)
+        op = rdm_lz_length(op, lit - 15);
+    if (lit > 0)
+        memcpy(op, literals, lit);
+    op += lit;
+    if (match == 0)
+        return op;
+    *op++ = (uint8_t) offset;
+    *op++ = (uint8_t) (offset >> 8);
+    *token |= (uint8_t) std::min<size_t>(match - 4, 15);
+    if (match - 4 >= 15)
+        op = rdm_lz_length(op, match - 4 - 15);
+    return op;
+}
+
+// Greedy single-probe compressor: one hash of the next 4 bytes per position, skipping ahead
+// faster while nothing matches. dst needs rdm_lz_bound(n) bytes. Returns the compressed size.
+inline size_t rdm_lz_compress(const uint8_t* src, size_t n, uint8_t* dst)
+{
+    uint8_t* op = dst;
+    size_t anchor = 0;
+    if (n > 12) {
+        uint32_t table[1 << RDMS_LZ_HASH_BITS];
+        memset(table, 0, sizeof(table));
+        const size_t match_limit = n - 12, end_limit = n - 5;
+        size_t ip = 1, misses = 0;
+        while (ip < match_limit) {
+            uint32_t seq = rdm_lz_read32(src + ip);
+            uint32_t h = (seq * 2654435761u) >> (32 - RDMS_LZ_HASH_BITS);
+            size_t ref = table[h];
+            table[h] = ip;
+            if (ip - ref > 65535 || rdm_lz_read32(src + ref) != seq) {
+                ip += 1 + (misses++ >> 5);
+                continue;
+            }
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1])
+                ip--, ref--;
+            size_t len = 4;
+            while (ip + len < end_limit && src[ip + len] == src[ref + len])
+                len++;
+            op = rdm_lz_sequence(op, src + anchor, ip - anchor, ip - ref, len);
+            ip += len;
+            anchor = ip;
+            misses = 0;
+            if (ip - 2 < match_limit)
+                table[(rdm_lz_read32(src + ip - 2) * 2654435761u) >> (32 - RDMS_LZ_HASH_BITS)] = ip - 2;
+        }
+    }
+    return rdm_lz_sequence(op, src + anchor, n - anchor, 0, 0) - dst;
+}
+
+// Returns the decompressed size, -1 for input that is malformed or does not fit cap bytes
+inline long rdm_lz_decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap)
+{
+    size_t ip = 0, op = 0;
+    auto length = [&](size_t& len) {
+        uint8_t b;
+        do {
+            if (ip >= n)
+                return false;
+            b = src[ip++];
+            len += b;
+        } while (b == 255);
+        return true;
+    };
+    while (ip < n) {
+        uint8_t token = src[ip++];
+        size_t lit = token >> 4;
+        if (lit == 15 && !length(lit))
+            return -1;
+        if (lit > n - ip || lit > cap - op)
+            return -1;
+        memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == n)
+            break;
+        if (n - ip < 2)
+            return -1;
+        size_t offset = src[ip] | (size_t) src[ip + 1] << 8;
+        ip += 2;
+        size_t len = (token & 15) + 4;
+        if ((token & 15) == 15 && !length(len))
+            return -1;
+        if (offset == 0 || offset > op || len > cap - op)
+            return -1;
+        uint8_t* d = dst + op;
+        const uint8_t* s = d - offset;
+        if (offset >= len)
+            memcpy(d, s, len);
+        else
+            for (size_t i = 0; i < len; i++)      // overlapping: repeats the last offset bytes
+                d[i] = s[i];
+        op += len;
+    }
+    return op;
+}
+
+// ---- Stream --------------------------------------------------------------------------------
+
+inline void rdm_stream_tiles(int fast, int slow, int tile, int& tiles_r, int& tiles_d)
+{
+    tiles_r = (fast + tile - 1) / tile;
+    tiles_d = (slow + tile - 1) / tile;
+}
+
+// Encodes frames into a reused buffer. Not thread safe, one per stream.
+class RdmStreamEncoder
+{
+    uint16_t node_id;
+    bool tiles;
+    int threshold, key_every;
+    uint32_t seq;
+    int since_key;
+    bool need_key;
+    int fast, slow;
+    std::vector<uint8_t> ref;           // the map as the decoder has it
+    std::vector<uint8_t> levels, payload, msg;
+
+    public:
+        // thr levels of change are left out, changed_tiles sends only tiles with a larger change
+        RdmStreamEncoder(uint16_t node = 0, bool changed_tiles = false, int thr = 0, int key = RDMS_KEY_EVERY)
+            : node_id(node), tiles(changed_tiles), threshold(std::max(0, std::min(thr, 255))),
+              key_every(std::max(1, key)), seq(0), since_key(0), need_key(true), fast(0), slow(0) {}
+
+        // The next message is a keyframe. Call when a message was lost on the way.
+        void forceKey()
+        {
+            need_key = true;
+        }
+
+        // Encodes one scaled map. t_acquired_ns (CLOCK_MONOTONIC) gives the header's latency.
+        // The message stays valid until the next encode().
+        const uint8_t* encode(const float* rdm, int fast_time, int slow_time, uint32_t frame, int64_t t_wall_ns,
+                              int64_t t_acquired_ns, size_t& len)
+        {
+            size_t bins = (size_t) fast_time * slow_time;
+            if (fast_time != fast || slow_time != slow) {
+                fast = fast_time;
+                slow = slow_time;
+                ref.assign(bins, 0);
+                need_key = true;
+            }
+            levels.resize(bins);
+            for (size_t i = 0; i < bins; i++)
+                levels[i] = (uint8_t) (std::min(std::max(rdm[i], 0.0f), 255.0f) + 0.5f);
+
+            RdmStreamHeader h;
+            memset(&h, 0, sizeof(h));
+            bool key = need_key || ++since_key >= key_every;
+            if (key) {
+                payload.assign(levels.begin(), levels.end());
+                ref.swap(levels);
+                h.flags = RDMS_KEY;
+                since_key = 0;
+                need_key = false;
+            }
+            else if (!tiles) {
+                payload.resize(bins);
+                for (size_t i = 0; i < bins; i++)
+                    payload[i] = difference(i);
+            }
+            else {
+                h.flags = RDMS_TILES;
+                h.tiles_sent = encode_tiles();
+            }
+            h.threshold = key ? 0 : threshold;
+
+            size_t raw = payload.size();
+            msg.resize(sizeof(h) + rdm_lz_bound(raw));
+            size_t packed = rdm_lz_compress(payload.data(), raw, msg.data() + sizeof(h));
+            if (packed >= raw) {
+                memcpy(msg.data() + sizeof(h), payload.data(), raw);
+                packed = raw;
+                h.flags |= RDMS_RAW;
+            }
+            msg.resize(sizeof(h) + packed);
+
+            memcpy(h.magic, RDMS_MAGIC, 4);
+            h.version = RDMS_VERSION;
+            h.node_id = node_id;
+            h.seq = seq++;
+            h.frame = frame;
+            h.t_wall_ns = t_wall_ns;
+            h.fast_time = fast;
+            h.slow_time = slow;
+            h.tile = RDMS_TILE;
+            h.raw_bytes = raw;
+            h.bytes = msg.size();
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            int64_t latency_ns = (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec - t_acquired_ns;
+            h.latency_us = latency_ns > 0 ? latency_ns / 1000 : 0;
+            memcpy(msg.data(), &h, sizeof(h));
+            len = msg.size();
+            return msg.data();
+        }
+
+    private:
+        // Difference of bin i to what the decoder has, 0 within threshold; moves ref along
+        uint8_t difference(size_t i)
+        {
+            if (std::abs((int) levels[i] - (int) ref[i]) <= threshold)
+                return 0;
+            uint8_t d = levels[i] - ref[i];
+            ref[i] = levels[i];
+            return d;
+        }
+
+        // Bitmap and differences of the tiles that moved by more than threshold
+        int encode_tiles()
+        {
+            int tiles_r, tiles_d;
+            rdm_stream_tiles(fast, slow, RDMS_TILE, tiles_r, tiles_d);
+            int count = tiles_r * tiles_d, sent = 0;
+            payload.assign((count + 7) / 8, 0);
+            for (int t = 0; t < count; t++) {
+                int r0 = (t % tiles_r) * RDMS_TILE, d0 = (t / tiles_r) * RDMS_TILE;
+                int w = std::min(RDMS_TILE, fast - r0), hgt = std::min(RDMS_TILE, slow - d0);
+                bool changed = false;
+                for (int v = 0; v < hgt && !changed; v++) {
+                    const uint8_t* a = &levels[(size_t) (d0 + v) * fast + r0];
+                    const uint8_t* b = &ref[(size_t) (d0 + v) * fast + r0];
+                    for (int r = 0; r < w; r++)
+                        changed |= std::abs((int) a[r] - (int) b[r]) > threshold;
+                }
+                if (!changed)
+                    continue;
+                payload[t / 8] |= 1 << (t % 8);
+                sent++;
+                for (int v = 0; v < hgt; v++) {
+                    size_t row = (size_t) (d0 + v) * fast + r0;
+                    for (int r = 0; r < w; r++)
+                        payload.push_back(difference(row + r));
+                }
+            }
+            return sent;
+        }
+};
+
+// Size of the message at the start of a byte stream: 0 while fewer than sizeof(RdmStreamHeader)
+// bytes are there, -1 if the data is not a message of this version
+inline long rdm_stream_message_size(const uint8_t* data, size_t len)
+{
+    if (len < sizeof(RdmStreamHeader))
+        return 0;
+    RdmStreamHeader h;
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, RDMS_MAGIC, 4) != 0 || h.version != RDMS_VERSION || h.bytes < sizeof(RdmStreamHeader))
+        return -1;
+    return h.bytes;
+}
+
+// Rebuilds the levels from a node's messages, in order
+class RdmStreamDecoder
+{
+    RdmStreamHeader last;
+    bool synced;
+    std::vector<uint8_t> map, payload;
+    uint64_t decoded, unsynced;
+
+    public:
+        RdmStreamDecoder() : synced(false), decoded(0), unsynced(0)
+        {
+            memset(&last, 0, sizeof(last));
+        }
+
+        // True when the message updated levels(). False for a malformed message (reason in
+        // error) or a delta that does not follow the last decoded message: a message was lost,
+        // the map stays as it was until the next keyframe (error empty).
+        bool decode(const uint8_t* data, size_t len, std::string* error = NULL)
+        {
+            auto fail = [&](const char* why) {
+                if (error)
+                    *error = why;
+                return false;
+            };
+            if (error)
+                error->clear();
+            long size = rdm_stream_message_size(data, len);
+            if (size < 0)
+                return fail("bad magic or version");
+            if (size == 0 || (size_t) size > len)
+                return fail("truncated message");
+            RdmStreamHeader h;
+            memcpy(&h, data, sizeof(h));
+            size_t bins = (size_t) h.fast_time * h.slow_time;
+            if (bins == 0 || bins > RDMS_MAX_BINS || h.tile == 0)
+                return fail("bad map size");
+
+            bool key = h.flags & RDMS_KEY;
+            if (!key && (!synced || h.seq != last.seq + 1 || h.fast_time != last.fast_time || h.slow_time != last.slow_time)) {
+                synced = false;
+                unsynced++;
+                return false;
+            }
+
+            // Expected payload size from the header, so a bad message cannot run past the map
+            int tiles_r, tiles_d;
+            rdm_stream_tiles(h.fast_time, h.slow_time, h.tile, tiles_r, tiles_d);
+            size_t bitmap = ((size_t) tiles_r * tiles_d + 7) / 8;
+            if ((h.flags & RDMS_TILES) && !key) {
+                if (h.raw_bytes < bitmap || h.raw_bytes > bitmap + bins)
+                    return fail("bad payload size");
+            }
+            else if (h.raw_bytes != bins) {
+                return fail("bad payload size");
+            }
+
+            const uint8_t* body = data + sizeof(h);
+            size_t body_len = size - sizeof(h);
+            payload.resize(h.raw_bytes);
+            if (h.flags & RDMS_RAW) {
+                if (body_len != h.raw_bytes)
+                    return fail("bad payload size");
+                memcpy(payload.data(), body, body_len);
+            }
+            else if (rdm_lz_decompress(body, body_len, payload.data(), payload.size()) != (long) h.raw_bytes) {
+                return fail("corrupt payload");
+            }
+
+            if (key) {
+                map.assign(payload.begin(), payload.end());
+            }
+            else if (!(h.flags & RDMS_TILES)) {
+                for (size_t i = 0; i < bins; i++)
+                    map[i] += payload[i];
+            }
+            else if (!apply_tiles(h, tiles_r, tiles_d, bitmap)) {
+                synced = false;
+                return fail("tile data does not match the bitmap");
+            }
+            last = h;
+            synced = true;
+            decoded++;
+            return true;
+        }
+
+        const RdmStreamHeader& header() const { return last; }
+        // fast_time x slow_time levels, Doppler major
+        const uint8_t* levels() const { return map.data(); }
+        uint64_t getDecoded() const { return decoded; }
+        // Deltas that could not be applied (waiting for a keyframe)
+        uint64_t getUnsynced() const { return unsynced; }
+
+    private:
+        bool apply_tiles(const RdmStreamHeader& h, int tiles_r, int tiles_d, size_t bitmap)
+        {
+            size_t off = bitmap;
+            for (int t = 0; t < tiles_r * tiles_d; t++) {
+                if (!(payload[t / 8] & (1 << (t % 8))))
+                    continue;
+                int r0 = (t % tiles_r) * h.tile, d0 = (t / tiles_r) * h.tile;
+                int w = std::min<int>(h.tile, h.fast_time - r0), hgt = std::min<int>(h.tile, h.slow_time - d0);
+                if (off + (size_t) w * hgt > payload.size())
+                    return false;
+                for (int v = 0; v < hgt; v++) {
+                    uint8_t* row = &map[(size_t) (d0 + v) * h.fast_time + r0];
+                    for (int r = 0; r < w; r++)
+                        row[r] += payload[off++];
+                }
+            }
+            return off == payload.size();
+        }
+};
@@ -0,0 +1,184 @@
+#pragma once
+// Real-time execution profile for the node's threads.
+//
+// Frame-time jitter on a loaded board comes mostly from the scheduler (other tasks on the same
+// core, CFS time slicing) and from page faults on first touch. The helpers below pin a thread
+// to its cores and give it a SCHED_FIFO priority, lock and pre-fault memory so the hot path
+// never faults, and check that the kernel is set up to make this effective (isolated CPUs, RT
+// throttling). Every step reports what was actually achieved, a missing capability only warns.
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define RT_STACK_PREFAULT (256*1024)    // stack touched by each real-time thread at startup
+
+struct RtThreadConfig
+{
+    std::vector<int> cpus;      // cores the thread may run on, empty leaves affinity alone
+    int priority = 0;           // 1-99 selects SCHED_FIFO, 0 keeps SCHED_OTHER
+
+    bool enabled() const { return !cpus.empty() || priority > 0; }
+};
+
+// "3", "2,3", "4-7" or "0-1,6" -> list of cores. Returns false on a malformed list.
+inline bool parse_cpu_list(const std::string& s, std::vector<int>& cpus)
+{
+    std::stringstream in(s);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (item.empty() || item == "\n")
+            continue;
+        int lo, hi;
+        if (sscanf(item.c_str(), "%d-%d", &lo, &hi) == 2) {
+            if (lo < 0 || hi < lo)
+                return false;
+        }
+        else if (sscanf(item.c_str(), "%d", &lo) == 1 && lo >= 0)
+            hi = lo;
+        else
+            return false;
+        for (int c = lo; c <= hi; c++)
+            cpus.push_back(c);
+    }
+    return true;
+}
+
+inline std::string cpu_list_string(const std::vector<int>& cpus)
+{
+    std::string s;
+    for (size_t i = 0; i < cpus.size(); i++)
+        s += (i ? "," : "") + std::to_string(cpus[i]);
+    return s.empty() ? "-" : s;
+}
+
+// Writes one byte per page so the pages are resident before the first frame
+inline void prefault_pages(void* p, size_t bytes)
+{
+    if (p == NULL)
+        return;
+    static const long page = sysconf(_SC_PAGESIZE);
+    volatile char* c = reinterpret_cast<volatile char*>(p);
+    for (size_t i = 0; i < bytes; i += page)
+        c[i] = c[i];
+}
+
+// Touches the calling thread's stack down to RT_STACK_PREFAULT bytes
+inline void prefault_stack()
+{
+    volatile unsigned char stack[RT_STACK_PREFAULT];
+    for (size_t i = 0; i < sizeof(stack); i += 4096)
+        stack[i] = 0;
+}
+
+// Prints the scheduling policy and affinity the calling thread really has
+inline void report_thread_rt(const char* name)
+{
+    int policy;
+    struct sched_param param;
+    pthread_getschedparam(pthread_self(), &policy, &param);
+
+    cpu_set_t set;
+    std::vector<int> cpus;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0)
+        for (int c = 0; c < CPU_SETSIZE; c++)
+            if (CPU_ISSET(c, &set))
+                cpus.push_back(c);
+
+    printf("[rt] %-12s tid %-6ld %-12s prio %-3d cpus %s\n", name, (long) syscall(SYS_gettid),
+           policy == SCHED_FIFO ? "SCHED_FIFO" : policy == SCHED_RR ? "SCHED_RR" : "SCHED_OTHER",
+           param.sched_priority, cpu_list_string(cpus).c_str());
+}
+
+// Applies cfg to the calling thread, pre-faults its stack and reports the result. Returns false
+// if part of the profile could not be applied (typically missing CAP_SYS_NICE).
+inline bool apply_thread_rt(const RtThreadConfig& cfg, const char* name)
+{
+    bool ok = true;
+    if (!cfg.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int c : cfg.cpus)
+            CPU_SET(c, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0) {
+            fprintf(stderr, "[rt] warning: %s: cannot pin to cpus %s: %s\n", name, cpu_list_string(cfg.cpus).c_str(), strerror(err));
+            ok = false;
+        }
+    }
+    if (cfg.priority > 0) {
+        struct sched_param param;
+        param.sched_priority = cfg.priority;
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err != 0) {
+            fprintf(stderr, "[rt] warning: %s: cannot set SCHED_FIFO %d: %s\n", name, cfg.priority, strerror(err));
+            ok = false;
+        }
+    }
+    prefault_stack();
+    report_thread_rt(name);
+    return ok;
+}
+
+// Locks every current and future page in RAM and stops malloc from handing memory back to the
+// kernel (or using fresh mmaps), so buffers allocated later are not faulted in on the hot path.
+inline bool lock_memory()
+{
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        fprintf(stderr, "[rt] warning: mlockall failed: %s (raise RLIMIT_MEMLOCK or run with CAP_IPC_LOCK)\n", strerror(errno));
+        return false;
+    }
+
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+        if (line.compare(0, 6, "VmLck:") == 0)
+            printf("[rt] memory locked, %s\n", line.c_str());
+    return true;
+}
+
+// Warns about kernel settings that defeat the profile: cores given to real-time threads that
+// are not isolated (isolcpus=), cores that do not exist, and RT throttling.
+inline void check_rt_environment(const std::vector<int>& cpus)
+{
+    std::set<int> wanted(cpus.begin(), cpus.end());
+    if (wanted.empty())
+        return;
+    std::string wanted_str = cpu_list_string(std::vector<int>(wanted.begin(), wanted.end()));
+
+    std::vector<int> isolated_list;
+    std::ifstream isolated_file("/sys/devices/system/cpu/isolated");
+    std::string isolated_str;
+    std::getline(isolated_file, isolated_str);
+    parse_cpu_list(isolated_str, isolated_list);
+    std::set<int> isolated(isolated_list.begin(), isolated_list.end());
+
+    long online = sysconf(_SC_NPROCESSORS_CONF);
+    for (int c : wanted) {
+        if (c >= online)
+            fprintf(stderr, "[rt] warning: cpu %d does not exist (%ld cpus)\n", c, online);
+        else if (!isolated.count(c))
+            fprintf(stderr, "[rt] warning: cpu %d is not isolated, other tasks and kernel threads can run on it "
+                            "(boot with isolcpus=%s nohz_full=%s)\n", c, wanted_str.c_str(), wanted_str.c_str());
+    }
+
+    std::ifstream runtime_file("/proc/sys/kernel/sched_rt_runtime_us");
+    long runtime = -1;
+    if (runtime_file >> runtime && runtime != -1)
+        fprintf(stderr, "[rt] warning: RT throttling is on (sched_rt_runtime_us=%ld), SCHED_FIFO threads can be "
+                        "stalled every period (echo -1 > /proc/sys/kernel/sched_rt_runtime_us)\n", runtime);
+}
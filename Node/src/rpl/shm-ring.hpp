@@ -0,0 +1,281 @@
+#pragma once
+// Shared-memory frame ring for consumers on the node itself (ROS bridge, recorder, a second
+// analysis process). Standalone like detection-wire.hpp, readers include it on its own.
+//
+// The DSP writes every frame's scaled RDM, angle map, detections and optionally the per-channel
+// range FFT cube into one slot of a ring in /dev/shm. It claims the slot before it starts on the
+// frame and computes the range FFT cube straight into it, the largest array is never copied. Any number of readers map the ring
+// read-only and use the data where it is: ShmRingReader::newest() returns a pointer into the
+// mapping, nothing is copied. Readers never take a lock and the writer never waits for them:
+// every slot carries a sequence number that is odd while the slot is written (seqlock), a reader
+// checks after using the data (ShmRingReader::valid) that the slot was not rewritten meanwhile.
+// With SHM_RING_SLOTS slots a reader has that many frame periods before its slot comes around.
+//
+// Layout: ShmRingHeader, then `slots` slots of slot_bytes each (page aligned). A slot is a
+// ShmSlotHeader followed by its arrays at the offsets in the ring header. Frame f is in slot
+// f % slots, so frames finished out of order (frame-parallel DSP) still land where readers
+// look for them; ShmRingHeader.latest is the newest complete frame.
+//
+// The writer recreates the ring on start (shm_unlink + create), a reader whose frames stop
+// advancing should reopen it.
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "detection-wire.hpp"
+
+#define SHM_RING_NAME "/rpl_node"       // /dev/shm/rpl_node
+#define SHM_RING_SLOTS 8
+#define SHM_RING_MAGIC "RPLSHM1"
+#define SHM_RING_VERSION 1
+#define SHM_ANGLE_BINS 256              // RadarFrame::angle_map (ANGLE_BINS)
+
+struct ShmRingHeader
+{
+    char magic[8];              // SHM_RING_MAGIC, written last when the ring is ready
+    uint32_t version;
+    uint32_t slots;
+    uint64_t slot_bytes;        // distance between slots
+    uint64_t ring_offset;       // first slot, from the start of the mapping
+    uint32_t max_rd_bins;       // RDM floats a slot holds
+    uint32_t max_cube;          // complex range FFT samples a slot holds, 0 if not published
+    uint32_t max_detections;
+    uint32_t angle_offset;      // offsets of the arrays from the start of a slot
+    uint32_t detection_offset;
+    uint32_t rdm_offset;
+    uint64_t cube_offset;
+    uint64_t latest;            // newest complete frame + 1, 0 before the first (atomic)
+    int64_t writer_pid;
+};
+
+struct ShmSlotHeader
+{
+    uint64_t seq;               // seqlock: odd while being written (atomic)
+    uint32_t frame;
+    uint32_t num_detections;    // WireDetection records
+    int64_t t_wall_ns;          // CLOCK_REALTIME at acquisition
+    int64_t t_acquired_ns;      // CLOCK_MONOTONIC, comparable between processes on the node
+    int64_t t_processed_ns;
+    int32_t fast_time, slow_time, rx, tx;
+    uint32_t rd_bins;           // RDM floats in this slot (Doppler major, 0-255 scaled, zero Doppler removed)
+    uint32_t cube_samples;      // complex floats of the range FFT cube, 0 if not published
+};
+
+static_assert(sizeof(ShmSlotHeader) == 64, "ShmSlotHeader layout");
+
+inline size_t shm_align(size_t n, size_t a)
+{
+    return (n + a - 1) / a * a;
+}
+
+// Writing side, one per ring. Several DSP lanes may write at once, each into the slot of its own
+// frame; readers are never waited for.
+class ShmRingWriter
+{
+    std::string name;
+    uint8_t* base;
+    size_t bytes;
+    ShmRingHeader* header;
+    std::atomic<uint64_t> skipped;
+
+    public:
+        ShmRingWriter() : base(NULL), bytes(0), header(NULL), skipped(0) {}
+
+        ~ShmRingWriter()
+        {
+            close();
+        }
+
+        bool create(const std::string& shm_name, int slots, uint32_t max_rd_bins, uint32_t max_cube, uint32_t max_detections)
+        {
+            close();
+            name = (shm_name.empty() || shm_name[0] != '/') ? "/" + shm_name : shm_name;
+            ShmRingHeader h;
+            memset(&h, 0, sizeof(h));
+            h.version = SHM_RING_VERSION;
+            h.slots = std::max(slots, 2);
+            h.max_rd_bins = max_rd_bins;
+            h.max_cube = max_cube;
+            h.max_detections = max_detections;
+            h.angle_offset = sizeof(ShmSlotHeader);
+            h.detection_offset = shm_align(h.angle_offset + SHM_ANGLE_BINS * sizeof(float), 64);
+            h.rdm_offset = shm_align(h.detection_offset + max_detections * sizeof(WireDetection), 64);
+            h.cube_offset = shm_align(h.rdm_offset + (size_t) max_rd_bins * sizeof(float), 64);
+            h.slot_bytes = shm_align(h.cube_offset + (size_t) max_cube * 2 * sizeof(float), 4096);
+            h.ring_offset = 4096;
+            h.writer_pid = getpid();
+            bytes = h.ring_offset + h.slots * h.slot_bytes;
+
+            // A new object: readers still mapping the old one keep valid (stale) memory
+            shm_unlink(name.c_str());
+            int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+            if (fd < 0) {
+                perror("[ERROR] creating the shared-memory ring\n");
+                return false;
+            }
+            if (ftruncate(fd, bytes) != 0) {
+                perror("[ERROR] sizing the shared-memory ring\n");
+                ::close(fd);
+                shm_unlink(name.c_str());
+                return false;
+            }
+            void* p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (p == MAP_FAILED) {
+                perror("[ERROR] mapping the shared-memory ring\n");
+                shm_unlink(name.c_str());
+                return false;
+            }
+            base = static_cast<uint8_t*>(p);
+            header = reinterpret_cast<ShmRingHeader*>(base);
+            memcpy(header, &h, sizeof(h));          // the object is zero filled, slots start at seq 0
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            memcpy(header->magic, SHM_RING_MAGIC, sizeof(header->magic));
+            printf("Shared-memory ring /dev/shm%s: %u slots of %.1f KB\n", name.c_str(), h.slots, h.slot_bytes / 1024.0);
+            return true;
+        }
+
+        void close()
+        {
+            if (base == NULL)
+                return;
+            munmap(base, bytes);
+            shm_unlink(name.c_str());
+            base = NULL;
+            header = NULL;
+        }
+
+        bool isOpen() const { return base != NULL; }
+        const ShmRingHeader& getHeader() const { return *header; }
+
+        // Claims the slot of a frame and marks it as being written. NULL (counted) when another lane
+        // still writes the slot, a frame `slots` frames apart. Fill the slot through the accessors,
+        // for as long as the frame takes, then end() publishes it.
+        ShmSlotHeader* begin(uint32_t frame)
+        {
+            ShmSlotHeader* s = reinterpret_cast<ShmSlotHeader*>(base + header->ring_offset + (frame % header->slots) * header->slot_bytes);
+            uint64_t seq = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+            if ((seq & 1) || !__atomic_compare_exchange_n(&s->seq, &seq, seq + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                skipped++;
+                return NULL;
+            }
+            __atomic_thread_fence(__ATOMIC_RELEASE);        // odd before any data changes
+            s->frame = frame;
+            s->num_detections = 0;
+            s->rd_bins = 0;
+            s->cube_samples = 0;
+            return s;
+        }
+
+        // Publishes a slot taken with begin()
+        void end(ShmSlotHeader* s)
+        {
+            uint64_t seq = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+            __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELEASE);
+            uint64_t next = (uint64_t) s->frame + 1, latest = __atomic_load_n(&header->latest, __ATOMIC_RELAXED);
+            while (next > latest && !__atomic_compare_exchange_n(&header->latest, &latest, next, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+                ;
+        }
+
+        uint64_t getSkipped() const { return skipped.load(); }
+        float* angle_map(ShmSlotHeader* s) { return reinterpret_cast<float*>(reinterpret_cast<uint8_t*>(s) + header->angle_offset); }
+        WireDetection* detections(ShmSlotHeader* s) { return reinterpret_cast<WireDetection*>(reinterpret_cast<uint8_t*>(s) + header->detection_offset); }
+        float* rdm(ShmSlotHeader* s) { return reinterpret_cast<float*>(reinterpret_cast<uint8_t*>(s) + header->rdm_offset); }
+        float* cube(ShmSlotHeader* s) { return reinterpret_cast<float*>(reinterpret_cast<uint8_t*>(s) + header->cube_offset); }       // interleaved I/Q
+};
+
+// Reading side: maps a ring read-only
+class ShmRingReader
+{
+    uint8_t* base;
+    size_t bytes;
+    const ShmRingHeader* header;
+
+    public:
+        ShmRingReader() : base(NULL), bytes(0), header(NULL) {}
+
+        ~ShmRingReader()
+        {
+            close();
+        }
+
+        // Fails while the writer has not created the ring yet
+        bool open(const std::string& name = SHM_RING_NAME)
+        {
+            close();
+            int fd = shm_open(name.c_str(), O_RDONLY, 0);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(ShmRingHeader)) {
+                ::close(fd);
+                return false;
+            }
+            void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (p == MAP_FAILED)
+                return false;
+            base = static_cast<uint8_t*>(p);
+            bytes = st.st_size;
+            header = reinterpret_cast<const ShmRingHeader*>(base);
+            if (memcmp(header->magic, SHM_RING_MAGIC, sizeof(header->magic)) != 0 || header->version != SHM_RING_VERSION ||
+                header->ring_offset + header->slots * header->slot_bytes > bytes) {
+                close();
+                return false;
+            }
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            return true;
+        }
+
+        void close()
+        {
+            if (base != NULL)
+                munmap(base, bytes);
+            base = NULL;
+            header = NULL;
+        }
+
+        bool isOpen() const { return base != NULL; }
+        const ShmRingHeader& getHeader() const { return *header; }
+
+        // Newest complete frame + 1, 0 before the first
+        uint64_t latest() const
+        {
+            return __atomic_load_n(&header->latest, __ATOMIC_ACQUIRE);
+        }
+
+        // The slot of a frame in place, NULL while it is being written or if it holds another
+        // frame. Use the data, then check valid(slot, seq) before trusting what was read.
+        const ShmSlotHeader* get(uint32_t frame, uint64_t& seq) const
+        {
+            const ShmSlotHeader* s = reinterpret_cast<const ShmSlotHeader*>(base + header->ring_offset + (frame % header->slots) * header->slot_bytes);
+            seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+            if ((seq & 1) || s->frame != frame)
+                return NULL;
+            return s;
+        }
+
+        // The newest frame in place, NULL if there is none yet or it was just being rewritten
+        const ShmSlotHeader* newest(uint64_t& seq) const
+        {
+            uint64_t l = latest();
+            return l == 0 ? NULL : get(l - 1, seq);
+        }
+
+        // True if the slot still holds what it held when get() returned seq
+        bool valid(const ShmSlotHeader* s, uint64_t seq) const
+        {
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            return __atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq;
+        }
+
+        const float* angle_map(const ShmSlotHeader* s) const { return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(s) + header->angle_offset); }
+        const WireDetection* detections(const ShmSlotHeader* s) const { return reinterpret_cast<const WireDetection*>(reinterpret_cast<const uint8_t*>(s) + header->detection_offset); }
+        const float* rdm(const ShmSlotHeader* s) const { return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(s) + header->rdm_offset); }
+        const float* cube(const ShmSlotHeader* s) const { return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(s) + header->cube_offset); }
+};
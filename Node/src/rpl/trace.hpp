@@ -0,0 +1,265 @@
+#pragma once
+// Low-overhead tracing of stages and kernels.
+//
+// TRACE_SCOPE("name") records one event (begin and end time, frame id, thread) when the scope
+// exits. Every thread writes into its own fixed ring, so recording is two clock reads and a few
+// stores with no lock, allocation or I/O. The rings are read on demand:
+//  - Tracer::write_chrome_json() exports a trace for chrome://tracing or ui.perfetto.dev
+//  - Tracer::print_summary() prints p50/p99/max per event name over the events still in the
+//    rings, i.e. a rolling window of the last TRACE_RING_SIZE events of every thread
+// Build with -DRPL_NO_TRACE to compile the scopes out, or call Tracer::instance().enable(false).
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#define TRACE_RING_SIZE 16384       // events kept per thread, power of two
+
+struct TraceEvent
+{
+    const char* name;               // string literal or Tracer::intern()
+    int64_t begin_ns;               // monotonic_ns()
+    int64_t end_ns;
+    uint32_t frame;                 // frame id set with trace_set_frame(), 0 if none
+};
+
+// Single-writer ring owned by one thread
+class TraceRing
+{
+    TraceEvent events[TRACE_RING_SIZE];
+    std::atomic<uint64_t> head;     // events ever written
+
+    public:
+        int tid;
+        const char* thread_name;
+
+        TraceRing(int id) : head(0), tid(id), thread_name(NULL) {}
+
+        void push(const char* name, int64_t begin_ns, int64_t end_ns, uint32_t frame)
+        {
+            uint64_t h = head.load(std::memory_order_relaxed);
+            TraceEvent& ev = events[h & (TRACE_RING_SIZE - 1)];
+            ev.name = name;
+            ev.begin_ns = begin_ns;
+            ev.end_ns = end_ns;
+            ev.frame = frame;
+            head.store(h + 1, std::memory_order_release);
+        }
+
+        // Appends the events still in the ring, oldest first. Entries the writer may have
+        // overwritten during the copy are dropped.
+        void snapshot(std::vector<TraceEvent>& out)
+        {
+            uint64_t end = head.load(std::memory_order_acquire);
+            uint64_t begin = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+            size_t first = out.size();
+            for (uint64_t i = begin; i < end; i++)
+                out.push_back(events[i & (TRACE_RING_SIZE - 1)]);
+
+            uint64_t now = head.load(std::memory_order_acquire);
+            if (now >= begin + TRACE_RING_SIZE) {
+                size_t torn = std::min<uint64_t>(now - TRACE_RING_SIZE - begin + 1, end - begin);
+                out.erase(out.begin() + first, out.begin() + first + torn);
+            }
+        }
+};
+
+// Log-scale histogram of durations: 8 buckets per power of two, so percentiles are within 12.5%
+class LatencyHistogram
+{
+    uint64_t counts[512];
+    uint64_t n;
+    int64_t max_ns;
+
+    static int bucket(int64_t ns)
+    {
+        uint64_t v = ns > 0 ? ns : 0;
+        if (v < 8)
+            return v;
+        int e = 63 - __builtin_clzll(v);
+        return (e - 2) * 8 + ((v >> (e - 3)) & 7);
+    }
+
+    static int64_t bucket_floor(int i)
+    {
+        if (i < 8)
+            return i;
+        int e = i / 8 + 2;
+        return (int64_t) (8 + i % 8) << (e - 3);
+    }
+
+    public:
+        LatencyHistogram() : n(0), max_ns(0)
+        {
+            std::fill(counts, counts + 512, 0);
+        }
+
+        void add(int64_t ns)
+        {
+            counts[bucket(ns)]++;
+            n++;
+            max_ns = std::max(max_ns, ns);
+        }
+
+        uint64_t count() const { return n; }
+        int64_t max() const { return max_ns; }
+
+        // p in [0, 1]
+        int64_t percentile(double p) const
+        {
+            if (n == 0)
+                return 0;
+            uint64_t target = (uint64_t) (p * (n - 1)) + 1, seen = 0;
+            for (int i = 0; i < 512; i++) {
+                seen += counts[i];
+                if (seen >= target)
+                    return std::min(bucket_floor(i + 1), max_ns);
+            }
+            return max_ns;
+        }
+};
+
+class Tracer
+{
+    std::mutex m;
+    std::vector<TraceRing*> rings;          // never freed, threads may exit before an export
+    std::set<std::string> names;
+    std::atomic<bool> enabled;
+
+    Tracer() : enabled(true) {}
+
+    static TraceRing*& local_ring()
+    {
+        static thread_local TraceRing* ring = NULL;
+        return ring;
+    }
+
+    public:
+        static Tracer& instance()
+        {
+            static Tracer tracer;
+            return tracer;
+        }
+
+        bool on() const { return enabled.load(std::memory_order_relaxed); }
+        void enable(bool e) { enabled.store(e); }
+
+        // This thread's ring, registered on first use
+        TraceRing* ring()
+        {
+            TraceRing*& r = local_ring();
+            if (r == NULL) {
+                std::lock_guard<std::mutex> lock(m);
+                r = new TraceRing(rings.size() + 1);
+                rings.push_back(r);
+            }
+            return r;
+        }
+
+        // Stable copy of a runtime string, for event and thread names
+        const char* intern(const std::string& s)
+        {
+            std::lock_guard<std::mutex> lock(m);
+            return names.insert(s).first->c_str();
+        }
+
+        // Name shown for the calling thread in the exported trace
+        void name_thread(const std::string& name)
+        {
+            ring()->thread_name = intern(name);
+        }
+
+        // Writes every event still in the rings as Chrome trace JSON. Returns false if the file
+        // cannot be written.
+        bool write_chrome_json(const std::string& path)
+        {
+            FILE* fp = fopen(path.c_str(), "w");
+            if (fp == NULL) {
+                perror("[ERROR] opening the trace file\n");
+                return false;
+            }
+            std::vector<TraceRing*> all = registered();
+            std::vector<TraceEvent> events;
+            bool first = true;
+            fprintf(fp, "{\"traceEvents\":[\n");
+            for (TraceRing* r : all) {
+                if (r->thread_name) {
+                    fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                            first ? "" : ",\n", r->tid, r->thread_name);
+                    first = false;
+                }
+                events.clear();
+                r->snapshot(events);
+                for (const TraceEvent& ev : events) {
+                    fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+                            first ? "" : ",\n", ev.name, r->tid, ev.begin_ns / 1000.0, (ev.end_ns - ev.begin_ns) / 1000.0, ev.frame);
+                    first = false;
+                }
+            }
+            fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+            fclose(fp);
+            return true;
+        }
+
+        // p50/p99/max per event name over the events currently in the rings
+        void print_summary()
+        {
+            std::map<std::string, LatencyHistogram> hist;
+            std::vector<TraceEvent> events;
+            for (TraceRing* r : registered())
+                r->snapshot(events);
+            for (const TraceEvent& ev : events)
+                hist[ev.name].add(ev.end_ns - ev.begin_ns);
+
+            printf("%-20s %8s %10s %10s %10s\n", "event", "count", "p50 (us)", "p99 (us)", "max (us)");
+            for (auto& h : hist)
+                printf("%-20s %8llu %10.1f %10.1f %10.1f\n", h.first.c_str(), (unsigned long long) h.second.count(),
+                       h.second.percentile(0.5) / 1000.0, h.second.percentile(0.99) / 1000.0, h.second.max() / 1000.0);
+        }
+
+    private:
+        std::vector<TraceRing*> registered()
+        {
+            std::lock_guard<std::mutex> lock(m);
+            return rings;
+        }
+};
+
+// Frame id attached to the events of the calling thread
+inline uint32_t& trace_frame()
+{
+    static thread_local uint32_t frame = 0;
+    return frame;
+}
+
+inline void trace_set_frame(uint32_t id)
+{
+    trace_frame() = id;
+}
+
+class TraceScope
+{
+    const char* name;
+    int64_t begin;
+
+    public:
+        TraceScope(const char* n) : name(n), begin(Tracer::instance().on() ? monotonic_ns() : 0) {}
+        ~TraceScope()
+        {
+            if (begin != 0)
+                Tracer::instance().ring()->push(name, begin, monotonic_ns(), trace_frame());
+        }
+};
+
+#ifdef RPL_NO_TRACE
+#define TRACE_SCOPE(name)
+#else
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#endif
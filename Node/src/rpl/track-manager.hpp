@@ -0,0 +1,166 @@
+#pragma once
+// Track lifecycle for the node's tracker (tracker.hpp): birth, M-of-N confirmation, coasting and
+// deletion, the bookkeeping multi_view_track_mgmt_for_calibration.m and track_filtering.m do on
+// MATLAB dictionaries after the fact.
+//
+// Tracks live in a pool whose size is fixed at construction (TrackerConfig::capacity, TRACK_MAX
+// by default). A free list hands out slots and takes them back, a track keeps its slot for its
+// whole life, so the filter state in the tracker's arrays never moves and the slot is a stable
+// handle; the ID given at birth is never reused. live() lists the occupied slots for the loops
+// over tracks. Every track keeps its last TRACK_HISTORY states in a ring of its own, all rings in
+// one array allocated with the pool: memory is fixed however long the node runs, and nothing is
+// allocated per frame.
+//
+// States:
+//  - tentative: born from an unassociated detection. Confirmed once it was detected in M of its
+//    last N frames (confirm_hits of confirm_window), deleted as soon as it no longer can be.
+//  - confirmed: detected in the last frame.
+//  - coasting: a confirmed track missed for up to max_misses frames, predicted only. Reported,
+//    with TrackEstimate::misses telling for how long.
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define TRACK_CONFIRM_WINDOW 5          // N of M-of-N confirmation, 32 at most
+#define TRACK_HISTORY 32                // states kept per track
+
+enum TrackState : uint8_t
+{
+    TRACK_TENTATIVE,
+    TRACK_CONFIRMED,
+    TRACK_COASTING
+};
+
+// One frame of a track
+struct TrackPoint
+{
+    int64_t t_ns;
+    float x, y, vx, vy;
+    float snr;                  // of the last detection
+    int detected;               // 1 if updated in that frame
+};
+
+class TrackManager
+{
+    int confirm_hits, confirm_window, max_misses;
+    uint32_t next_id;
+
+    std::vector<int> free_slots;        // stack
+    std::vector<int> live_slots;        // occupied slots, in no particular order
+    std::vector<int> live_index;        // per slot, its position in live_slots
+    std::vector<uint32_t> ids;
+    std::vector<TrackState> states;
+    std::vector<uint32_t> window;       // detection of the last frames, bit 0 the newest
+    std::vector<int> hits, misses, age;
+    std::vector<TrackPoint> history;    // slot s: [s * TRACK_HISTORY, (s + 1) * TRACK_HISTORY)
+    std::vector<uint32_t> history_count;
+
+    public:
+        TrackManager(int capacity, int m, int n, int coast)
+            : confirm_hits(m), confirm_window(n < 1 ? 1 : n > 32 ? 32 : n), max_misses(coast), next_id(1)
+        {
+            free_slots.reserve(capacity);
+            for (int s = capacity - 1; s >= 0; s--)
+                free_slots.push_back(s);
+            live_slots.reserve(capacity);
+            live_index.resize(capacity, -1);
+            ids.resize(capacity);
+            states.resize(capacity);
+            window.resize(capacity);
+            hits.resize(capacity);
+            misses.resize(capacity);
+            age.resize(capacity);
+            history.resize((size_t) capacity * TRACK_HISTORY);
+            history_count.resize(capacity);
+        }
+
+        // A new tentative track, detected in its first frame. Returns its slot, -1 if the pool is full.
+        int birth()
+        {
+            if (free_slots.empty())
+                return -1;
+            int s = free_slots.back();
+            free_slots.pop_back();
+            live_index[s] = live_slots.size();
+            live_slots.push_back(s);
+            ids[s] = next_id++;
+            window[s] = 1;
+            hits[s] = 1;
+            misses[s] = 0;
+            age[s] = 1;
+            history_count[s] = 0;
+            states[s] = confirm_hits <= 1 ? TRACK_CONFIRMED : TRACK_TENTATIVE;
+            return s;
+        }
+
+        // A frame's outcome for the track in slot s. Returns false if the track ended, its slot
+        // is free again and live() had its last entry moved into the track's place.
+        bool step(int s, bool detected)
+        {
+            age[s]++;
+            window[s] = (window[s] << 1) | (detected ? 1 : 0);
+            if (detected) {
+                hits[s]++;
+                misses[s] = 0;
+            }
+            else {
+                misses[s]++;
+            }
+            if (states[s] == TRACK_TENTATIVE) {
+                int in_window = __builtin_popcount(confirm_window == 32 ? window[s] : window[s] & ((1u << confirm_window) - 1));
+                int left = age[s] < confirm_window ? confirm_window - age[s] : 0;
+                if (in_window >= confirm_hits) {
+                    states[s] = TRACK_CONFIRMED;
+                }
+                else if (in_window + left < confirm_hits) {
+                    release(s);
+                    return false;
+                }
+            }
+            else if (detected) {
+                states[s] = TRACK_CONFIRMED;
+            }
+            else if (misses[s] > max_misses) {
+                release(s);
+                return false;
+            }
+            else {
+                states[s] = TRACK_COASTING;
+            }
+            return true;
+        }
+
+        void release(int s)
+        {
+            int i = live_index[s], last = live_slots.back();
+            live_slots[i] = last;
+            live_index[last] = i;
+            live_slots.pop_back();
+            live_index[s] = -1;
+            free_slots.push_back(s);
+        }
+
+        // Appends the track's state of this frame to its history, the oldest falls out
+        void record(int s, const TrackPoint& p)
+        {
+            history[(size_t) s * TRACK_HISTORY + history_count[s] % TRACK_HISTORY] = p;
+            history_count[s]++;
+        }
+
+        const std::vector<int>& live() const { return live_slots; }
+        int size() const { return live_slots.size(); }
+        uint32_t getId(int s) const { return ids[s]; }
+        TrackState getState(int s) const { return states[s]; }
+        bool reported(int s) const { return states[s] != TRACK_TENTATIVE; }
+        int getHits(int s) const { return hits[s]; }
+        int getMisses(int s) const { return misses[s]; }
+        int getAge(int s) const { return age[s]; }
+
+        // Entries of the track's history, at most TRACK_HISTORY
+        int historySize(int s) const { return history_count[s] < TRACK_HISTORY ? history_count[s] : TRACK_HISTORY; }
+        // k frames back, 0 the newest
+        const TrackPoint& getHistory(int s, int k) const
+        {
+            return history[(size_t) s * TRACK_HISTORY + (history_count[s] - 1 - k) % TRACK_HISTORY];
+        }
+};
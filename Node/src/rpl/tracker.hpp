@@ -0,0 +1,429 @@
+#pragma once
+// Multi-target tracker on the node: the C++ counterpart of detection_tracking.m and ekf_custom.m,
+// run on RangeDoppler's detections as they come instead of offline on a saved detection_log.
+//
+// Each track is an extended Kalman filter in the radar's Cartesian frame (x along boresight,
+// y = range * sin(azimuth), as the fusion server), with a constant velocity [x vx y vy] or a
+// constant acceleration [x vx ax y vy ay] motion model. It is updated with the polar measurement
+// itself (range, azimuth and the range rate of the Doppler bin), linearised at the predicted
+// state, so the Doppler speeds up the velocity estimate from the first update.
+//
+// Tracks live in a structure of arrays of fixed-size Eigen matrices allocated once for
+// TrackerConfig::capacity tracks, so a frame allocates nothing and the prediction and gating loops run over
+// contiguous memory. Association (association.hpp) gates through a grid over the predicted
+// measurements, then solves global nearest neighbour, or JPDA where a track is updated with all
+// its gated detections weighted by their probabilities. A detection starts a track only if it is
+// in no track's gate, so a target two tracks compete for does not spawn a third. Births,
+// M-of-N confirmation, coasting and deletion are track-manager.hpp's, which also owns the slots:
+// a track stays in its slot of the arrays for its whole life.
+//
+// The tracks need not be in the frame of the radar that measures them: with a SensorPose the
+// measurements are those of a radar placed and turned in the tracks' frame, which is how the
+// fusion server (tools/fusion-server) runs the same tracker on every node's detections in the
+// common frame of the self-calibration.
+//
+// Needs Eigen and the frame types only, so tools can run it without the DSP.
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include "radar-config.hpp"
+#include "realtime.hpp"
+#include "radar-frame.hpp"
+#include "association.hpp"
+#include "track-manager.hpp"
+
+#define TRACK_MAX 512                   // tracks the store holds by default, tentative ones included
+#define TRACK_SIGMA_ACC 0.25            // m/s^2, CV process noise (ekf_custom.m)
+#define TRACK_SIGMA_JERK 1.0            // m/s^3, CA process noise
+#define TRACK_SIGMA_RANGE 0.035         // m (detection_tracking.m)
+#define TRACK_SIGMA_AZIMUTH 10.0        // deg
+#define TRACK_SIGMA_RANGE_RATE 0.1      // m/s
+#define TRACK_GATE_CHI2 16.27           // 99.9% of chi-square with 3 degrees of freedom
+#define TRACK_INIT_VEL_VAR 4.0          // (m/s)^2 across the line of sight of a new track
+#define TRACK_INIT_ACC_VAR 4.0          // (m/s^2)^2, CA
+#define TRACK_CONFIRM_HITS 3            // M of M-of-N: updates in the last TRACK_CONFIRM_WINDOW frames to confirm a track
+#define TRACK_MAX_MISSES 10             // frames a confirmed track coasts without an update before it is deleted
+
+enum MotionModel
+{
+    MOTION_CV,              // constant velocity, white acceleration noise
+    MOTION_CA               // constant acceleration, white jerk noise
+};
+
+struct TrackerConfig
+{
+    MotionModel model = MOTION_CV;
+    double sigma_process = TRACK_SIGMA_ACC;     // acceleration (CV) or jerk (CA)
+    double sigma_range = TRACK_SIGMA_RANGE;
+    double sigma_azimuth = TRACK_SIGMA_AZIMUTH;
+    double sigma_range_rate = TRACK_SIGMA_RANGE_RATE;
+    double doppler_step = 0;                    // m/s per Doppler bin, 0 for FrameGeometry::doppler_step(); negative if positive bins approach
+    double gate_chi2 = TRACK_GATE_CHI2;
+    int confirm_hits = TRACK_CONFIRM_HITS;
+    int confirm_window = TRACK_CONFIRM_WINDOW;
+    int max_misses = TRACK_MAX_MISSES;
+    int capacity = TRACK_MAX;                   // track store, allocated once: a full one starts no track
+    AssociationConfig association;
+};
+
+// Position and boresight of the radar whose detections come next, in the frame of the tracks
+// (the node's own tracker keeps the default: tracks in the radar's frame)
+struct SensorPose
+{
+    double x = 0, y = 0;        // m
+    double theta = 0;           // rad, boresight against the x axis
+};
+
+// Runs the tracker of the configured model
+class Tracker
+{
+    public:
+        virtual ~Tracker() {}
+        // One frame of detections at t_ns (any monotonic clock, in frame order)
+        virtual void process(const Detection* dets, int n, int64_t t_ns) = 0;
+        // Copies up to max confirmed and coasting tracks, returns how many
+        virtual int report(TrackEstimate* out, int max) const = 0;
+        // Tracks held, tentative ones included
+        virtual int size() const = 0;
+        // m/s per Doppler bin of the detections to come, when the radar profile changes
+        virtual void setDopplerStep(double step) = 0;
+        virtual double getDopplerStep() const = 0;
+        // Radar of the detections to come, when several feed one tracker
+        virtual void setSensorPose(const SensorPose& p) = 0;
+        // Lifecycle and history of the tracks
+        virtual const TrackManager& manager() const = 0;
+        // Association of the last frame
+        virtual const AssociationStats& associationStats() const = 0;
+};
+
+// K states per axis: 2 for CV (position, velocity), 3 for CA (... acceleration)
+template <int K>
+class EkfTracker : public Tracker
+{
+    static const int N = 2 * K;
+    static const int PX = 0, VX = 1, PY = K, VY = K + 1;
+    typedef Eigen::Matrix<double, N, 1> State;
+    typedef Eigen::Matrix<double, N, N> Cov;
+    typedef Eigen::Matrix<double, 3, N> Jacobian;
+    typedef Eigen::Matrix<double, N, 3> Gain;
+    typedef Eigen::Vector3d Meas;
+    typedef Eigen::Matrix3d MeasCov;
+
+    template <typename T>
+    using Array = std::vector<T, Eigen::aligned_allocator<T>>;
+
+    TrackerConfig cfg;
+    MeasCov R;
+    double doppler_step;
+    SensorPose pose;
+    int64_t t_last_ns;
+
+    // Track store, by slot of the manager
+    TrackManager tracks;
+    Array<State> x;
+    Array<Cov> P;
+    std::vector<float> snr;
+
+    // Per frame, per track in the order of frame_slots (the live slots when the frame came):
+    // predicted measurement, its Jacobian and inverse innovation covariance, and the gate's extent
+    // in range and azimuth for the associator's grid
+    std::vector<int> frame_slots;
+    Array<Meas> z_pred;
+    Array<Jacobian> H;
+    Array<MeasCov> S_inv;
+    std::vector<double> pred_range, pred_azimuth, gate_range, gate_azimuth;
+    std::vector<double> log_norm;       // log of the Gaussian's normalisation, for JPDA's likelihoods
+    std::vector<char> track_used;
+
+    // Per frame, per detection
+    Array<Meas> z;
+    Associator assoc;
+    AssociationStats frame_stats;
+
+    public:
+        EkfTracker(const TrackerConfig& c = TrackerConfig())
+            : cfg(c), doppler_step(c.doppler_step != 0 ? c.doppler_step : FrameGeometry().doppler_step()), t_last_ns(0),
+              tracks(c.capacity, c.confirm_hits, c.confirm_window, c.max_misses), assoc(c.association)
+        {
+            double sa = cfg.sigma_azimuth * M_PI / 180;
+            R = Meas(cfg.sigma_range * cfg.sigma_range, sa * sa, cfg.sigma_range_rate * cfg.sigma_range_rate).asDiagonal();
+            x.resize(cfg.capacity);
+            P.resize(cfg.capacity);
+            snr.resize(cfg.capacity);
+            frame_slots.reserve(cfg.capacity);
+            z_pred.resize(cfg.capacity);
+            H.resize(cfg.capacity);
+            S_inv.resize(cfg.capacity);
+            pred_range.resize(cfg.capacity);
+            pred_azimuth.resize(cfg.capacity);
+            gate_range.resize(cfg.capacity);
+            gate_azimuth.resize(cfg.capacity);
+            log_norm.resize(cfg.capacity);
+            track_used.resize(cfg.capacity);
+            z.reserve(MAX_DETECTIONS);
+        }
+
+        void process(const Detection* dets, int n, int64_t t_ns) override
+        {
+            double dt = t_last_ns > 0 ? (t_ns - t_last_ns) * 1e-9 : 0;
+            t_last_ns = t_ns;
+            if (dt > 0)
+                predict(dt);
+
+            z.resize(n);
+            for (int m = 0; m < n; m++)
+                z[m] = Meas(dets[m].range, dets[m].azimuth * M_PI / 180, dets[m].doppler * doppler_step);
+
+            associate(n);
+            int count = frame_slots.size();
+            for (int t = 0; t < count; t++) {
+                int s = frame_slots[t], m = -1;
+                if (cfg.association.mode == ASSOC_GNN) {
+                    m = assoc.assigned(t);
+                    if (m >= 0)
+                        update(t, s, z[m]);
+                }
+                else if (assoc.pairsBegin(t) != assoc.pairsEnd(t)) {
+                    m = update_jpda(t, s);
+                }
+                // A JPDA track counts as detected when a detection is more likely its than not
+                track_used[t] = m >= 0 && (cfg.association.mode == ASSOC_GNN || assoc.missProbability(t) < 0.5);
+                if (track_used[t])
+                    snr[s] = dets[m].snr;
+            }
+
+            // Ends tracks before starting new ones, so the slots are free
+            for (int t = 0; t < count; t++) {
+                int s = frame_slots[t];
+                if (tracks.step(s, track_used[t]))
+                    record(s, t_ns, track_used[t]);
+            }
+            for (int m = 0; m < n; m++)
+                if (!assoc.gated(m))
+                    start(z[m], dets[m].snr, t_ns);
+        }
+
+        int report(TrackEstimate* out, int max) const override
+        {
+            int k = 0;
+            for (int t : tracks.live()) {
+                if (k >= max)
+                    break;
+                if (!tracks.reported(t))
+                    continue;
+                const State& s = x[t];
+                TrackEstimate& e = out[k++];
+                double r = std::hypot(s(PX), s(PY));
+                e.id = tracks.getId(t);
+                e.x = s(PX);
+                e.y = s(PY);
+                e.vx = s(VX);
+                e.vy = s(VY);
+                e.range = r;
+                e.azimuth = std::atan2(s(PY), s(PX)) * 180 / M_PI;
+                e.range_rate = r > 0 ? (s(PX) * s(VX) + s(PY) * s(VY)) / r : 0;
+                e.var_x = P[t](PX, PX);
+                e.var_y = P[t](PY, PY);
+                e.hits = tracks.getHits(t);
+                e.misses = tracks.getMisses(t);
+            }
+            return k;
+        }
+
+        int size() const override { return tracks.size(); }
+        void setDopplerStep(double step) override { doppler_step = step; }
+        double getDopplerStep() const override { return doppler_step; }
+        void setSensorPose(const SensorPose& p) override { pose = p; }
+        const TrackManager& manager() const override { return tracks; }
+        const AssociationStats& associationStats() const override { return frame_stats; }
+
+    private:
+        // Per axis transition and process noise, the same for x and y
+        void predict(double dt)
+        {
+            Eigen::Matrix<double, K, K> F = Eigen::Matrix<double, K, K>::Identity();
+            Eigen::Matrix<double, K, 1> G;
+            F(0, 1) = dt;
+            if (K == 2) {
+                G(0) = dt * dt / 2;
+                G(1) = dt;
+            }
+            else {
+                F(0, K - 1) = dt * dt / 2;
+                F(1, K - 1) = dt;
+                G(0) = dt * dt * dt / 6;
+                G(1) = dt * dt / 2;
+                G(K - 1) = dt;
+            }
+            Cov Fn = Cov::Zero(), Q = Cov::Zero();
+            Fn.template block<K, K>(0, 0) = F;
+            Fn.template block<K, K>(K, K) = F;
+            Eigen::Matrix<double, K, K> q = cfg.sigma_process * cfg.sigma_process * G * G.transpose();
+            Q.template block<K, K>(0, 0) = q;
+            Q.template block<K, K>(K, K) = q;
+            for (int t : tracks.live()) {
+                x[t] = Fn * x[t];
+                P[t] = Fn * P[t] * Fn.transpose() + Q;
+            }
+        }
+
+        // h(x) = [range, azimuth, range rate] seen from the sensor, and its Jacobian (the pose
+        // only shifts the position and the azimuth, the derivatives stay those at the origin)
+        void measure(const State& s, Meas& h, Jacobian& J) const
+        {
+            double px = s(PX) - pose.x, py = s(PY) - pose.y, vx = s(VX), vy = s(VY);
+            double r2 = std::max(px * px + py * py, 1e-6), r = std::sqrt(r2);
+            double rr = (px * vx + py * vy) / r;
+            h = Meas(r, std::remainder(std::atan2(py, px) - pose.theta, 2 * M_PI), rr);
+            J.setZero();
+            J(0, PX) = px / r;
+            J(0, PY) = py / r;
+            J(1, PX) = -py / r2;
+            J(1, PY) = px / r2;
+            double cross = (vx * py - vy * px) / (r2 * r);
+            J(2, PX) = py * cross;
+            J(2, PY) = -px * cross;
+            J(2, VX) = px / r;
+            J(2, VY) = py / r;
+        }
+
+        static Meas innovation(const Meas& zm, const Meas& h)
+        {
+            Meas nu = zm - h;
+            nu(1) = std::remainder(nu(1), 2 * M_PI);
+            return nu;
+        }
+
+        // Gates the detections against the tracks whose gate box holds them and solves the
+        // assignment. The box is the gate ellipsoid's extent along range and azimuth.
+        void associate(int n)
+        {
+            const AssociationConfig& a = cfg.association;
+            frame_slots.assign(tracks.live().begin(), tracks.live().end());
+            int count = frame_slots.size();
+            for (int t = 0; t < count; t++) {
+                int s = frame_slots[t];
+                measure(x[s], z_pred[t], H[t]);
+                MeasCov S = H[t] * P[s] * H[t].transpose() + R;
+                S_inv[t] = S.inverse();
+                pred_range[t] = z_pred[t](0);
+                pred_azimuth[t] = z_pred[t](1);
+                gate_range[t] = std::sqrt(cfg.gate_chi2 * S(0, 0));
+                gate_azimuth[t] = std::sqrt(cfg.gate_chi2 * S(1, 1));
+                log_norm[t] = std::log(a.pd) - 1.5 * std::log(2 * M_PI) - 0.5 * std::log(S.determinant()) - std::log(a.clutter_density);
+            }
+            assoc.index(pred_range.data(), pred_azimuth.data(), gate_range.data(), gate_azimuth.data(), count);
+            for (int m = 0; m < n; m++) {
+                // Azimuths of the predictions are in (-pi, pi], a detection's too
+                assoc.candidates(z[m](0), z[m](1), [&](int t) {
+                    Meas nu = innovation(z[m], z_pred[t]);
+                    double d2 = nu.dot(S_inv[t] * nu);
+                    if (d2 < cfg.gate_chi2)
+                        assoc.add(t, m, d2, log_norm[t] - d2 / 2);
+                });
+            }
+            assoc.solve(count, n);
+            frame_stats = assoc.getStats();
+        }
+
+        // Joseph form, keeps P symmetric and positive definite. t indexes this frame's arrays, s
+        // is the track's slot.
+        void update(int t, int s, const Meas& zm)
+        {
+            Meas nu = innovation(zm, z_pred[t]);
+            Gain Kg = P[s] * H[t].transpose() * S_inv[t];
+            x[s] += Kg * nu;
+            Cov A = Cov::Identity() - Kg * H[t];
+            P[s] = A * P[s] * A.transpose() + Kg * R * Kg.transpose();
+        }
+
+        // PDA update with the track's gated detections: the combined innovation, and the covariance
+        // of the "no detection" case, the updated one and the spread of the innovations. Returns
+        // the most probable detection.
+        int update_jpda(int t, int s)
+        {
+            Meas nu = Meas::Zero();
+            MeasCov spread = MeasCov::Zero();
+            double beta_sum = 0, best = -1;
+            int m = -1;
+            for (const AssocPair* q = assoc.pairsBegin(t); q != assoc.pairsEnd(t); q++) {
+                Meas nu_m = innovation(z[q->m], z_pred[t]);
+                nu += q->beta * nu_m;
+                spread += q->beta * nu_m * nu_m.transpose();
+                beta_sum += q->beta;
+                if (q->beta > best) {
+                    best = q->beta;
+                    m = q->m;
+                }
+            }
+            Gain Kg = P[s] * H[t].transpose() * S_inv[t];
+            x[s] += Kg * nu;
+            Cov A = Cov::Identity() - Kg * H[t];
+            Cov updated = A * P[s] * A.transpose() + Kg * R * Kg.transpose();
+            P[s] = (1 - beta_sum) * P[s] + beta_sum * updated + Kg * (spread - nu * nu.transpose()) * Kg.transpose();
+            return m;
+        }
+
+        // A track at the detection: position and range rate measured, the velocity across the line
+        // of sight (and the acceleration) unknown
+        void start(const Meas& zm, float s, int64_t t_ns)
+        {
+            int t = tracks.birth();
+            if (t < 0) {
+                frame_stats.births_dropped++;
+                return;
+            }
+            double r = zm(0), c = std::cos(zm(1) + pose.theta), sn = std::sin(zm(1) + pose.theta);
+            x[t].setZero();
+            x[t](PX) = pose.x + r * c;
+            x[t](PY) = pose.y + r * sn;
+            x[t](VX) = zm(2) * c;
+            x[t](VY) = zm(2) * sn;
+            Eigen::Matrix2d rot;
+            rot << c, -sn, sn, c;
+            Eigen::Matrix2d pos = rot * Eigen::Vector2d(R(0, 0), r * r * R(1, 1)).asDiagonal() * rot.transpose();
+            Eigen::Matrix2d vel = rot * Eigen::Vector2d(R(2, 2), TRACK_INIT_VEL_VAR).asDiagonal() * rot.transpose();
+            Cov& p = P[t];
+            p.setZero();
+            const int pi[2] = {PX, PY}, vi[2] = {VX, VY};
+            for (int a = 0; a < 2; a++) {
+                for (int b = 0; b < 2; b++) {
+                    p(pi[a], pi[b]) = pos(a, b);
+                    p(vi[a], vi[b]) = vel(a, b);
+                }
+            }
+            if (K == 3) {
+                p(K - 1, K - 1) = TRACK_INIT_ACC_VAR;
+                p(N - 1, N - 1) = TRACK_INIT_ACC_VAR;
+            }
+            snr[t] = s;
+            record(t, t_ns, true);
+        }
+
+        void record(int t, int64_t t_ns, bool detected)
+        {
+            const State& s = x[t];
+            tracks.record(t, {t_ns, (float) s(PX), (float) s(PY), (float) s(VX), (float) s(VY), snr[t], detected ? 1 : 0});
+        }
+};
+
+inline std::unique_ptr<Tracker> make_tracker(const TrackerConfig& cfg)
+{
+    if (cfg.model == MOTION_CA)
+        return std::unique_ptr<Tracker>(new EkfTracker<3>(cfg));
+    return std::unique_ptr<Tracker>(new EkfTracker<2>(cfg));
+}
+
+inline bool parse_motion_model(const std::string& s, MotionModel& m)
+{
+    if (s == "cv")
+        m = MOTION_CV;
+    else if (s == "ca")
+        m = MOTION_CA;
+    else
+        return false;
+    return true;
+}
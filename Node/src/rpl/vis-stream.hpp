@@ -0,0 +1,241 @@
+#pragma once
+// Off-screen output for the Visualizer on nodes without a display.
+//
+// The rendered canvas is handed over with submit() and encoded on a thread of its own: as MJPEG
+// (multipart/x-mixed-replace over HTTP, opens in a browser or with ffplay/vlc) for clients of a
+// TCP port, and/or into a video file. submit() only copies the canvas into a keep-latest slot, a
+// canvas the encoder has not picked up yet is replaced (counted as skipped), so a slow client or
+// disk never holds up the caller.
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <opencv2/opencv.hpp>
+
+#define VIS_STREAM_QUALITY 80           // JPEG quality
+#define VIS_STREAM_MAX_CLIENTS 8
+#define VIS_STREAM_SEND_TIMEOUT_MS 1000 // a client this far behind is dropped
+
+class VisStream
+{
+    int listen_fd;
+    std::vector<int> clients;           // encoder thread only
+    cv::VideoWriter writer;
+    std::string video_path;             // set before start()
+    double video_fps;
+    std::atomic<bool> recording;        // cleared by the encoder when the file cannot be opened
+
+    std::thread encoder;
+    std::atomic<bool> running;
+    std::mutex m;
+    std::condition_variable ready;
+    cv::Mat pending;                    // newest canvas not yet encoded, under m
+    bool has_pending;
+    std::atomic<int> num_clients;
+
+    std::atomic<uint64_t> submitted, encoded, skipped;
+
+    public:
+        VisStream() : listen_fd(-1), video_fps(0), recording(false), running(false), has_pending(false), num_clients(0),
+                      submitted(0), encoded(0), skipped(0) {}
+
+        ~VisStream()
+        {
+            stop();
+        }
+
+        // Serves MJPEG on addr:port (127.0.0.1 keeps it local, e.g. behind an ssh tunnel)
+        bool serve(int port, const std::string& addr = "127.0.0.1")
+        {
+            listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (listen_fd < 0) {
+                perror("[ERROR] creating the stream socket\n");
+                return false;
+            }
+            int one = 1;
+            setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            struct sockaddr_in sa;
+            memset(&sa, 0, sizeof(sa));
+            sa.sin_family = AF_INET;
+            sa.sin_port = htons(port);
+            if (inet_pton(AF_INET, addr.c_str(), &sa.sin_addr) != 1) {
+                fprintf(stderr, "Error: bad stream address '%s'\n", addr.c_str());
+                close(listen_fd);
+                listen_fd = -1;
+                return false;
+            }
+            if (bind(listen_fd, (struct sockaddr*) &sa, sizeof(sa)) != 0 || ::listen(listen_fd, 4) != 0) {
+                perror("[ERROR] binding the stream socket\n");
+                close(listen_fd);
+                listen_fd = -1;
+                return false;
+            }
+            fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+            printf("Visualizer stream on http://%s:%d/\n", addr.c_str(), port);
+            return true;
+        }
+
+        // Records into a video file (MJPG in AVI) at a nominal fps. The file is opened with the
+        // first canvas, whose size it takes.
+        void record(const std::string& path, double fps)
+        {
+            video_path = path;
+            video_fps = fps > 0 ? fps : 10;
+            recording = !path.empty();
+        }
+
+        void start()
+        {
+            if (running || (listen_fd < 0 && !recording))
+                return;
+            running = true;
+            encoder = std::thread(&VisStream::encode_loop, this);
+        }
+
+        void stop()
+        {
+            if (running) {
+                {
+                    std::lock_guard<std::mutex> lock(m);
+                    running = false;
+                }
+                ready.notify_one();
+                encoder.join();
+                printf("Visualizer stream: %llu canvases encoded, %llu skipped\n",
+                       (unsigned long long) encoded.load(), (unsigned long long) skipped.load());
+            }
+            for (int fd : clients)
+                close(fd);
+            clients.clear();
+            if (listen_fd >= 0)
+                close(listen_fd);
+            listen_fd = -1;
+            if (writer.isOpened())
+                writer.release();
+        }
+
+        // True when a submitted canvas would go anywhere
+        bool active() const
+        {
+            return running && (num_clients > 0 || recording);
+        }
+
+        // Copies the canvas for the encoder, replacing one it has not taken yet
+        void submit(const cv::Mat& canvas)
+        {
+            submitted++;
+            {
+                std::lock_guard<std::mutex> lock(m);
+                if (has_pending)
+                    skipped++;
+                canvas.copyTo(pending);
+                has_pending = true;
+            }
+            ready.notify_one();
+        }
+
+    private:
+        void encode_loop()
+        {
+            Tracer::instance().name_thread("vis stream");
+            cv::Mat canvas;
+            std::vector<unsigned char> jpeg;
+            std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, VIS_STREAM_QUALITY};
+            for (;;) {
+                bool fresh;
+                {
+                    // Wakes now and then without a canvas to take new clients
+                    std::unique_lock<std::mutex> lock(m);
+                    ready.wait_for(lock, std::chrono::milliseconds(100), [this] { return !running || has_pending; });
+                    if (!running)
+                        return;
+                    fresh = has_pending;
+                    if (fresh)
+                        cv::swap(canvas, pending);      // both buffers are reused
+                    has_pending = false;
+                }
+                accept_clients();
+                if (!fresh)
+                    continue;
+
+                if (recording) {
+                    if (!writer.isOpened() &&
+                        !writer.open(video_path, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), video_fps, canvas.size())) {
+                        fprintf(stderr, "Error: cannot record the visualizer to %s\n", video_path.c_str());
+                        recording = false;
+                    }
+                    if (writer.isOpened())
+                        writer.write(canvas);
+                }
+                if (!clients.empty()) {
+                    TRACE_SCOPE("vis jpeg");
+                    cv::imencode(".jpg", canvas, jpeg, params);
+                    send_part(jpeg);
+                }
+                encoded++;
+            }
+        }
+
+        void accept_clients()
+        {
+            if (listen_fd < 0)
+                return;
+            int fd;
+            while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+                if (clients.size() >= VIS_STREAM_MAX_CLIENTS) {
+                    close(fd);
+                    continue;
+                }
+                struct timeval tv = {VIS_STREAM_SEND_TIMEOUT_MS / 1000, (VIS_STREAM_SEND_TIMEOUT_MS % 1000) * 1000};
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+                // The request is not parsed, every client gets the stream
+                static const char header[] = "HTTP/1.0 200 OK\r\nCache-Control: no-cache\r\n"
+                                             "Content-Type: multipart/x-mixed-replace; boundary=frame\r\n\r\n";
+                if (send_all(fd, header, sizeof(header) - 1))
+                    clients.push_back(fd);
+                else
+                    close(fd);
+            }
+            num_clients = clients.size();
+        }
+
+        // Sends one JPEG to every client, dropping those that fail or time out
+        void send_part(const std::vector<unsigned char>& jpeg)
+        {
+            char header[128];
+            int n = snprintf(header, sizeof(header), "--frame\r\nContent-Type: image/jpeg\r\nContent-Length: %zu\r\n\r\n", jpeg.size());
+            for (size_t i = 0; i < clients.size();) {
+                int fd = clients[i];
+                if (send_all(fd, header, n) && send_all(fd, jpeg.data(), jpeg.size()) && send_all(fd, "\r\n", 2)) {
+                    i++;
+                    continue;
+                }
+                close(fd);
+                clients.erase(clients.begin() + i);
+            }
+            num_clients = clients.size();
+        }
+
+        static bool send_all(int fd, const void* data, size_t len)
+        {
+            const char* p = static_cast<const char*>(data);
+            while (len > 0) {
+                ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+                if (n <= 0)
+                    return false;
+                p += n;
+                len -= n;
+            }
+            return true;
+        }
+};
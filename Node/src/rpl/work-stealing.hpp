@@ -0,0 +1,148 @@
+#pragma once
+// Work-stealing thread pool.
+//
+// Every worker owns a task deque. A task submitted from a worker goes onto that worker's deque
+// and is popped LIFO (its data is still in cache), tasks from other threads are spread round
+// robin. An idle worker steals the oldest task of another worker before going to sleep.
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class WorkStealingExecutor
+{
+    struct Worker
+    {
+        std::deque<std::function<void()>> tasks;
+        std::mutex m;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::atomic<int> pending;               // submitted but not yet picked up
+    std::atomic<bool> running;
+    std::atomic<unsigned> next_worker;
+    std::atomic<uint64_t> steals;
+    std::mutex sleep_m;
+    std::condition_variable sleep_cv;
+    std::function<void(int)> on_start;
+
+    // Worker index of the calling thread in the executor it belongs to, -1 elsewhere
+    static int& current_index()
+    {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    static WorkStealingExecutor*& current_owner()
+    {
+        static thread_local WorkStealingExecutor* owner = NULL;
+        return owner;
+    }
+
+    public:
+        // on_start(i) runs first thing on worker i, e.g. to pin it (realtime.hpp)
+        WorkStealingExecutor(int n, std::function<void(int)> init = nullptr)
+            : pending(0), running(true), next_worker(0), steals(0), on_start(init)
+        {
+            if (n < 1)
+                n = 1;
+            for (int i = 0; i < n; i++)
+                workers.emplace_back(new Worker());
+            for (int i = 0; i < n; i++)
+                threads.emplace_back(&WorkStealingExecutor::loop, this, i);
+        }
+
+        ~WorkStealingExecutor()
+        {
+            stop();
+        }
+
+        // Joins the workers. Tasks that have not started are dropped.
+        void stop()
+        {
+            if (!running.exchange(false))
+                return;
+            {
+                std::lock_guard<std::mutex> lock(sleep_m);
+            }
+            sleep_cv.notify_all();
+            for (auto& t : threads)
+                t.join();
+            for (auto& w : workers)
+                w->tasks.clear();
+        }
+
+        void submit(std::function<void()> task)
+        {
+            int i;
+            if (current_owner() == this)
+                i = current_index();
+            else
+                i = next_worker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+            {
+                std::lock_guard<std::mutex> lock(workers[i]->m);
+                workers[i]->tasks.push_back(std::move(task));
+            }
+            pending.fetch_add(1);
+            {
+                std::lock_guard<std::mutex> lock(sleep_m);     // pairs with the predicate check in loop()
+            }
+            sleep_cv.notify_one();
+        }
+
+        int size() const { return workers.size(); }
+        uint64_t getSteals() const { return steals.load(); }
+
+    private:
+        bool pop_local(int i, std::function<void()>& task)
+        {
+            std::lock_guard<std::mutex> lock(workers[i]->m);
+            if (workers[i]->tasks.empty())
+                return false;
+            task = std::move(workers[i]->tasks.back());
+            workers[i]->tasks.pop_back();
+            return true;
+        }
+
+        bool steal(int i, std::function<void()>& task)
+        {
+            int n = workers.size();
+            for (int k = 1; k < n; k++) {
+                Worker& victim = *workers[(i + k) % n];
+                std::lock_guard<std::mutex> lock(victim.m);
+                if (victim.tasks.empty())
+                    continue;
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                steals.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+            return false;
+        }
+
+        void loop(int i)
+        {
+            current_index() = i;
+            current_owner() = this;
+            Tracer::instance().name_thread("worker " + std::to_string(i));
+            if (on_start)
+                on_start(i);
+            std::function<void()> task;
+            while (running) {
+                if (pop_local(i, task) || steal(i, task)) {
+                    pending.fetch_sub(1);
+                    task();
+                    task = nullptr;
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(sleep_m);
+                sleep_cv.wait(lock, [this] { return !running || pending.load() > 0; });
+            }
+        }
+};
@@ -37,8 +37,8 @@ int main()
     // daq.create_bind_socket(); // open the socket for listening
     vis.setWaitTime(1);   
 
-    std::cout << "FRAME --> DAQ: " << *frame_daq << std::endl;
-    std::cout << "FRAME --> RDM: "<< *frame_rdm << std::endl;
+    std::cout << "FRAME --> DAQ: " << frame_daq->load() << std::endl;
+    std::cout << "FRAME --> RDM: "<< frame_rdm->load() << std::endl;
     // std::cout << "FRAME --> VIS: "<< *frame_vis << std::endl;
 
     thread daqThread(&DataAcquisition::iteration, &daq);
@@ -0,0 +1,45 @@
+// g++ -std=c++14 -Wall -Wextra -pedantic -I../../src/ -o test test.cpp -lfftw3f -pthread -lm `pkg-config --cflags --libs opencv4`; ./test [pipeline.cfg]
+// kill -USR1 <pid> writes the last few seconds of stage timings to trace.json (open in ui.perfetto.dev)
+#include "../src/rpl/private-header.hpp"
+#include <signal.h>
+#define RADAR_CONFIG "../../setup_radar/mmwaveconfig.txt"   // same file setup_radar programs the AWR2243 with
+#define PIPELINE_CONFIG "pipeline.cfg"
+#define TRACE_FILE "trace.json"
+
+static volatile sig_atomic_t dump_trace = 0;
+
+static void on_sigusr1(int)
+{
+    dump_trace = 1;
+}
+
+int main(int argc, char* argv[])
+{
+    // FRAME GEOMETRY (falls back to the compile-time defaults if the config can't be read)
+    FrameGeometry geom;
+    load_mmwave_config(RADAR_CONFIG, geom);
+    print_geometry(geom);
+
+    // GRAPH FROM CONFIG
+    Pipeline pipeline;
+    if (!build_pipeline(argc > 1 ? argv[1] : PIPELINE_CONFIG, geom, pipeline))
+        return 1;
+    signal(SIGUSR1, on_sigusr1);
+    if (!pipeline.start())
+        return 1;
+
+    // Stages run on their own threads, the main thread only reports
+    int ticks = 0;
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (dump_trace) {
+            dump_trace = 0;
+            if (Tracer::instance().write_chrome_json(TRACE_FILE))
+                printf("Trace written to %s\n", TRACE_FILE);
+        }
+        if (++ticks % 50 == 0)
+            pipeline.printStats();
+    }
+
+    return 0;
+}
@@ -6,13 +6,13 @@
 int main()
 {   
     // Upstream frame count
-    uint inputframe = 0;
-    int inputbuffer[INPUT_SIZE];
+    FrameSignal inputframe;
+    float inputbuffer[INPUT_SIZE];
 
-    uint* in_frameptr = &inputframe;
-    int* in_bufferptr = inputbuffer;
+    FrameSignal* in_frameptr = &inputframe;
+    float* in_bufferptr = inputbuffer;
 
-    cout << "Upstream frame: " << inputframe << endl;
+    cout << "Upstream frame: " << inputframe.load() << endl;
     cout << "Address: " << in_frameptr << endl;
     cout << "\n" << endl;
 
@@ -24,8 +24,8 @@ int main()
     obj.setFramePointer(in_frameptr);
 
     // Pass to next block
-    int* out_bufferptr = obj.getBufferPointer();
-    uint* out_frameptr = obj.getFramePointer();
+    float* out_bufferptr = obj.getBufferPointer();
+    FrameSignal* out_frameptr = obj.getFramePointer();
 
     cout << "Output buffer address: " << out_bufferptr << endl;
     cout << "\n" << endl;
@@ -33,10 +33,14 @@ int main()
     // Multi-threading this block
     thread myThread(&RadarBlock::iteration, &obj);
 
-    // Incrementing the upstream frame
-    inputframe++;
+    // Incrementing the upstream frame, the block sleeps in between and reports its wake-up latency
+    for (int i = 0; i < 200; i++)
+    {
+        this_thread::sleep_for(chrono::milliseconds(5));
+        inputframe.publish();
+    }
 
-    cout << "Upstream frame: " << inputframe << endl;
+    cout << "Upstream frame: " << inputframe.load() << endl;
     cout << "Address: " << in_frameptr << endl;
     cout << "\n" << endl;
 
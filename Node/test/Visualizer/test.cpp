@@ -4,7 +4,7 @@
 #define OUTPUT_SIZE 0
 
 // Changing the buffer and increasing frame
-void updateBuffer(int* bufferptr, uint* frameptr)
+void updateBuffer(int* bufferptr, FrameSignal* frameptr)
 {
     for(;;)
     {
@@ -13,17 +13,17 @@ void updateBuffer(int* bufferptr, uint* frameptr)
             bufferptr[i] = rand() % 256; // Generate a random number between 0 and 255
         }
 
-        (*frameptr)++;
+        frameptr->publish();
     }
 }
 
 int main()
 {   
     // Upstream frame count
-    uint inputframe = 0;
+    FrameSignal inputframe;
     int inputbuffer[INPUT_SIZE];
 
-    uint* in_frameptr = &inputframe;
+    FrameSignal* in_frameptr = &inputframe;
     int* in_bufferptr = inputbuffer;
 
     // New block
@@ -2,6 +2,7 @@
 #include "../src/rpl/private-header.hpp"
 #define INPUT_SIZE 64 * 512
 #define OUTPUT_SIZE 0
+#define RADAR_CONFIG "../../setup_radar/mmwaveconfig.txt"   // same file setup_radar programs the AWR2243 with
 
 using namespace std;
 using namespace std::chrono;
@@ -9,34 +10,25 @@ using namespace std::chrono;
 int main(int argc, char* argv[])
 {   
 
+    // FRAME GEOMETRY (falls back to the compile-time defaults if the config can't be read)
+    FrameGeometry geom;
+    load_mmwave_config(RADAR_CONFIG, geom);
+    RadarConfigWatcher config_watcher(RADAR_CONFIG);
+
     // CONSTRUCTOR INITIATION
-    DataAcquisition daq;
+    DataAcquisition daq(geom);
 
-    RangeDoppler rdm("blackman");
+    RangeDoppler rdm("blackman", geom);
 
     Visualizer vis(INPUT_SIZE,OUTPUT_SIZE);
+    vis.setGeometry(geom);
 	JSON_TCP client_p;
 
-    // BUFFER POINTER INITIATION
-    uint16_t *in_bufferptr    = daq.getBufferPointer();
-    float    *in_visualizeptr = rdm.getBufferPointer();
-    float    *ang_visualizeptr = rdm.getAngleBufferPointer();
-    int      *angidx_visptr = rdm.getAngleIndexPointer();
-    float    *range_visualizeptr = rdm.getRangeBufferPointer();
-    float    *angleMap_ptr = rdm.getAngleMapPointer();
-    
-    rdm.setBufferPointer(in_bufferptr);
-    vis.setBufferPointer(in_visualizeptr);
-    vis.setAngleBufferPointer(ang_visualizeptr);
-    vis.setAngleIndexPointer(angidx_visptr);
-    vis.setRangeBufferPointer(range_visualizeptr);
-    vis.setAngleMapPointer(angleMap_ptr);
-
-    // FRAME POINTER INITIATION
-    auto frame_daq = daq.getFramePointer();
-    rdm.setFramePointer(frame_daq);
-    auto frame_rdm = rdm.getFramePointer();
-    daq.setFramePointer(frame_rdm);
+    // FRAME INITIATION
+    // Frames (ADC cube, RDM, detections) flow DAQ -> RDM -> VIS, pooled and reference counted
+    rdm.setInputBlock(&daq);
+    vis.setInputBlock(&rdm);
+    daq.setFramePointer(rdm.getFramePointer());
     // OTHER PARAMS
     if (argc > 1){
         if(argc != 3){
@@ -59,10 +51,18 @@ int main(int argc, char* argv[])
 		auto start_demo = chrono::high_resolution_clock::now();
 		rdm.process();
 		while(frame < num_frames) {
+			// Follow radar profile changes without restarting
+			if (config_watcher.poll(geom)) {
+				daq.setGeometry(geom);     // RangeDoppler picks the new geometry up from the frames
+				vis.setGeometry(geom);
+			}
 			daq.process();
 			rdm.process();
-			frame_angle = *ang_visualizeptr;
-			frame_range = *range_visualizeptr;
+			FrameRef result = rdm.getOutputFrame();
+			if (result && result->num_detections > 0) {
+				frame_angle = result->detections[0].azimuth;
+				frame_range = result->detections[0].range;
+			}
 			vis.process();
 			client_p.process(frame_angle, frame_range, start_demo);
 			frame++;
@@ -0,0 +1,269 @@
+// Offline batch processor for recorded DCA1000 captures.
+//
+// make; ./batch [-c mmwaveconfig.txt] [-j threads] [-w blackman|hann] [-o outdir] [-n chunk] [-t] <capture dir>
+//
+// Every *.bin in the directory is one capture, frames back to back as the DCA1000 writes them.
+// <name>_Raw_0.bin, <name>_Raw_1.bin, ... are segments of one capture and are read in order.
+// Captures are cut into chunks of frames that run on all cores with the node's RangeDoppler DSP.
+// A chunk first computes the map of the frame before it (the CFAR background of its first frame),
+// so the detections are the same as processing the capture frame by frame.
+// Writes <outdir>/<name>.det per capture, a columnar log (src/rpl/detection-log.hpp).
+#include "../../src/rpl/private-header.hpp"
+#include <dirent.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/resource.h>
+#define RADAR_CONFIG "../../setup_radar/mmwaveconfig.txt"   // same file setup_radar programs the AWR2243 with
+#define DEFAULT_CHUNK 64                                    // frames per work item
+
+struct Segment
+{
+    std::string path;
+    int fd;
+    uint64_t bytes;
+};
+
+struct Capture
+{
+    std::string name;
+    std::vector<Segment> segments;      // in recording order
+    uint64_t frames;
+};
+
+// Frames [begin, end) of one capture and their results
+struct Chunk
+{
+    Capture* cap;
+    uint64_t begin, end;
+    std::vector<int> counts;            // detections per frame
+    std::vector<Detection> dets;
+};
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [-c mmwaveconfig.txt] [-j threads] [-w blackman|hann] [-o outdir] [-n chunk] [-t] <capture dir>\n", prog);
+}
+
+// Groups the *.bin files of dir into captures, sorted by name
+static bool find_captures(const std::string& dir, std::vector<Capture>& captures)
+{
+    DIR* d = opendir(dir.c_str());
+    if (d == NULL) {
+        perror("[ERROR] opening the capture directory\n");
+        return false;
+    }
+    std::map<std::string, std::map<int, std::string>> files;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        std::string file = entry->d_name;
+        if (file.size() <= 4 || file.compare(file.size() - 4, 4, ".bin") != 0)
+            continue;
+        std::string name = file.substr(0, file.size() - 4);
+        int segment = 0;
+        size_t raw = name.rfind("_Raw_");
+        if (raw != std::string::npos && sscanf(name.c_str() + raw, "_Raw_%d", &segment) == 1)
+            name.erase(raw);
+        files[name][segment] = dir + "/" + file;
+    }
+    closedir(d);
+
+    for (auto& f : files) {
+        Capture cap;
+        cap.name = f.first;
+        uint64_t bytes = 0;
+        for (auto& seg : f.second) {
+            Segment s;
+            s.path = seg.second;
+            s.fd = open(s.path.c_str(), O_RDONLY);
+            struct stat st;
+            if (s.fd < 0 || fstat(s.fd, &st) != 0) {
+                perror(("[ERROR] opening " + s.path + "\n").c_str());
+                return false;
+            }
+            s.bytes = st.st_size;
+            bytes += s.bytes;
+            cap.segments.push_back(s);
+        }
+        captures.push_back(cap);
+        captures.back().frames = bytes;     // converted to frames once the geometry is known
+    }
+    return true;
+}
+
+// Copies frame k of the capture into dst, across segment boundaries
+static bool read_frame(const Capture& cap, uint64_t k, uint64_t frame_bytes, uint16_t* dst)
+{
+    uint64_t offset = k * frame_bytes;
+    uint64_t left = frame_bytes;
+    char* out = reinterpret_cast<char*>(dst);
+    for (const Segment& s : cap.segments) {
+        if (offset >= s.bytes) {
+            offset -= s.bytes;
+            continue;
+        }
+        while (left > 0 && offset < s.bytes) {
+            ssize_t n = pread(s.fd, out, std::min(left, s.bytes - offset), offset);
+            if (n <= 0)
+                return false;
+            out += n;
+            left -= n;
+            offset += n;
+        }
+        if (left == 0)
+            return true;
+        offset = 0;
+    }
+    return left == 0;
+}
+
+// Worker loop: takes chunks until none are left. Two pooled frames are enough, the current one
+// and the previous one whose map is the CFAR background.
+static void process_chunks(int index, RangeDoppler* lane, const FrameGeometry& g, std::vector<Chunk>& chunks,
+                           std::atomic<size_t>& next, std::atomic<bool>& failed)
+{
+    Tracer::instance().name_thread("batch " + std::to_string(index));
+    FramePool pool(g, 2);
+    size_t i;
+    while (!failed && (i = next.fetch_add(1)) < chunks.size()) {
+        Chunk& c = chunks[i];
+        FrameRef prev;
+        for (uint64_t k = c.begin > 0 ? c.begin - 1 : 0; k < c.end; k++) {
+            FrameRef f = pool.acquire();
+            if (!read_frame(*c.cap, k, g.bytes_in_frame(), f->adc)) {
+                fprintf(stderr, "Error: %s: cannot read frame %llu\n", c.cap->name.c_str(), (unsigned long long) k + 1);
+                failed = true;
+                return;
+            }
+            f->id = k + 1;
+            lane->process_rdm(f.get());
+            if (k >= c.begin) {
+                lane->process_detect(f.get(), prev ? prev->rdm : NULL);
+                c.counts.push_back(f->num_detections);
+                c.dets.insert(c.dets.end(), f->detections, f->detections + f->num_detections);
+            }
+            prev = std::move(f);
+        }
+    }
+}
+
+static double cpu_seconds()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string config = RADAR_CONFIG, outdir = ".";
+    const char* window = "blackman";
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    int chunk_frames = DEFAULT_CHUNK;
+    bool trace_summary = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:j:w:o:n:t")) != -1) {
+        switch (opt) {
+            case 'c': config = optarg; break;
+            case 'j': threads = std::max(1, atoi(optarg)); break;
+            case 'w': window = strcmp(optarg, "hann") == 0 ? "hann" : "blackman"; break;   // RangeDoppler keeps the pointer
+            case 'o': outdir = optarg; break;
+            case 'n': chunk_frames = std::max(1, atoi(optarg)); break;
+            case 't': trace_summary = true; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // FRAME GEOMETRY (falls back to the compile-time defaults if the config can't be read)
+    FrameGeometry geom;
+    load_mmwave_config(config, geom);
+    print_geometry(geom);
+    uint64_t frame_bytes = geom.bytes_in_frame();
+
+    // CAPTURES -> CHUNKS
+    std::vector<Capture> captures;
+    if (!find_captures(argv[optind], captures))
+        return 1;
+    if (captures.empty()) {
+        fprintf(stderr, "Error: no .bin captures in %s\n", argv[optind]);
+        return 1;
+    }
+    std::vector<Chunk> chunks;
+    uint64_t total_frames = 0;
+    for (Capture& cap : captures) {
+        uint64_t bytes = cap.frames;
+        cap.frames = bytes / frame_bytes;
+        if (bytes % frame_bytes)
+            fprintf(stderr, "Warning: %s ends with a partial frame (%llu bytes), ignored\n", cap.name.c_str(),
+                    (unsigned long long) (bytes % frame_bytes));
+        for (uint64_t b = 0; b < cap.frames; b += chunk_frames) {
+            Chunk c;
+            c.cap = &cap;
+            c.begin = b;
+            c.end = std::min(cap.frames, b + chunk_frames);
+            chunks.push_back(c);
+        }
+        total_frames += cap.frames;
+    }
+    threads = std::min<int>(threads, std::max<size_t>(chunks.size(), 1));
+    if (mkdir(outdir.c_str(), 0755) != 0 && errno != EEXIST) {
+        perror("[ERROR] creating the output directory\n");
+        return 1;
+    }
+
+    // One DSP lane per thread, created here because the FFTW planner is not thread safe
+    std::vector<std::unique_ptr<RangeDoppler>> lanes;
+    for (int i = 0; i < threads; i++)
+        lanes.emplace_back(new RangeDoppler(window, geom));
+
+    // PROCESS
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    int64_t t0 = monotonic_ns();
+    double cpu0 = cpu_seconds();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++)
+        workers.emplace_back(process_chunks, i, lanes[i].get(), std::cref(geom), std::ref(chunks), std::ref(next), std::ref(failed));
+    for (auto& t : workers)
+        t.join();
+    double wall = (monotonic_ns() - t0) * 1e-9;
+    double cpu = cpu_seconds() - cpu0;
+    if (failed)
+        return 1;
+
+    // WRITE LOGS (chunks are in capture and frame order)
+    size_t c = 0;
+    for (Capture& cap : captures) {
+        DetectionLog log;
+        size_t first = c, rows = 0;
+        for (size_t i = first; i < chunks.size() && chunks[i].cap == &cap; i++)
+            rows += chunks[i].dets.size();
+        log.reserve(rows);
+        for (; c < chunks.size() && chunks[c].cap == &cap; c++) {
+            const Chunk& ch = chunks[c];
+            size_t off = 0;
+            for (size_t k = 0; k < ch.counts.size(); k++) {
+                log.append(ch.begin + k + 1, ch.dets.data() + off, ch.counts[k]);
+                off += ch.counts[k];
+            }
+        }
+        std::string path = outdir + "/" + cap.name + ".det";
+        if (!log.write(path, geom))
+            return 1;
+        printf("%-40s %8llu frames %8zu detections -> %s\n", cap.name.c_str(), (unsigned long long) cap.frames,
+               log.records(), path.c_str());
+        for (Segment& s : cap.segments)
+            close(s.fd);
+    }
+
+    printf("Processed %llu frames from %zu captures in %.2f s on %d threads: %.1f fps, %.1f fps per core "
+           "(%.1f fps per CPU second)\n", (unsigned long long) total_frames, captures.size(), wall, threads,
+           total_frames / wall, total_frames / wall / threads, cpu > 0 ? total_frames / cpu : 0.0);
+    if (trace_summary)
+        Tracer::instance().print_summary();
+    return 0;
+}
@@ -0,0 +1,298 @@
+// Microbenchmarks for the RangeDoppler kernels.
+//
+// make; ./bench [-g 512x64x4x3,...] [-j 1,2,4] [-t ms] [-o results.json] [-b baseline.json] [-r percent]
+//
+// Every kernel of the chain (RangeDoppler::Kernel) runs in isolation on a simulated cube
+// (fmcw-sim.hpp), for each geometry (fast x slow x rx x tx) and thread count. With n threads, n
+// independent RangeDoppler instances run the same kernel at once, which shows how a kernel scales
+// once it shares caches and memory bandwidth. Reported per kernel: median ns per call, ns per input sample and the aggregate
+// GB/s of all threads (bytes estimated by RangeDoppler::kernelWork).
+//
+// Results are written as JSON (-o). With -b, every result is compared with the same kernel,
+// geometry and thread count in a stored baseline, and the run fails (exit 2) if a kernel got
+// slower by more than -r percent.
+#include "../../src/rpl/private-header.hpp"
+#include "rapidjson/filereadstream.h"
+#include "rapidjson/prettywriter.h"
+#include <getopt.h>
+#define DEFAULT_GEOMETRIES "256x32x4x3,512x64x4x3,1024x128x4x3"
+#define DEFAULT_THREADS "1,2,4"
+#define DEFAULT_TIME_MS 200         // measured time per kernel, geometry and thread count
+#define DEFAULT_THRESHOLD 10.0      // % slower than the baseline that counts as a regression
+#define BATCHES 15                  // timed batches per thread, the median is reported
+
+struct BenchResult
+{
+    std::string kernel;
+    std::string geometry;
+    int threads;
+    double ns_per_call;
+    double ns_per_sample;
+    double gb_per_s;
+};
+
+// Releases all threads at once so their batches overlap
+class StartBarrier
+{
+    std::mutex m;
+    std::condition_variable cv;
+    int count, waiting;
+    uint64_t generation;
+
+    public:
+        StartBarrier(int n) : count(n), waiting(0), generation(0) {}
+
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(m);
+            uint64_t gen = generation;
+            if (++waiting == count) {
+                waiting = 0;
+                generation++;
+                cv.notify_all();
+                return;
+            }
+            cv.wait(lock, [&] { return gen != generation; });
+        }
+};
+
+static std::string geometry_name(const FrameGeometry& g)
+{
+    return std::to_string(g.fast_time) + "x" + std::to_string(g.slow_time) + "x" + std::to_string(g.rx) + "x" + std::to_string(g.tx);
+}
+
+static bool parse_geometries(const std::string& list, std::vector<FrameGeometry>& out)
+{
+    std::stringstream in(list);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        FrameGeometry g;
+        if (sscanf(item.c_str(), "%dx%dx%dx%d", &g.fast_time, &g.slow_time, &g.rx, &g.tx) != 4 || !g.valid()) {
+            fprintf(stderr, "Error: bad geometry '%s', expected fast x slow x rx x tx\n", item.c_str());
+            return false;
+        }
+        out.push_back(g);
+    }
+    return !out.empty();
+}
+
+// One moving target over noise and a little clutter, so CFAR and the angle search have work to do
+static void synthetic_cube(RadarFrame* f)
+{
+    SimConfig cfg;
+    SimTarget t = {5.0, 1.0, 20.0, 0.0, 1.0};
+    cfg.targets.push_back(t);
+    cfg.clutter_points = 4;
+    FmcwSimulator sim(f->geom, cfg);
+    sim.generate(f->id, f->adc);
+}
+
+// Iterations that take about target_ns on one instance
+static int calibrate(RangeDoppler& rd, int k, double target_ns)
+{
+    int iters = 1;
+    for (;;) {
+        int64_t t0 = monotonic_ns();
+        for (int i = 0; i < iters; i++)
+            rd.runKernel(k);
+        int64_t dt = monotonic_ns() - t0;
+        if (dt >= target_ns || iters >= (1 << 24))
+            return std::max(1, (int) (iters * target_ns / std::max<int64_t>(dt, 1)));
+        iters *= dt < target_ns / 16 ? 16 : 2;
+    }
+}
+
+static void bench_geometry(const FrameGeometry& g, int threads, double time_ms, std::vector<BenchResult>& results)
+{
+    // Instances are created here, the FFTW planner is not thread safe
+    FramePool pool(g, threads + 1);
+    FrameRef prev = pool.acquire();
+    prev->id = 1;
+    synthetic_cube(prev.get());
+    std::vector<std::unique_ptr<RangeDoppler>> rds;
+    std::vector<FrameRef> frames;
+    for (int t = 0; t < threads; t++) {
+        rds.emplace_back(new RangeDoppler("blackman", g));
+        frames.push_back(pool.acquire());
+        frames.back()->id = 2;
+        synthetic_cube(frames.back().get());
+        rds.back()->process_rdm(prev.get());
+        rds.back()->process_rdm(frames.back().get());
+        rds.back()->process_detect(frames.back().get(), prev->rdm);
+    }
+
+    for (int k = 0; k < RangeDoppler::NUM_KERNELS; k++) {
+        int iters = calibrate(*rds[0], k, time_ms * 1e6 / BATCHES);
+        std::vector<std::vector<double>> batch_ns(threads, std::vector<double>(BATCHES));
+        StartBarrier barrier(threads);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t] {
+                for (int b = 0; b < BATCHES; b++) {
+                    barrier.wait();
+                    int64_t t0 = monotonic_ns();
+                    for (int i = 0; i < iters; i++)
+                        rds[t]->runKernel(k);
+                    batch_ns[t][b] = (double) (monotonic_ns() - t0) / iters;
+                }
+            });
+        }
+        for (auto& w : workers)
+            w.join();
+
+        double ns = 0;
+        for (auto& v : batch_ns) {
+            std::sort(v.begin(), v.end());
+            ns += v[BATCHES / 2] / threads;
+        }
+        uint64_t samples, bytes;
+        rds[0]->kernelWork(k, samples, bytes);
+
+        BenchResult r;
+        r.kernel = RangeDoppler::kernelName(k);
+        r.geometry = geometry_name(g);
+        r.threads = threads;
+        r.ns_per_call = ns;
+        r.ns_per_sample = ns / samples;
+        r.gb_per_s = threads * bytes / ns;
+        results.push_back(r);
+        printf("%-10s %-16s %3d %14.0f %12.3f %10.2f\n", r.kernel.c_str(), r.geometry.c_str(), r.threads,
+               r.ns_per_call, r.ns_per_sample, r.gb_per_s);
+    }
+}
+
+static bool write_results(const std::string& path, const std::vector<BenchResult>& results, double time_ms)
+{
+    FILE* fp = fopen(path.c_str(), "w");
+    if (fp == NULL) {
+        perror("[ERROR] opening the results file\n");
+        return false;
+    }
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+
+    char buffer[65536];
+    FileWriteStream os(fp, buffer, sizeof(buffer));
+    PrettyWriter<FileWriteStream> w(os);
+    w.StartObject();
+    w.Key("host");
+    w.String(host);
+    w.Key("wall_time_ns");
+    w.Int64(wall_clock_ns());
+    w.Key("time_ms");
+    w.Double(time_ms);
+    w.Key("results");
+    w.StartArray();
+    for (const BenchResult& r : results) {
+        w.StartObject();
+        w.Key("kernel");
+        w.String(r.kernel.c_str());
+        w.Key("geometry");
+        w.String(r.geometry.c_str());
+        w.Key("threads");
+        w.Int(r.threads);
+        w.Key("ns_per_call");
+        w.Double(r.ns_per_call);
+        w.Key("ns_per_sample");
+        w.Double(r.ns_per_sample);
+        w.Key("gb_per_s");
+        w.Double(r.gb_per_s);
+        w.EndObject();
+    }
+    w.EndArray();
+    w.EndObject();
+    os.Flush();
+    fputc('\n', fp);
+    fclose(fp);
+    return true;
+}
+
+// Prints every kernel slower than the baseline by more than threshold %. Returns the number of
+// regressions, or -1 if the baseline cannot be read.
+static int compare_baseline(const std::string& path, const std::vector<BenchResult>& results, double threshold)
+{
+    FILE* fp = fopen(path.c_str(), "r");
+    if (fp == NULL) {
+        perror("[ERROR] opening the baseline\n");
+        return -1;
+    }
+    char buffer[65536];
+    FileReadStream is(fp, buffer, sizeof(buffer));
+    Document d;
+    d.ParseStream(is);
+    fclose(fp);
+    if (d.HasParseError() || !d.IsObject() || !d.HasMember("results") || !d["results"].IsArray()) {
+        fprintf(stderr, "Error: %s is not a benchmark result file\n", path.c_str());
+        return -1;
+    }
+
+    std::map<std::tuple<std::string, std::string, int>, double> base;
+    for (const Value& r : d["results"].GetArray()) {
+        if (r.HasMember("kernel") && r.HasMember("geometry") && r.HasMember("threads") && r.HasMember("ns_per_call"))
+            base[std::make_tuple(std::string(r["kernel"].GetString()), std::string(r["geometry"].GetString()),
+                                 r["threads"].GetInt())] = r["ns_per_call"].GetDouble();
+    }
+
+    int regressions = 0, compared = 0;
+    printf("\n%-10s %-16s %3s %14s %14s %9s\n", "kernel", "geometry", "thr", "baseline (ns)", "now (ns)", "change");
+    for (const BenchResult& r : results) {
+        auto it = base.find(std::make_tuple(r.kernel, r.geometry, r.threads));
+        if (it == base.end())
+            continue;
+        compared++;
+        double change = (r.ns_per_call / it->second - 1) * 100;
+        bool slower = change > threshold;
+        regressions += slower;
+        printf("%-10s %-16s %3d %14.0f %14.0f %+8.1f%%%s\n", r.kernel.c_str(), r.geometry.c_str(), r.threads,
+               it->second, r.ns_per_call, change, slower ? "  REGRESSION" : "");
+    }
+    printf("%d of %d results more than %.1f%% slower than %s\n", regressions, compared, threshold, path.c_str());
+    return regressions;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string geometry_list = DEFAULT_GEOMETRIES, thread_list = DEFAULT_THREADS, out_path, baseline;
+    double time_ms = DEFAULT_TIME_MS, threshold = DEFAULT_THRESHOLD;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "g:j:t:o:b:r:")) != -1) {
+        switch (opt) {
+            case 'g': geometry_list = optarg; break;
+            case 'j': thread_list = optarg; break;
+            case 't': time_ms = std::max(1.0, atof(optarg)); break;
+            case 'o': out_path = optarg; break;
+            case 'b': baseline = optarg; break;
+            case 'r': threshold = atof(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-g 512x64x4x3,...] [-j 1,2,4] [-t ms] [-o results.json] [-b baseline.json] [-r percent]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    std::vector<FrameGeometry> geometries;
+    std::vector<int> thread_counts;
+    if (!parse_geometries(geometry_list, geometries) || !parse_cpu_list(thread_list, thread_counts) || thread_counts.empty()) {
+        fprintf(stderr, "Error: bad geometry or thread list\n");
+        return 1;
+    }
+    Tracer::instance().enable(false);       // time the kernels, not the trace scopes
+
+    std::vector<BenchResult> results;
+    printf("%-10s %-16s %3s %14s %12s %10s\n", "kernel", "geometry", "thr", "ns/call", "ns/sample", "GB/s");
+    for (const FrameGeometry& g : geometries)
+        for (int threads : thread_counts)
+            if (threads > 0)
+                bench_geometry(g, threads, time_ms, results);
+
+    if (!out_path.empty() && write_results(out_path, results, time_ms))
+        printf("Results written to %s\n", out_path.c_str());
+    if (!baseline.empty()) {
+        int regressions = compare_baseline(baseline, results, threshold);
+        if (regressions < 0)
+            return 1;
+        if (regressions > 0)
+            return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,206 @@
+// Load generator for the fusion server: plays many nodes over the binary TCP uplink, each sending
+// its frames at the frame rate with targets moving through the scene and false detections on top.
+//
+// make; ./load -w load-calibration.txt -n 32     writes the calibration of the simulated nodes
+//       ./server -c load-calibration.txt &
+//       ./load [-a host] [-p port] [-n nodes] [-f fps] [-t targets] [-k clutter] [-s seconds]
+//
+// The nodes sit on a circle around the scene, facing its centre, so every target is seen by the
+// nodes whose field of view it is in. Compare the server's "% busy" (time spent outside
+// epoll_wait) with the number of nodes.
+#include "../../src/rpl/detection-wire.hpp"
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SERVER_PORT 1210
+#define SCENE_RADIUS 20.0           // m, nodes on this circle, targets inside it
+#define FOV_DEG 60.0                // half the azimuth coverage of a node
+#define MAX_RANGE 30.0              // m
+#define TARGET_SPEED 1.5            // m/s
+#define DOPPLER_STEP 0.08           // m/s per bin of the simulated profile
+
+static int64_t wall_clock_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+struct SimNode
+{
+    int id;
+    double x, y, theta;
+    int fd;
+    WireEncoder encoder;
+};
+
+struct Target
+{
+    double x, y, vx, vy;
+};
+
+static void node_pose(int i, int n, SimNode& s)
+{
+    double a = 2 * M_PI * i / n;
+    s.x = SCENE_RADIUS * cos(a);
+    s.y = SCENE_RADIUS * sin(a);
+    s.theta = remainder(a + M_PI, 2 * M_PI);
+}
+
+static bool write_calibration(const std::string& path, int n)
+{
+    FILE* fp = fopen(path.c_str(), "w");
+    if (fp == NULL) {
+        perror("[ERROR] opening the calibration file\n");
+        return false;
+    }
+    fprintf(fp, "# %d simulated nodes of the load generator\n", n);
+    for (int i = 0; i < n; i++) {
+        SimNode s;
+        node_pose(i, n, s);
+        fprintf(fp, "node %d %.3f %.3f %.3f\n", i + 1, s.x, s.y, s.theta * 180 / M_PI);
+    }
+    fclose(fp);
+    return true;
+}
+
+static int connect_to(const std::string& host, int port)
+{
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0) {
+        fprintf(stderr, "Error: cannot resolve %s\n", host.c_str());
+        return -1;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+        perror("[ERROR] connecting to the fusion server\n");
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd >= 0) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string host = "127.0.0.1", calibration;
+    int port = SERVER_PORT, n_nodes = 16, n_targets = 10, n_clutter = 2;
+    double fps = 20, seconds = 30;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:p:n:f:t:k:s:w:")) != -1) {
+        switch (opt) {
+            case 'a': host = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'n': n_nodes = std::max(1, atoi(optarg)); break;
+            case 'f': fps = std::max(1.0, atof(optarg)); break;
+            case 't': n_targets = std::max(0, atoi(optarg)); break;
+            case 'k': n_clutter = std::max(0, std::min(atoi(optarg), WIRE_MAX_DETECTIONS / 2)); break;
+            case 's': seconds = atof(optarg); break;
+            case 'w': calibration = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-w calibration.txt] [-a host] [-p port] [-n nodes] [-f fps] [-t targets] [-k clutter] [-s seconds]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (!calibration.empty())
+        return write_calibration(calibration, n_nodes) ? 0 : 1;
+
+    std::vector<SimNode> nodes(n_nodes);
+    for (int i = 0; i < n_nodes; i++) {
+        SimNode& s = nodes[i];
+        s.id = i + 1;
+        node_pose(i, n_nodes, s);
+        s.encoder = WireEncoder(s.id);
+        s.fd = connect_to(host, port);
+        if (s.fd < 0)
+            return 1;
+    }
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> uni(-1, 1);
+    std::normal_distribution<double> noise(0, 1);
+    std::vector<Target> targets(n_targets);
+    for (Target& t : targets) {
+        double a = M_PI * uni(rng);
+        t = {SCENE_RADIUS / 2 * uni(rng), SCENE_RADIUS / 2 * uni(rng), TARGET_SPEED * cos(a), TARGET_SPEED * sin(a)};
+    }
+
+    std::vector<WireDetection> dets;
+    int64_t period_ns = (int64_t) (1e9 / fps), next = wall_clock_ns();
+    long frames = (long) (seconds * fps), sent = 0;
+    printf("%d nodes, %.0f frames/s each, %d targets, %d false detections per frame\n", n_nodes, fps, n_targets, n_clutter);
+    for (long k = 0; k < frames; k++) {
+        double dt = 1 / fps;
+        for (Target& t : targets) {
+            t.x += t.vx * dt;
+            t.y += t.vy * dt;
+            // Bounces off the edge of the scene
+            if (fabs(t.x) > SCENE_RADIUS / 2)
+                t.vx = -t.vx;
+            if (fabs(t.y) > SCENE_RADIUS / 2)
+                t.vy = -t.vy;
+        }
+        for (SimNode& s : nodes) {
+            dets.clear();
+            for (const Target& t : targets) {
+                double dx = t.x - s.x, dy = t.y - s.y, r = hypot(dx, dy);
+                double az = remainder(atan2(dy, dx) - s.theta, 2 * M_PI) * 180 / M_PI;
+                if (r > MAX_RANGE || fabs(az) > FOV_DEG || (int) dets.size() >= WIRE_MAX_DETECTIONS / 2)
+                    continue;
+                WireDetection d;
+                memset(&d, 0, sizeof(d));
+                d.range = r + 0.03 * noise(rng);
+                d.azimuth = az + 3 * noise(rng);
+                d.doppler = (dx * t.vx + dy * t.vy) / r / DOPPLER_STEP;
+                d.snr = 20;
+                dets.push_back(d);
+            }
+            for (int i = 0; i < n_clutter; i++) {
+                WireDetection d;
+                memset(&d, 0, sizeof(d));
+                d.range = MAX_RANGE * (uni(rng) + 1) / 2;
+                d.azimuth = FOV_DEG * uni(rng);
+                d.doppler = 8 * uni(rng);
+                d.snr = 5;
+                dets.push_back(d);
+            }
+            s.encoder.begin();
+            s.encoder.add_frame(k, wall_clock_ns(), 0, DOPPLER_STEP, dets.data(), dets.size());
+            size_t len;
+            const uint8_t* msg = s.encoder.finish(len);
+            if (send(s.fd, msg, len, MSG_NOSIGNAL) != (ssize_t) len) {
+                perror("[ERROR] sending a frame\n");
+                return 1;
+            }
+        }
+        sent += n_nodes;
+        next += period_ns;
+        struct timespec ts = {(time_t) (next / 1000000000LL), (long) (next % 1000000000LL)};
+        while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+    }
+    printf("%ld frames sent\n", sent);
+    for (SimNode& s : nodes)
+        close(s.fd);
+    return 0;
+}
@@ -0,0 +1,237 @@
+// RDM stream viewer: receives the compressed range-Doppler maps of one or more nodes' rdm_stream
+// stages (rdm-stream.hpp), decodes them and reports bandwidth and latency per node. With -o the
+// newest map of every node is written as an 8-bit PGM image (<prefix><node>.pgm) at each report,
+// for a remote look at the scene without a display stack on either side.
+//
+// make; ./viewer [-p port] [-s stats_s] [-o prefix]
+//
+// Latency is reported twice: on the node (acquisition to encoded, from the message header) and
+// end to end (acquisition to decoded here, CLOCK_REALTIME on both sides, needs synchronised
+// clocks).
+#include "../../src/rpl/rdm-stream.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RECV_CHUNK 65536
+#define MAX_MESSAGE (4 << 20)       // a larger header.bytes is a broken stream
+#define MAX_CONNECTIONS 32
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int)
+{
+    stop_requested = 1;
+}
+
+static int64_t clock_ns(clockid_t c)
+{
+    struct timespec ts;
+    clock_gettime(c, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+struct NodeStats
+{
+    RdmStreamDecoder decoder;
+    uint64_t maps, keyframes, bytes, float_bytes, errors;
+    double node_ms, node_max_ms, e2e_ms, e2e_max_ms, decode_ms;
+
+    NodeStats() { reset(); errors = 0; }
+
+    void reset()
+    {
+        maps = keyframes = bytes = float_bytes = 0;
+        node_ms = node_max_ms = e2e_ms = e2e_max_ms = decode_ms = 0;
+    }
+};
+
+struct Connection
+{
+    int fd;
+    std::vector<uint8_t> buf;
+};
+
+static std::map<int, NodeStats> nodes;
+
+static void handle(const uint8_t* msg, size_t len)
+{
+    RdmStreamHeader h;
+    memcpy(&h, msg, sizeof(h));
+    NodeStats& n = nodes[h.node_id];
+    int64_t t0 = clock_ns(CLOCK_MONOTONIC);
+    std::string error;
+    bool ok = n.decoder.decode(msg, len, &error);
+    double decode_ms = (clock_ns(CLOCK_MONOTONIC) - t0) * 1e-6;
+    n.bytes += len;
+    if (!ok) {
+        if (!error.empty()) {
+            n.errors++;
+            fprintf(stderr, "node %d: %s\n", h.node_id, error.c_str());
+        }
+        return;
+    }
+    double e2e = (clock_ns(CLOCK_REALTIME) - h.t_wall_ns) * 1e-6;
+    n.maps++;
+    n.keyframes += (h.flags & RDMS_KEY) != 0;
+    n.float_bytes += (uint64_t) h.fast_time * h.slow_time * sizeof(float);
+    n.node_ms += h.latency_us * 1e-3;
+    n.node_max_ms = std::max(n.node_max_ms, h.latency_us * 1e-3);
+    n.e2e_ms += e2e;
+    n.e2e_max_ms = std::max(n.e2e_max_ms, e2e);
+    n.decode_ms += decode_ms;
+}
+
+// Cuts the complete messages out of a connection's buffer. False if the stream is broken.
+static bool parse(Connection& c)
+{
+    size_t off = 0;
+    while (true) {
+        long size = rdm_stream_message_size(c.buf.data() + off, c.buf.size() - off);
+        if (size < 0 || size > MAX_MESSAGE)
+            return false;
+        if (size == 0 || (size_t) size > c.buf.size() - off)
+            break;
+        handle(c.buf.data() + off, size);
+        off += size;
+    }
+    c.buf.erase(c.buf.begin(), c.buf.begin() + off);
+    return true;
+}
+
+static void write_pgm(const std::string& path, const RdmStreamDecoder& d)
+{
+    const RdmStreamHeader& h = d.header();
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (fp == NULL) {
+        perror("[ERROR] writing the map image\n");
+        return;
+    }
+    // Range across, Doppler down, as the node's visualizer
+    fprintf(fp, "P5\n%d %d\n255\n", h.fast_time, h.slow_time);
+    fwrite(d.levels(), 1, (size_t) h.fast_time * h.slow_time, fp);
+    fclose(fp);
+}
+
+static void report(double dt, const std::string& image_prefix)
+{
+    for (auto& it : nodes) {
+        NodeStats& n = it.second;
+        double m = n.maps ? (double) n.maps : 1.0;
+        printf("node %d: %.1f maps/s, %.1f kbit/s, %.2f KB/map (%.1fx smaller than float), %llu keyframes, %llu unsynced, "
+               "%llu errors | node %.2f ms max %.2f ms, end to end %.2f ms max %.2f ms, decode %.3f ms\n",
+               it.first, n.maps / dt, n.bytes * 8 / 1000.0 / dt, n.bytes / 1024.0 / m,
+               n.bytes ? (double) n.float_bytes / n.bytes : 0.0, (unsigned long long) n.keyframes,
+               (unsigned long long) n.decoder.getUnsynced(), (unsigned long long) n.errors,
+               n.node_ms / m, n.node_max_ms, n.e2e_ms / m, n.e2e_max_ms, n.decode_ms / m);
+        if (!image_prefix.empty() && n.decoder.getDecoded() > 0)
+            write_pgm(image_prefix + std::to_string(it.first) + ".pgm", n.decoder);
+        n.reset();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int port = RDMS_PORT;
+    double stats_s = 5;
+    std::string image_prefix;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:s:o:")) != -1) {
+        switch (opt) {
+            case 'p': port = atoi(optarg); break;
+            case 's': stats_s = std::max(0.1, atof(optarg)); break;
+            case 'o': image_prefix = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-p port] [-s stats_s] [-o prefix]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_ANY);
+    sa.sin_port = htons(port);
+    if (bind(listen_fd, (struct sockaddr*) &sa, sizeof(sa)) != 0 || listen(listen_fd, 8) != 0) {
+        perror("[ERROR] listening for RDM streams\n");
+        return 1;
+    }
+    printf("Waiting for RDM streams on port %d\n", port);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    std::vector<Connection> conns;
+    std::vector<uint8_t> chunk(RECV_CHUNK);
+    int64_t last_report = clock_ns(CLOCK_MONOTONIC);
+
+    while (!stop_requested) {
+        std::vector<struct pollfd> fds(1 + conns.size());
+        fds[0] = {listen_fd, POLLIN, 0};
+        for (size_t i = 0; i < conns.size(); i++)
+            fds[1 + i] = {conns[i].fd, POLLIN, 0};
+        int r = poll(fds.data(), fds.size(), 100);
+        if (r < 0 && errno != EINTR) {
+            perror("[ERROR] poll\n");
+            break;
+        }
+        // Connections first, accepting may add to conns
+        for (size_t i = conns.size(); i-- > 0;) {
+            if (!(fds[1 + i].revents & (POLLIN | POLLERR | POLLHUP)))
+                continue;
+            ssize_t n = recv(conns[i].fd, chunk.data(), chunk.size(), 0);
+            bool keep = n > 0;
+            if (keep) {
+                conns[i].buf.insert(conns[i].buf.end(), chunk.begin(), chunk.begin() + n);
+                keep = parse(conns[i]);
+                if (!keep)
+                    fprintf(stderr, "Error: not an RDM stream, closing the connection\n");
+            }
+            else if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+                keep = true;
+            }
+            if (!keep) {
+                close(conns[i].fd);
+                conns.erase(conns.begin() + i);
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            struct sockaddr_in peer;
+            socklen_t peer_len = sizeof(peer);
+            int fd = accept(listen_fd, (struct sockaddr*) &peer, &peer_len);
+            if (fd >= 0 && conns.size() >= MAX_CONNECTIONS) {
+                close(fd);
+            }
+            else if (fd >= 0) {
+                printf("Stream from %s\n", inet_ntoa(peer.sin_addr));
+                conns.push_back(Connection{fd, std::vector<uint8_t>()});
+            }
+        }
+
+        int64_t t = clock_ns(CLOCK_MONOTONIC);
+        if ((t - last_report) * 1e-9 >= stats_s) {
+            report((t - last_report) * 1e-9, image_prefix);
+            fflush(stdout);
+            last_report = t;
+        }
+    }
+    for (Connection& c : conns)
+        close(c.fd);
+    close(listen_fd);
+    return 0;
+}
@@ -0,0 +1,134 @@
+// Shared-memory ring reader: follows the frames a node's range_doppler stage writes with
+// `shm=<name>` (shm-ring.hpp) and reports what a local consumer sees, as a starting point for
+// one (ROS bridge, recorder).
+//
+// make; ./reader [-n /rpl_node] [-s stats_s]
+//
+// Every frame is used in place: the detections and the map peak are read straight from the
+// mapping, then the slot's sequence number is checked. A frame the writer rewrote while it was
+// read is counted as torn, a frame overwritten before the reader got to it as missed. Age is
+// the time from the end of the DSP to the read (both CLOCK_MONOTONIC).
+#include "../../src/rpl/shm-ring.hpp"
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+
+#define POLL_US 200                 // between looks at the ring when no frame is new
+#define REOPEN_S 2.0                // no new frame for this long: the writer may have restarted
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int)
+{
+    stop_requested = 1;
+}
+
+static int64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string name = SHM_RING_NAME;
+    double stats_s = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n': name = optarg; break;
+            case 's': stats_s = std::max(0.1, atof(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-n name] [-s stats_s]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    ShmRingReader ring;
+    uint64_t next = 0;                  // next frame to read
+    uint64_t frames = 0, missed = 0, torn = 0, detections = 0;
+    double age_sum = 0, age_max = 0;
+    float peak = 0;
+    int64_t last_stats = now_ns(), last_frame = now_ns();
+
+    while (!stop_requested) {
+        if (!ring.isOpen() || (now_ns() - last_frame) * 1e-9 > REOPEN_S) {
+            if (ring.open(name)) {
+                const ShmRingHeader& h = ring.getHeader();
+                printf("Opened /dev/shm%s: %u slots, %u RDM bins, %u cube samples, writer %lld\n", name.c_str(), h.slots,
+                       h.max_rd_bins, h.max_cube, (long long) h.writer_pid);
+                next = ring.latest();
+            }
+            else if (!ring.isOpen()) {
+                usleep(100000);
+                continue;
+            }
+            last_frame = now_ns();
+        }
+
+        uint64_t latest = ring.latest();
+        if (next >= latest) {
+            usleep(POLL_US);
+        }
+        else {
+            // Frames older than the ring holds are gone
+            uint64_t slots = ring.getHeader().slots;
+            if (latest - next > slots) {
+                missed += latest - slots - next;
+                next = latest - slots;
+            }
+            uint64_t seq;
+            const ShmSlotHeader* s = ring.get(next, seq);
+            if (s == NULL) {
+                // Not finished yet (parallel DSP lanes finish out of order) or already overwritten
+                if (latest - next >= slots)
+                    missed++, next++;
+                else
+                    usleep(POLL_US);
+            }
+            else {
+                int n = s->num_detections;
+                float p = 0;
+                const float* rdm = ring.rdm(s);
+                for (uint32_t i = 0; i < s->rd_bins; i++)
+                    p = std::max(p, rdm[i]);
+                double age = (now_ns() - s->t_processed_ns) * 1e-6;
+                if (ring.valid(s, seq)) {
+                    frames++;
+                    detections += n;
+                    peak = std::max(peak, p);
+                    age_sum += age;
+                    age_max = std::max(age_max, age);
+                }
+                else {
+                    torn++;
+                }
+                next++;
+                last_frame = now_ns();
+            }
+        }
+
+        int64_t t = now_ns();
+        if ((t - last_stats) * 1e-9 >= stats_s) {
+            double dt = (t - last_stats) * 1e-9;
+            printf("%.1f frames/s, %.1f detections/frame, age %.3f ms mean %.3f ms max, RDM peak %.0f, missed %llu, torn %llu\n",
+                   frames / dt, frames ? (double) detections / frames : 0.0, frames ? age_sum / frames : 0.0, age_max,
+                   peak, (unsigned long long) missed, (unsigned long long) torn);
+            frames = detections = 0;
+            age_sum = age_max = 0;
+            peak = 0;
+            last_stats = t;
+        }
+    }
+    return 0;
+}
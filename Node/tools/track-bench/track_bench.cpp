@@ -0,0 +1,168 @@
+// Tracker benchmark: time per frame of the node's tracker (tracker.hpp) against the number of
+// targets, on simulated detections.
+//
+// make; ./track_bench [-t 50,100,200,400] [-c clutter] [-f frames] [-m cv|ca] [-s gnn|jpda] [-k M/N] [-n capacity] [-a sigma_az_deg] [-d pd]
+// e.g. ./track_bench -t 200,500 -c 50 -k 5/6 -n 1024 -s jpda     up to 500 detections x 580 tracks per frame
+// Clutter much denser than the targets confirms false tracks whatever the association, and
+// starts a track per detection outside the gates: check "full" and "confirmed" before trusting
+// the timings.
+//
+// Targets walk at 0.5-2 m/s with slowly wandering headings, turning back towards the middle of
+// a field that grows with their number, so the density stays that of a busy room. Every frame each target is detected
+// with probability pd, with the tracker's measurement noise (range, azimuth, Doppler bin), plus
+// clutter detections spread uniformly. Reported per target count: median, p99 and max time of
+// Tracker::process and of the association's solver alone (clusters and assignment), the largest
+// cluster (tracks + detections), detections that could not start a track because the track
+// store was full (any is a saturated tracker, its timings do not count), tracks held
+// and tracks reported (confirmed or coasting) at the end against the number of targets.
+#include "../../src/rpl/tracker.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+#include <getopt.h>
+
+#define FRAME_PERIOD_S 0.1
+#define DENSITY 0.25                // targets per square metre of field
+#define MIN_RANGE 1.0
+#define TURN_RATE 0.5               // rad/s towards the middle when outside the field
+#define WANDER 0.02                 // rad per frame, heading noise
+
+struct Target
+{
+    double x, y, speed, heading;
+};
+
+static double percentile(std::vector<double> v, double p)
+{
+    std::sort(v.begin(), v.end());
+    return v.empty() ? 0 : v[std::min(v.size() - 1, (size_t) (p * v.size()))];
+}
+
+static void run(int targets, int clutter, int frames, double pd, TrackerConfig cfg)
+{
+    std::mt19937 rng(targets);
+    std::uniform_real_distribution<double> u(0, 1);
+    std::normal_distribution<double> g(0, 1);
+    double side = std::sqrt(targets / DENSITY);         // field: x in [MIN_RANGE, MIN_RANGE + side], y in [-side / 2, side / 2]
+    // JPDA's clutter model: the field seen from the radar spans about 90 deg, the clutter 4 Doppler bins
+    cfg.association.pd = std::min(0.99, std::max(0.01, pd));
+    if (clutter > 0)
+        cfg.association.clutter_density = clutter / (side * M_PI / 2 * 4 * std::abs(cfg.doppler_step));
+
+    std::vector<Target> truth(targets);
+    for (Target& t : truth) {
+        double speed = 0.5 + 1.5 * u(rng), heading = 2 * M_PI * u(rng);
+        t = {MIN_RANGE + side * u(rng), side * (u(rng) - 0.5), speed, heading};
+    }
+
+    std::unique_ptr<Tracker> tracker = make_tracker(cfg);
+    std::vector<Detection> dets;
+    std::vector<double> times, solve_times;
+    int largest = 0;
+    long dropped = 0;
+    std::vector<TrackEstimate> out(cfg.capacity);
+    for (int f = 0; f < frames; f++) {
+        dets.clear();
+        for (Target& t : truth) {
+            t.heading += WANDER * g(rng);
+            if (t.x < MIN_RANGE || t.x > MIN_RANGE + side || std::abs(t.y) > side / 2) {
+                double to_middle = std::atan2(-t.y, MIN_RANGE + side / 2 - t.x);
+                t.heading += std::max(-TURN_RATE * FRAME_PERIOD_S, std::min(TURN_RATE * FRAME_PERIOD_S, std::remainder(to_middle - t.heading, 2 * M_PI)));
+            }
+            double vx = t.speed * std::cos(t.heading), vy = t.speed * std::sin(t.heading);
+            t.x += vx * FRAME_PERIOD_S;
+            t.y += vy * FRAME_PERIOD_S;
+            if (u(rng) > pd)
+                continue;
+            double r = std::hypot(t.x, t.y), az = std::atan2(t.y, t.x), rr = (t.x * vx + t.y * vy) / r;
+            Detection d = {};
+            d.range = r + cfg.sigma_range * g(rng);
+            d.azimuth = az * 180 / M_PI + cfg.sigma_azimuth * g(rng);
+            d.doppler = (rr + cfg.sigma_range_rate * g(rng)) / cfg.doppler_step;
+            d.snr = 10;
+            dets.push_back(d);
+        }
+        for (int c = 0; c < clutter; c++) {
+            double x = MIN_RANGE + side * u(rng), y = side * (u(rng) - 0.5);
+            Detection d = {};
+            d.range = std::hypot(x, y);
+            d.azimuth = std::atan2(y, x) * 180 / M_PI;
+            d.doppler = 4 * (u(rng) - 0.5);
+            d.snr = 3;
+            dets.push_back(d);
+        }
+        std::shuffle(dets.begin(), dets.end(), rng);
+
+        auto t0 = std::chrono::steady_clock::now();
+        tracker->process(dets.data(), dets.size(), (int64_t) (f * FRAME_PERIOD_S * 1e9) + 1);
+        auto t1 = std::chrono::steady_clock::now();
+        if (f >= 10) {                      // after the tracks have formed
+            const AssociationStats& a = tracker->associationStats();
+            times.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+            solve_times.push_back(a.solve_ns / 1e3);
+            largest = std::max(largest, a.largest_tracks + a.largest_detections);
+            dropped += a.births_dropped;
+        }
+    }
+    int confirmed = tracker->report(out.data(), out.size());
+    printf("%8d %10zu %10.1f %10.1f %10.1f %10.1f %10.1f %8d %8ld %8d %10d%s\n", targets, dets.size(), percentile(times, 0.5),
+           percentile(times, 0.99), percentile(times, 1.0), percentile(solve_times, 0.5), percentile(solve_times, 0.99), largest,
+           dropped, tracker->size(), confirmed, dropped > 0 ? "  SATURATED" : "");
+}
+
+int main(int argc, char* argv[])
+{
+    std::string target_list = "50,100,200,400";
+    int clutter = 10, frames = 500;
+    double pd = 0.9;
+    TrackerConfig cfg;
+    cfg.sigma_azimuth = 2;
+    cfg.sigma_process = 1;
+    cfg.doppler_step = FrameGeometry().doppler_step();      // the default profile's
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:c:f:m:s:k:n:a:d:")) != -1) {
+        switch (opt) {
+            case 't': target_list = optarg; break;
+            case 'c': clutter = std::max(0, atoi(optarg)); break;
+            case 'f': frames = std::max(20, atoi(optarg)); break;
+            case 'm':
+                if (!parse_motion_model(optarg, cfg.model)) {
+                    fprintf(stderr, "Error: unknown motion model '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 's':
+                if (!parse_association_mode(optarg, cfg.association.mode)) {
+                    fprintf(stderr, "Error: unknown association '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'k':
+                if (sscanf(optarg, "%d/%d", &cfg.confirm_hits, &cfg.confirm_window) != 2 || cfg.confirm_hits < 1 ||
+                    cfg.confirm_hits > cfg.confirm_window || cfg.confirm_window > 32) {
+                    fprintf(stderr, "Error: confirmation must be M/N with 1 <= M <= N <= 32\n");
+                    return 1;
+                }
+                break;
+            case 'n': cfg.capacity = std::max(1, atoi(optarg)); break;
+            case 'a': cfg.sigma_azimuth = atof(optarg); break;
+            case 'd': pd = std::min(1.0, std::max(0.0, atof(optarg))); break;
+            default:
+                fprintf(stderr, "usage: %s [-t 50,100,200,400] [-c clutter] [-f frames] [-m cv|ca] [-s gnn|jpda] [-k M/N] [-n capacity] [-a sigma_az_deg] [-d pd]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    printf("%s model, %s association, %d-of-%d confirmation, %d frames, pd %.2f, %d clutter/frame, azimuth sigma %.1f deg\n",
+           cfg.model == MOTION_CA ? "CA" : "CV", cfg.association.mode == ASSOC_JPDA ? "JPDA" : "GNN", cfg.confirm_hits, cfg.confirm_window, frames, pd, clutter, cfg.sigma_azimuth);
+    printf("%8s %10s %10s %10s %10s %10s %10s %8s %8s %8s %10s\n", "targets", "dets", "p50 us", "p99 us", "max us", "solve p50", "solve p99",
+           "cluster", "full", "tracks", "confirmed");
+    std::stringstream ss(target_list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        run(std::max(1, atoi(item.c_str())), clutter, frames, pd, cfg);
+    return 0;
+}
@@ -0,0 +1,39 @@
+function log = load_detection_log(path)
+    % Loads a .det detection log written by the node's batch processor
+    % (Node/tools/batch, layout in Node/src/rpl/detection-log.hpp).
+    % Returns a struct with the header fields and one column vector per detection field.
+
+    fid = fopen(path, 'r', 'ieee-le');
+    if fid < 0
+        error('Could not open %s', path);
+    end
+    cleanup = onCleanup(@() fclose(fid));
+
+    magic = fread(fid, 4, '*char')';
+    version = fread(fid, 1, 'uint32');
+    if ~strcmp(magic, 'RDET') || version ~= 1
+        error('%s is not a detection log', path);
+    end
+
+    geometry = fread(fid, 4, 'int32');
+    log.fast_time = geometry(1);
+    log.slow_time = geometry(2);
+    log.rx = geometry(3);
+    log.tx = geometry(4);
+    log.frame_period_ms = fread(fid, 1, 'single');
+    log.frames = fread(fid, 1, 'uint32');
+    records = fread(fid, 1, 'uint64');
+    fseek(fid, 64, 'bof');
+
+    log.frame = fread(fid, records, 'uint32');
+    log.range_bin = fread(fid, records, 'int32');
+    log.doppler_bin = fread(fid, records, 'int32');
+    log.range = fread(fid, records, 'single');
+    log.doppler = fread(fid, records, 'single');
+    log.azimuth = fread(fid, records, 'single');
+    log.elevation = fread(fid, records, 'single');
+    log.snr = fread(fid, records, 'single');
+
+    % Frame start time relative to the first frame
+    log.time_s = (log.frame - 1) * log.frame_period_ms / 1000;
+end